@@ -33,12 +33,76 @@
 
 #include <cbang/json/JSON.h>
 #include <cbang/net/Base64.h>
+#include <cbang/os/Mutex.h>
+#include <cbang/os/SmartLock.h>
+
+#include <map>
 
 using namespace std;
 using namespace cb;
 using namespace Buildbotics;
 
 
+namespace {
+  // Policy serialized once per layout with markers in place of the values.
+  // parts[i] is the literal text before value i.
+  struct PolicyTemplate {
+    vector<string> parts;
+
+    PolicyTemplate(const string &policy, unsigned slots) {
+      string::size_type start = 0;
+
+      for (unsigned i = 0; i < slots; i++) {
+        string quoted = "\"@@" + String(i) + "@@\"";
+        string::size_type end = policy.find(quoted, start);
+        if (end == string::npos) THROW("Invalid policy template");
+
+        parts.push_back(policy.substr(start, end - start));
+        start = end + quoted.length();
+      }
+
+      parts.push_back(policy.substr(start));
+    }
+  };
+
+
+  const unsigned maxTemplates = 64;
+
+  Mutex templatesLock;
+  typedef map<string, SmartPointer<PolicyTemplate> > templates_t;
+  templates_t templates;
+
+
+  string marker(unsigned slot) {return "@@" + String(slot) + "@@";}
+
+
+  void appendQuoted(string &s, const string &value) {
+    s += '"';
+
+    for (unsigned i = 0; i < value.length(); i++) {
+      unsigned char c = value[i];
+
+      switch (c) {
+      case '"': s += "\\\""; break;
+      case '\\': s += "\\\\"; break;
+      case '\n': s += "\\n"; break;
+      case '\r': s += "\\r"; break;
+      case '\t': s += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          s += "\\u00";
+          s += String::hexNibble(c >> 4);
+          s += String::hexNibble(c);
+
+        } else s += c;
+      }
+    }
+
+    s += '"';
+  }
+}
+
+
 void AWS4Post::Condition::write(JSON::Writer &writer) const {
   if (op == "eq") {
     writer.beginDict();
@@ -104,35 +168,103 @@ void AWS4Post::addCondition(const string &name, const string &value,
 
 
 string AWS4Post::getPolicy(const string &id) const {
+  // Values in the order they appear in the policy
+  vector<string> values;
+  values.push_back(getExpiration());
+  for (unsigned i = 0; i < conditions.size(); i++)
+    values.push_back(conditions[i].value);
+  if (hasLengthRange()) {
+    values.push_back(String(minLength));
+    values.push_back(String(maxLength));
+  }
+  values.push_back(getAlgorithm());
+  values.push_back(getCredential(id));
+  values.push_back(getDateTime());
+
+  if (!getCaching()) return writePolicy(values, false);
+
+  // Find or build the template for this policy layout
+  string layout = hasLengthRange() ? "r" : "";
+  for (unsigned i = 0; i < conditions.size(); i++)
+    layout += "/" + conditions[i].op + ":" + conditions[i].name;
+
+  SmartPointer<PolicyTemplate> tmpl;
+  {
+    SmartLock lock(&templatesLock);
+
+    templates_t::iterator it = templates.find(layout);
+    if (it != templates.end()) tmpl = it->second;
+  }
+
+  if (tmpl.isNull()) {
+    tmpl = new PolicyTemplate(writePolicy(values, true), values.size());
+
+    SmartLock lock(&templatesLock);
+    if (templates.size() < maxTemplates) templates[layout] = tmpl;
+  }
+
+  // Substitute
+  string policy = tmpl->parts[0];
+  unsigned rangeSlot = 1 + conditions.size();
+
+  for (unsigned i = 0; i < values.size(); i++) {
+    if (hasLengthRange() && (i == rangeSlot || i == rangeSlot + 1))
+      policy += values[i];
+    else appendQuoted(policy, values[i]);
+
+    policy += tmpl->parts[i + 1];
+  }
+
+  return policy;
+}
+
+
+string AWS4Post::writePolicy(const vector<string> &values, bool markers) const {
   JSON::BufferWriter writer(0, true);
+  unsigned slot = 0;
 
   writer.beginDict();
 
   // Expiration
-  writer.insert("expiration", getExpiration());
+  writer.insert("expiration", markers ? marker(slot) : values[slot]);
+  slot++;
 
   // Conditions
   writer.insertList("conditions");
 
   // User supplied conditions
   for (unsigned i = 0; i < conditions.size(); i++) {
-    writer.beginAppend();
-    conditions[i].write(writer);
+    Condition condition = conditions[i];
+    condition.value = markers ? marker(slot) : values[slot];
+    slot++;
+
+    condition.append(writer);
   }
 
   // Content length range condition
-  if (0 <= minLength && 0 <= maxLength) {
+  if (hasLengthRange()) {
     writer.appendList();
     writer.append("content-length-range");
-    writer.append(minLength);
-    writer.append(maxLength);
+
+    if (markers) {
+      writer.append(marker(slot++));
+      writer.append(marker(slot++));
+
+    } else {
+      writer.append(minLength);
+      writer.append(maxLength);
+      slot += 2;
+    }
+
     writer.endList();
   }
 
   // Required conditions
-  Condition("x-amz-algorithm", getAlgorithm()).append(writer);
-  Condition("x-amz-credential", getCredential(id)).append(writer);
-  Condition("x-amz-date", getDateTime()).append(writer);
+  const char *required[] =
+    {"x-amz-algorithm", "x-amz-credential", "x-amz-date"};
+  for (unsigned i = 0; i < 3; i++, slot++)
+    Condition(required[i], markers ? marker(slot) : values[slot])
+      .append(writer);
 
   writer.endList();
   writer.endDict();
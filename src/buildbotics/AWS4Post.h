@@ -68,6 +68,7 @@ namespace Buildbotics {
              const std::string &region = "us-east-1");
 
     void setLengthRange(int minLength, int maxLength);
+    bool hasLengthRange() const {return 0 <= minLength && 0 <= maxLength;}
 
     void insert(const std::string &name, const std::string &value,
                 bool withCondition = true);
@@ -76,8 +77,14 @@ namespace Buildbotics {
     void addCondition(const std::string &name, const std::string &value,
                       const std::string &op = "eq");
 
+    /// Policies with the same layout, i.e. the same conditions but different
+    /// values, are rendered from a cached template.
     std::string getPolicy(const std::string &id) const;
     void sign(const std::string &id, const std::string &secret);
+
+  protected:
+    std::string writePolicy(const std::vector<std::string> &values,
+                            bool markers) const;
   };
 }
 
@@ -33,7 +33,10 @@
 
 #include <cbang/String.h>
 #include <cbang/openssl/Digest.h>
+#include <cbang/os/Mutex.h>
+#include <cbang/os/SmartLock.h>
 
+#include <map>
 #include <cctype>
 
 using namespace std;
@@ -41,6 +44,18 @@ using namespace cb;
 using namespace Buildbotics;
 
 
+namespace {
+  // Signing keys may be derived on task threads
+  Mutex keyCacheLock;
+  typedef map<string, string> key_cache_t;
+  key_cache_t keyCache;
+  string keyCacheDate;
+}
+
+
+bool AWS4Signature::caching = true;
+
+
 AWS4Signature::AWS4Signature(unsigned expires, uint64_t ts,
                              const string &service, const string &region) :
   expires(expires), ts(ts), service(service), region(region) {}
@@ -57,10 +72,36 @@ string AWS4Signature::getCredential(const string &id) const {
 
 
 string AWS4Signature::getKey(const string &secret) const {
-  string key = Digest::signHMAC("AWS4" + secret, getDate(), "sha256");
+  string date = getDate();
+  string cacheKey = region + "/" + service + "/" + secret;
+
+  if (caching) {
+    SmartLock lock(&keyCacheLock);
+
+    if (date == keyCacheDate) {
+      key_cache_t::const_iterator it = keyCache.find(cacheKey);
+      if (it != keyCache.end()) return it->second;
+    }
+  }
+
+  string key = Digest::signHMAC("AWS4" + secret, date, "sha256");
   key = Digest::signHMAC(key, region, "sha256");
   key = Digest::signHMAC(key, service, "sha256");
-  return Digest::signHMAC(key, "aws4_request", "sha256");
+  key = Digest::signHMAC(key, "aws4_request", "sha256");
+
+  if (caching) {
+    SmartLock lock(&keyCacheLock);
+
+    // Rotate at UTC midnight, keys for past dates are not cached
+    if (keyCacheDate < date) {
+      keyCache.clear();
+      keyCacheDate = date;
+    }
+
+    if (date == keyCacheDate) keyCache[cacheKey] = key;
+  }
+
+  return key;
 }
 
 
@@ -40,6 +40,8 @@
 
 namespace Buildbotics {
   class AWS4Signature {
+    static bool caching;
+
   protected:
     unsigned expires;
     uint64_t ts;
@@ -70,11 +72,18 @@ namespace Buildbotics {
     std::string getDateTime() const {return cb::Time(ts, "%Y%m%dT%H%M%SZ");}
     std::string getScope() const;
     std::string getCredential(const std::string &id) const;
+    /// The derived key only changes daily so it is cached per date, region,
+    /// service and secret.  The cache is dropped when the UTC date changes.
     std::string getKey(const std::string &secret) const;
     std::string getSignature(const std::string &secret,
                              const std::string &data) const;
 
     static std::string uriEncode(const std::string &s, bool encodeSlash = true);
+
+    /// Signing keys and policy templates are cached by default.  Disabling
+    /// the caches is only useful for benchmarking.
+    static void setCaching(bool caching) {AWS4Signature::caching = caching;}
+    static bool getCaching() {return caching;}
   };
 }
 
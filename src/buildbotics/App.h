@@ -32,8 +32,17 @@
 #ifndef BUILDBOTICS_APP_H
 #define BUILDBOTICS_APP_H
 
-#include "Server.h"
-#include "UserManager.h"
+#include "Worker.h"
+#include "SharedSessionTable.h"
+#include "TaskPool.h"
+#include "Supervisor.h"
+#include "Storage.h"
+#include "ThumbnailCache.h"
+#include "ThingCache.h"
+#include "RateLimiter.h"
+#include "Tracer.h"
+#include "WriteBatch.h"
+#include "AWS4PresignedURL.h"
 
 #include <cbang/ServerApplication.h>
 #include <cbang/net/IPAddress.h>
@@ -44,92 +53,261 @@
 #include <cbang/auth/GitHubOAuth2.h>
 #include <cbang/auth/FacebookOAuth2.h>
 
-#include <cbang/event/Base.h>
-#include <cbang/event/DNSBase.h>
-#include <cbang/event/Client.h>
+#include <map>
+#include <vector>
 
 namespace cb {
-  namespace Event {class Event;}
-  namespace MariaDB {class EventDB;}
+  namespace Event {
+    class Base;
+    class Event;
+    class Request;
+  }
+  namespace MariaDB {
+    class DB;
+    class EventDB;
+  }
+  namespace JSON {class Dict;}
 }
 
 
 namespace Buildbotics {
   class App : public cb::ServerApplication {
-    cb::Event::Base base;
-    cb::Event::DNSBase dns;
-    cb::Event::Client client;
-
     cb::GoogleOAuth2 googleAuth;
     cb::GitHubOAuth2 githubAuth;
     cb::FacebookOAuth2 facebookAuth;
 
-    Server server;
-    UserManager userManager;
+    // The first worker runs on the main thread
+    std::vector<cb::SmartPointer<Worker> > workers;
+    uint32_t workerThreads;
+    std::vector<cb::IPAddress> listenAddresses;
+    std::vector<cb::IPAddress> secureListenAddresses;
+
+    Supervisor supervisor;
+    uint32_t workerProcesses;
+    std::vector<int> listenSockets;
+    std::vector<int> secureListenSockets;
+
+    // HTTP/2
+    std::vector<cb::IPAddress> http2ListenAddresses;
+    std::vector<cb::IPAddress> secureHTTP2ListenAddresses;
+    std::vector<int> http2ListenSockets;
+    std::vector<int> secureHTTP2ListenSockets;
+    uint32_t http2MaxBodySize;
+
+    SharedSessionTable sharedSessions;
+
+    TaskPool taskPool;
+    uint32_t taskThreads;
+    uint32_t taskQueueSize;
 
     cb::IPAddress outboundIP;
     std::string imageHost;
     std::string sessionCookieName;
     uint64_t authTimeout;
     uint64_t authGraceperiod;
+    uint32_t maxSessions;
+    uint32_t sessionCleanupPeriod;
+    uint32_t sessionShmSize;
+    uint32_t authUserCacheTimeout;
     cb::KeyPair key;
 
+    typedef std::map<std::string, std::string> session_keys_t;
+    session_keys_t sessionKeys;
+    std::string sessionKeyID;
+
     std::string dbHost;
     std::string dbUser;
     std::string dbPass;
     std::string dbName;
     uint32_t dbPort;
     unsigned dbTimeout;
+    uint32_t dbMaxConnections;
     double dbMaintenancePeriod;
+    double counterRollupPeriod;
 
     std::string awsID;
     std::string awsSecret;
     std::string awsBucket;
     std::string awsRegion;
     uint32_t awsUploadExpires;
+    bool awsPrivate;
+    uint32_t awsDownloadWindow;
+    std::string awsEndpoint;
+    uint32_t awsPartSize;
+
+    cb::SmartPointer<Storage> storage;
+    std::string storageRoot;
+    uint32_t uploadMaxSize;
+    uint32_t httpMaxBodySize;
+    std::string uploadURL;
+    std::vector<cb::IPAddress> uploadListenAddresses;
+    std::vector<int> uploadListenSockets;
+
+    ThumbnailCache thumbnailCache;
+    std::string thumbnailCacheDir;
+    uint64_t thumbnailCacheSize;
+    uint64_t thumbnailMaxPixels;
+    uint64_t thumbnailMaxSourceSize;
+
+    ThingCache thingCache;
+    uint32_t thingCacheSize;
+    uint32_t thingCacheTimeout;
+    uint32_t compressionMinSize;
+    bool viewsPending;
+    ThingCache::views_t viewsQueue;
+    ThingCache::views_t viewsBatch;
+    cb::SmartPointer<cb::MariaDB::EventDB> viewsDB;
+
+    WriteQueue writeQueue;
+    double writeQueuePeriod;
+    bool writesPending;
+    cb::SmartPointer<WriteBatch> writeBatch;
+
+    RateLimiter rateLimiter;
+    double rateLimits[RateLimiter::CLASSES];
+    double rateLimitBurst;
+    uint32_t rateLimitClients;
+
+    Tracer tracer;
+    double traceSample;
+    double traceThreshold;
+    std::string traceFile;
 
     cb::SmartPointer<cb::MariaDB::EventDB> maintenanceDB;
 
+    // Multipart uploads aborted in S3, forgotten in the DB in batches
+    std::vector<std::string> abortedUploads;
+    bool abortedPending;
+    cb::SmartPointer<cb::MariaDB::EventDB> abortedDB;
+
+    bool rollupPending;
+    cb::SmartPointer<cb::MariaDB::EventDB> rollupDB;
+
   public:
     App();
 
     static bool _hasFeature(int feature);
 
-    cb::Event::Base &getEventBase() {return base;}
-    cb::Event::DNSBase &getEventDNS() {return dns;}
-    cb::Event::Client &getEventClient() {return client;}
+    Worker &getMainWorker() {return *workers[0];}
+    cb::Event::Base &getEventBase() {return workers[0]->getEventBase();}
+    const std::vector<cb::IPAddress> &getListenAddresses() const
+    {return listenAddresses;}
+    const std::vector<cb::IPAddress> &getSecureListenAddresses() const
+    {return secureListenAddresses;}
+    const std::vector<int> &getListenSockets() const {return listenSockets;}
+    const std::vector<int> &getSecureListenSockets() const
+    {return secureListenSockets;}
+    const std::vector<cb::IPAddress> &getHTTP2ListenAddresses() const
+    {return http2ListenAddresses;}
+    const std::vector<cb::IPAddress> &getSecureHTTP2ListenAddresses() const
+    {return secureHTTP2ListenAddresses;}
+    const std::vector<int> &getHTTP2ListenSockets() const
+    {return http2ListenSockets;}
+    const std::vector<int> &getSecureHTTP2ListenSockets() const
+    {return secureHTTP2ListenSockets;}
+    uint32_t getHTTP2MaxBodySize() const {return http2MaxBodySize;}
+    uint32_t getUploadMaxSize() const {return uploadMaxSize;}
+    uint32_t getHTTPMaxBodySize() const {return httpMaxBodySize;}
+    const std::string &getUploadURL() const {return uploadURL;}
+    const std::vector<cb::IPAddress> &getUploadListenAddresses() const
+    {return uploadListenAddresses;}
+    const std::vector<int> &getUploadListenSockets() const
+    {return uploadListenSockets;}
+    /// @return true if uploads have their own listeners
+    bool hasUploadListeners() const
+    {return !uploadListenAddresses.empty() || !uploadListenSockets.empty();}
+
+    Supervisor &getSupervisor() {return supervisor;}
+    unsigned getProcessIndex() const {return supervisor.getIndex();}
 
     cb::GoogleOAuth2 &getGoogleAuth() {return googleAuth;}
     cb::GitHubOAuth2 &getGitHubAuth() {return githubAuth;}
     cb::FacebookOAuth2 &getFacebookAuth() {return facebookAuth;}
 
-    Server &getServer() {return server;}
-    UserManager &getUserManager() {return userManager;}
+    SharedSessionTable &getSharedSessions() {return sharedSessions;}
+    TaskPool &getTaskPool() {return taskPool;}
 
-    cb::SmartPointer<cb::MariaDB::EventDB> getDBConnection();
+    cb::SmartPointer<cb::MariaDB::EventDB>
+    getDBConnection(cb::Event::Base &base);
+    /// For shutdown, after the event loops have stopped
+    cb::SmartPointer<cb::MariaDB::DB> getBlockingDBConnection();
+    uint32_t getDBMaxConnections() const {return dbMaxConnections;}
+    std::string addSessionKey(const std::string &secret);
 
     const cb::IPAddress &getOutboundIP() const {return outboundIP;}
     const std::string &getImageHost() const {return imageHost;}
     const std::string &getSessionCookieName() const {return sessionCookieName;}
     uint64_t getAuthTimeout() const {return authTimeout;}
     uint64_t getAuthGraceperiod() const {return authGraceperiod;}
+    uint32_t getMaxSessions() const {return maxSessions;}
+    uint32_t getSessionCleanupPeriod() const {return sessionCleanupPeriod;}
+    uint32_t getAuthUserCacheTimeout() const {return authUserCacheTimeout;}
+    uint32_t getCompressionMinSize() const {return compressionMinSize;}
     const cb::KeyPair &getPrivateKey() const {return key;}
+    const std::string &getSessionKeyID() const {return sessionKeyID;}
+    const std::string &getSessionKey() const
+    {return sessionKeys.at(sessionKeyID);}
+    const std::string *findSessionKey(const std::string &id) const;
 
     const std::string &getAWSID() const {return awsID;}
     const std::string &getAWSSecret() const {return awsSecret;}
     const std::string &getAWSBucket() const {return awsBucket;}
     const std::string &getAWSRegion() const {return awsRegion;}
     uint32_t getAWSUploadExpires() const {return awsUploadExpires;}
+    bool getAWSPrivate() const {return awsPrivate;}
+    uint32_t getAWSDownloadWindow() const {return awsDownloadWindow;}
+    uint32_t getAWSPartSize() const {return awsPartSize;}
+    std::string getAWSBucketURL() const;
+    AWS4PresignedURL getS3URL(const std::string &path,
+                              cb::HTTP::RequestMethod method,
+                              unsigned expires) const;
+    void signS3URL(AWS4PresignedURL &url) const;
+
+    Storage &getStorage() {return *storage;}
+    ThumbnailCache &getThumbnailCache() {return thumbnailCache;}
+    uint64_t getThumbnailMaxPixels() const {return thumbnailMaxPixels;}
+    uint64_t getThumbnailMaxSourceSize() const
+    {return thumbnailMaxSourceSize;}
+    ThingCache &getThingCache() {return thingCache;}
+    WriteQueue &getWriteQueue() {return writeQueue;}
+    RateLimiter &getRateLimiter() {return rateLimiter;}
+    Tracer &getTracer() {return tracer;}
 
     // From cb::Application
     int init(int argc, char *argv[]);
     void run();
 
     void dbMaintenanceCB(cb::MariaDB::EventDBCallback::state_t state);
+    void abandonedUploadsCB(cb::MariaDB::EventDBCallback::state_t state);
+    bool uploadAbortedCB(cb::Event::Request &req);
+    void abortedUploadsCB(cb::MariaDB::EventDBCallback::state_t state);
+    void viewsCB(cb::MariaDB::EventDBCallback::state_t state);
+    void rollupCB(cb::MariaDB::EventDBCallback::state_t state);
+    void writesFlushed(bool success);
 
     void maintenanceEvent(cb::Event::Event &e, int signal, unsigned flags);
+    void rollupEvent(cb::Event::Event &e, int signal, unsigned flags);
     void lifelineEvent(cb::Event::Event &e, int signal, unsigned flags);
     void signalEvent(cb::Event::Event &e, int signal, unsigned flags);
+    void statsEvent(cb::Event::Event &e, int signal, unsigned flags);
+    void viewsEvent(cb::Event::Event &e, int signal, unsigned flags);
+    void writesEvent(cb::Event::Event &e, int signal, unsigned flags);
+
+  protected:
+    void benchmarkSigning(unsigned count);
+    void benchmarkSQL(unsigned count);
+    void initWorkers();
+    void exitWorkers();
+    static std::string getViewsSQL(const ThingCache::views_t &views,
+                                   cb::JSON::Dict &args);
+    void sendViews();
+    void flushViews();
+    /// Synchronously write @param inFlight and then everything queued
+    void drainWrites(const WriteQueue::writes_t &inFlight =
+                     WriteQueue::writes_t());
+    void forgetAbortedUploads();
+    void parseListenAddresses(const std::string &name,
+                              std::vector<cb::IPAddress> &addrs);
   };
 }
 
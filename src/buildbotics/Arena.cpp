@@ -0,0 +1,104 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "Arena.h"
+
+using namespace std;
+using namespace Buildbotics;
+
+
+namespace {
+  const size_t alignment = 16;
+}
+
+
+Arena::Arena(ArenaPool &pool, size_t blockSize) :
+  pool(pool), blockSize(blockSize), first(new char[blockSize]), next(first),
+  remaining(blockSize), used(0), peak(0), overflows(0), route(0) {}
+
+
+Arena::~Arena() {
+  reset();
+  delete [] first;
+}
+
+
+void *Arena::allocate(size_t size) {
+  size = (size + alignment - 1) & ~(alignment - 1);
+
+  if (remaining < size) {
+    // Oversized requests get a block of their own
+    size_t length = size < blockSize ? blockSize : size;
+    next = new char[length];
+    remaining = length;
+    extra.push_back(next);
+    overflows++;
+  }
+
+  void *ptr = next;
+  next += size;
+  remaining -= size;
+  used += size;
+  if (peak < used) peak = used;
+
+  return ptr;
+}
+
+
+Arena::Mark Arena::mark() const {
+  Mark mark = {(unsigned)extra.size(), next, remaining, used};
+  return mark;
+}
+
+
+void Arena::rewind(const Mark &mark) {
+  while (mark.blocks < extra.size()) {
+    delete [] extra.back();
+    extra.pop_back();
+  }
+
+  next = mark.next;
+  remaining = mark.remaining;
+  used = mark.used;
+}
+
+
+void Arena::reset() {
+  for (unsigned i = 0; i < extra.size(); i++) delete [] extra[i];
+  extra.clear();
+
+  next = first;
+  remaining = blockSize;
+  used = 0;
+  peak = 0;
+  overflows = 0;
+  route = 0;
+}
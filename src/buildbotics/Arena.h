@@ -0,0 +1,91 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_ARENA_H
+#define BUILDBOTICS_ARENA_H
+
+#include <vector>
+
+#include <stddef.h>
+
+
+namespace Buildbotics {
+  class ArenaPool;
+
+  /// A bump allocator for one request.  Nothing is freed individually,
+  /// reset() releases everything at once.  Objects placed in the arena must
+  /// have their destructors called by their owner.
+  class Arena {
+    ArenaPool &pool;
+    size_t blockSize;
+    char *first;
+    std::vector<char *> extra;
+
+    char *next;
+    size_t remaining;
+    size_t used;
+    size_t peak;
+    unsigned overflows;
+    const char *route;
+
+  public:
+    Arena(ArenaPool &pool, size_t blockSize);
+    ~Arena();
+
+    ArenaPool &getPool() {return pool;}
+    size_t getUsed() const {return used;}
+    size_t getPeak() const {return peak;}
+    /// @return The number of blocks allocated beyond the first
+    unsigned getOverflows() const {return overflows;}
+
+    /// The pattern of the handler which matched the request, for stats
+    const char *getRoute() const {return route;}
+    void setRoute(const char *route) {this->route = route;}
+
+    void *allocate(size_t size);
+    template <typename T> T *allocate(unsigned count)
+    {return (T *)allocate(sizeof(T) * count);}
+
+    struct Mark {
+      unsigned blocks;
+      char *next;
+      size_t remaining;
+      size_t used;
+    };
+
+    /// Everything allocated after @param mark is released by rewind()
+    Mark mark() const;
+    void rewind(const Mark &mark);
+    void reset();
+  };
+}
+
+#endif // BUILDBOTICS_ARENA_H
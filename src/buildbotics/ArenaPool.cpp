@@ -0,0 +1,108 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "ArenaPool.h"
+#include "Arena.h"
+
+#include <cbang/json/Writer.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const size_t blockSize = 16 * 1024;  // Fits a Transaction and its scratch
+  const unsigned maxPooled = 256;
+}
+
+
+ArenaPool::ArenaPool() : created(0), reused(0) {}
+
+
+ArenaPool::~ArenaPool() {
+  for (unsigned i = 0; i < arenas.size(); i++) delete arenas[i];
+}
+
+
+Arena &ArenaPool::acquire() {
+  if (arenas.empty()) {
+    created++;
+    return *new Arena(*this, blockSize);
+  }
+
+  Arena *arena = arenas.back();
+  arenas.pop_back();
+  reused++;
+
+  return *arena;
+}
+
+
+void ArenaPool::release(Arena *arena) {
+  if (arena->getRoute()) {
+    RouteStats &stats = routes[arena->getRoute()];
+    stats.requests++;
+    stats.bytes += arena->getPeak();
+    if (stats.maxBytes < arena->getPeak()) stats.maxBytes = arena->getPeak();
+    if (arena->getOverflows()) stats.overflows++;
+  }
+
+  if (maxPooled <= arenas.size()) delete arena;
+  else {
+    arena->reset();
+    arenas.push_back(arena);
+  }
+}
+
+
+void ArenaPool::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("pooled", arenas.size());
+  writer.insert("created", created);
+  writer.insert("reused", reused);
+
+  writer.insertDict("routes");
+  for (routes_t::const_iterator it = routes.begin(); it != routes.end();
+       it++) {
+    const RouteStats &stats = it->second;
+
+    writer.insertDict(it->first);
+    writer.insert("requests", stats.requests);
+    writer.insert("bytes", stats.bytes);
+    writer.insert("max_bytes", stats.maxBytes);
+    writer.insert("overflows", stats.overflows);
+    writer.endDict();
+  }
+  writer.endDict();
+
+  writer.endDict();
+}
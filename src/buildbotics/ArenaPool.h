@@ -0,0 +1,78 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_ARENA_POOL_H
+#define BUILDBOTICS_ARENA_POOL_H
+
+#include <cbang/StdTypes.h>
+
+#include <vector>
+#include <map>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  class Arena;
+
+  /// Recycles request Arenas and records their use per route.  Not thread
+  /// safe, each Worker has its own.
+  class ArenaPool {
+    std::vector<Arena *> arenas;
+
+    uint64_t created;
+    uint64_t reused;
+
+    struct RouteStats {
+      uint64_t requests;
+      uint64_t bytes;
+      uint64_t maxBytes;
+      uint64_t overflows;
+
+      RouteStats() : requests(0), bytes(0), maxBytes(0), overflows(0) {}
+    };
+
+    // Keyed by the matcher's pattern, which outlives the pool's users
+    typedef std::map<const char *, RouteStats> routes_t;
+    routes_t routes;
+
+  public:
+    ArenaPool();
+    ~ArenaPool();
+
+    Arena &acquire();
+    void release(Arena *arena);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+  };
+}
+
+#endif // BUILDBOTICS_ARENA_POOL_H
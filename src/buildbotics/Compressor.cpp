@@ -0,0 +1,173 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "Compressor.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/json/Writer.h>
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+#include <vector>
+#include <string.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const int gzipLevel = 6;
+#ifdef HAVE_BROTLI
+  const int brotliQuality = 5; // Fast enough for dynamic responses
+#endif
+
+
+  /// @return The q value of @param coding in @param accept, -1 if absent
+  double getQuality(const string &accept, const string &coding) {
+    vector<string> codings;
+    String::tokenize(accept, codings, ",");
+
+    for (unsigned i = 0; i < codings.size(); i++) {
+      vector<string> parts;
+      String::tokenize(codings[i], parts, ";");
+      if (parts.empty() || String::toLower(String::trim(parts[0])) != coding)
+        continue;
+
+      for (unsigned j = 1; j < parts.size(); j++) {
+        string param = String::trim(parts[j]);
+        if (String::startsWith(param, "q="))
+          try {
+            return String::parseDouble(param.substr(2));
+          } catch (const Exception &e) {return 0;}
+      }
+
+      return 1;
+    }
+
+    return -1;
+  }
+}
+
+
+Compressor::Compressor() :
+  bytesIn(0), bytesOut(0), gzipped(0), brotlied(0) {
+  memset(&stream, 0, sizeof(stream));
+
+  // 16 + window bits selects the gzip format
+  if (deflateInit2(&stream, gzipLevel, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    THROW("Failed to initialize deflate");
+}
+
+
+Compressor::~Compressor() {
+  deflateEnd(&stream);
+}
+
+
+const char *Compressor::negotiate(const string &acceptEncoding) {
+#ifdef HAVE_BROTLI
+  if (accepts(acceptEncoding, "br")) return "br";
+#endif
+  if (accepts(acceptEncoding, "gzip")) return "gzip";
+  return 0;
+}
+
+
+bool Compressor::accepts(const string &acceptEncoding, const string &coding) {
+  return 0 < getQuality(acceptEncoding, coding);
+}
+
+
+bool Compressor::isCompressible(const string &contentType) {
+  string type = String::toLower(contentType);
+
+  return String::startsWith(type, "text/") ||
+    type.find("json") != string::npos ||
+    type.find("javascript") != string::npos ||
+    type.find("xml") != string::npos;
+}
+
+
+const string &Compressor::compress(const char *encoding, const char *data,
+                                   unsigned length) {
+#ifdef HAVE_BROTLI
+  if (string("br") == encoding) {
+    size_t size = BrotliEncoderMaxCompressedSize(length);
+    buffer.resize(size);
+
+    if (!BrotliEncoderCompress(brotliQuality, BROTLI_DEFAULT_WINDOW,
+                               BROTLI_MODE_TEXT, length,
+                               (const uint8_t *)data, &size,
+                               (uint8_t *)&buffer[0]))
+      THROW("Brotli compression failed");
+
+    buffer.resize(size);
+    brotlied++;
+
+  } else
+#endif
+  {
+    if (deflateReset(&stream) != Z_OK) THROW("Failed to reset deflate");
+
+    buffer.resize(deflateBound(&stream, length));
+
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = length;
+    stream.next_out = (Bytef *)&buffer[0];
+    stream.avail_out = buffer.size();
+
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+      THROW("gzip compression failed");
+
+    buffer.resize(stream.total_out);
+    gzipped++;
+  }
+
+  bytesIn += length;
+  bytesOut += buffer.size();
+
+  return buffer;
+}
+
+
+void Compressor::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("gzip", gzipped);
+  writer.insert("br", brotlied);
+  writer.insert("bytes_in", bytesIn);
+  writer.insert("bytes_out", bytesOut);
+  writer.endDict();
+}
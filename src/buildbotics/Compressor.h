@@ -0,0 +1,76 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_COMPRESSOR_H
+#define BUILDBOTICS_COMPRESSOR_H
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+
+#include <zlib.h>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  /// Compresses responses with gzip or, when built with HAVE_BROTLI, Brotli.
+  /// The deflate stream is reset and reused between responses.  Not thread
+  /// safe, each Worker has its own.
+  class Compressor {
+    z_stream stream;
+    std::string buffer;
+
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t gzipped;
+    uint64_t brotlied;
+
+  public:
+    Compressor();
+    ~Compressor();
+
+    /// @return "br", "gzip" or 0 if @param acceptEncoding allows neither
+    static const char *negotiate(const std::string &acceptEncoding);
+    static bool accepts(const std::string &acceptEncoding,
+                        const std::string &coding);
+    static bool isCompressible(const std::string &contentType);
+
+    /// @return The compressed data, valid until the next call
+    const std::string &compress(const char *encoding, const char *data,
+                                unsigned length);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+  };
+}
+
+#endif // BUILDBOTICS_COMPRESSOR_H
+
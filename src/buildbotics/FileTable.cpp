@@ -0,0 +1,177 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "FileTable.h"
+#include "ResourceHandler.h"
+
+#include <cbang/Exception.h>
+#include <cbang/time/Time.h>
+#include <cbang/os/SysError.h>
+#include <cbang/json/Writer.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const unsigned checkInterval = 1; // seconds
+  const unsigned maxEntries = 4096;
+  const uint64_t maxSize = 64 * 1024 * 1024; // Bytes
+  const uint64_t maxFileSize = 8 * 1024 * 1024; // Larger files are not kept
+}
+
+
+FileTable::File::File(const string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) THROWS("Failed to open '" << path << "': " << SysError());
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    THROWS("Failed to stat '" << path << "': " << SysError());
+  }
+
+  dev = st.st_dev;
+  ino = st.st_ino;
+  mtime = st.st_mtime;
+
+  // Read to the end, a file truncated meanwhile is just shorter
+  data.reserve(st.st_size);
+  char buffer[64 * 1024];
+
+  while (true) {
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      close(fd);
+      THROWS("Failed to read '" << path << "': " << SysError());
+    }
+
+    if (!count) break;
+    data.append(buffer, count);
+  }
+
+  close(fd);
+
+  etag = ResourceHandler::getETag(data.data(), data.length());
+}
+
+
+bool FileTable::File::isCurrent(const struct stat &st) const {
+  return st.st_dev == dev && st.st_ino == ino && st.st_mtime == mtime &&
+    (uint64_t)st.st_size == data.length();
+}
+
+
+FileTable::FileTable() : size(0), hits(0), loads(0), evictions(0) {}
+
+
+SmartPointer<FileTable::File> FileTable::lookup(const string &path) {
+  uint64_t now = Time::now();
+  entries_t::iterator it = entries.find(path);
+
+  if (it != entries.end()) {
+    Entry &entry = it->second;
+    lru.splice(lru.begin(), lru, entry.it);
+
+    if (now < entry.checked + checkInterval) {
+      hits++;
+      return entry.file;
+    }
+  }
+
+  struct stat st;
+  bool exists = !stat(path.c_str(), &st) && S_ISREG(st.st_mode);
+
+  if (it != entries.end()) {
+    Entry &entry = it->second;
+
+    if (exists ? !entry.file.isNull() && entry.file->isCurrent(st) :
+        entry.file.isNull()) {
+      entry.checked = now;
+      hits++;
+      return entry.file;
+    }
+
+    // Changed or removed, in flight responses keep the old copy
+    erase(it);
+  }
+
+  SmartPointer<File> file;
+  if (exists) {
+    file = new File(path);
+    loads++;
+
+    if (maxFileSize < file->data.length()) return file;
+  }
+
+  Entry &entry = entries[path];
+  entry.file = file;
+  entry.checked = now;
+  entry.it = lru.insert(lru.begin(), path);
+  if (exists) size += file->data.length();
+
+  evict();
+
+  return file;
+}
+
+
+void FileTable::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("files", entries.size());
+  writer.insert("size", size);
+  writer.insert("hits", hits);
+  writer.insert("loads", loads);
+  writer.insert("evictions", evictions);
+  writer.endDict();
+}
+
+
+void FileTable::erase(entries_t::iterator it) {
+  if (!it->second.file.isNull()) size -= it->second.file->data.length();
+  lru.erase(it->second.it);
+  entries.erase(it);
+}
+
+
+void FileTable::evict() {
+  while ((maxEntries < entries.size() || maxSize < size) && !lru.empty()) {
+    erase(entries.find(lru.back()));
+    evictions++;
+  }
+}
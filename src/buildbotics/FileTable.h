@@ -0,0 +1,102 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_FILE_TABLE_H
+#define BUILDBOTICS_FILE_TABLE_H
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <list>
+#include <map>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  /// Caches the files served from http-root in memory.  Each path, including
+  /// ones which do not exist, is restatted at most once a second and files
+  /// are reread when they change.  Rewriting a file in place cannot crash
+  /// the server but may briefly serve a partial copy, so files should be
+  /// replaced, e.g. by rename().  The least recently used files are dropped
+  /// to keep the table in bounds.  Not thread safe, each Worker has its own.
+  class FileTable {
+  public:
+    struct File {
+      std::string data;
+      dev_t dev;
+      ino_t ino;
+      time_t mtime;
+      std::string etag;
+
+      File(const std::string &path);
+
+      bool isCurrent(const struct stat &st) const;
+    };
+
+  protected:
+    typedef std::list<std::string> lru_t;
+    lru_t lru; // Most recent first
+
+    struct Entry {
+      cb::SmartPointer<File> file; // Null if not a regular file
+      uint64_t checked;
+      lru_t::iterator it;
+    };
+
+    typedef std::map<std::string, Entry> entries_t;
+    entries_t entries;
+
+    uint64_t size;
+    uint64_t hits;
+    uint64_t loads;
+    uint64_t evictions;
+
+  public:
+    FileTable();
+
+    /// @return The current contents of @param path or null if it is not a
+    /// regular file.
+    cb::SmartPointer<File> lookup(const std::string &path);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+
+  protected:
+    void erase(entries_t::iterator it);
+    void evict();
+  };
+}
+
+#endif // BUILDBOTICS_FILE_TABLE_H
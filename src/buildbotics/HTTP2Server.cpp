@@ -0,0 +1,208 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "HTTP2Server.h"
+#include "HTTP2Session.h"
+#include "Worker.h"
+#include "App.h"
+
+#include <cbang/Exception.h>
+#include <cbang/net/IPAddress.h>
+#include <cbang/os/SysError.h>
+#include <cbang/log/Logger.h>
+#include <cbang/json/Writer.h>
+#include <cbang/openssl/SSLContext.h>
+
+#include <event2/listener.h>
+#include <event2/bufferevent.h>
+#include <event2/bufferevent_ssl.h>
+#include <event2/event.h>
+
+#include <openssl/ssl.h>
+#include <nghttp2/nghttp2.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  // Marks SSL objects accepted on HTTP/2 listeners
+  int alpnIndex = -1;
+
+
+  int selectProtocol(SSL *ssl, const unsigned char **out,
+                     unsigned char *outlen, const unsigned char *in,
+                     unsigned inlen, void *arg) {
+    // The https listeners share the SSL_CTX but only speak HTTP/1.1
+    if (!SSL_get_ex_data(ssl, alpnIndex)) return SSL_TLSEXT_ERR_NOACK;
+
+    if (nghttp2_select_next_protocol((unsigned char **)out, outlen, in,
+                                     inlen) != 1)
+      return SSL_TLSEXT_ERR_NOACK;
+
+    return SSL_TLSEXT_ERR_OK;
+  }
+
+
+  void acceptCB(evconnlistener *listener, evutil_socket_t fd,
+                sockaddr *addr, int len, void *arg) {
+    try {
+      ((HTTP2Server *)arg)->connected(fd, addr, false);
+    } CATCH_ERROR;
+  }
+
+
+  void acceptSecureCB(evconnlistener *listener, evutil_socket_t fd,
+                      sockaddr *addr, int len, void *arg) {
+    try {
+      ((HTTP2Server *)arg)->connected(fd, addr, true);
+    } CATCH_ERROR;
+  }
+}
+
+
+HTTP2Server::HTTP2Server(Worker &worker) :
+  worker(worker), connections(0), streams(0), active(0) {}
+
+
+HTTP2Server::~HTTP2Server() {
+  for (unsigned i = 0; i < listeners.size(); i++)
+    evconnlistener_free(listeners[i]);
+
+  while (!sessions.empty()) remove(*sessions.begin());
+}
+
+
+void HTTP2Server::init() {
+  App &app = worker.getApp();
+
+  const vector<int> &sockets = app.getHTTP2ListenSockets();
+  const vector<int> &secureSockets = app.getSecureHTTP2ListenSockets();
+  const vector<IPAddress> &addrs = app.getHTTP2ListenAddresses();
+  const vector<IPAddress> &secureAddrs = app.getSecureHTTP2ListenAddresses();
+
+  if (sockets.empty() && secureSockets.empty() && addrs.empty() &&
+      secureAddrs.empty()) return;
+
+  // Negotiate h2 on the secure listeners
+  if (!secureSockets.empty() || !secureAddrs.empty()) {
+    if (alpnIndex == -1) alpnIndex = SSL_get_ex_new_index(0, 0, 0, 0, 0);
+    SSL_CTX_set_alpn_select_cb(worker.getSSLContext()->getCTX(),
+                               selectProtocol, 0);
+  }
+
+  // Listen on sockets bound by the supervisor
+  for (unsigned i = 0; i < sockets.size(); i++) accept(dup(sockets[i]), false);
+  for (unsigned i = 0; i < secureSockets.size(); i++)
+    accept(dup(secureSockets[i]), true);
+
+  for (unsigned i = 0; i < addrs.size(); i++) listen(addrs[i], false);
+  for (unsigned i = 0; i < secureAddrs.size(); i++)
+    listen(secureAddrs[i], true);
+}
+
+
+void HTTP2Server::listen(const IPAddress &addr, bool secure) {
+  accept(Worker::bind(addr), secure);
+
+  LOG_INFO(3, "Worker " << worker.getID() << " listening for HTTP/2 on "
+           << addr << (secure ? " (SSL)" : ""));
+}
+
+
+void HTTP2Server::accept(int fd, bool secure) {
+  if (fd == -1) THROWS("Invalid listen socket: " << SysError());
+
+  evconnlistener *listener =
+    evconnlistener_new(worker.getEventBase().getBase(),
+                       secure ? acceptSecureCB : acceptCB, this,
+                       LEV_OPT_CLOSE_ON_FREE, 0, fd);
+
+  if (!listener) {
+    ::close(fd);
+    THROWS("Failed to accept HTTP/2 on socket " << fd);
+  }
+
+  listeners.push_back(listener);
+}
+
+
+void HTTP2Server::connected(int fd, const sockaddr *addr, bool secure) {
+  event_base *base = worker.getEventBase().getBase();
+  bufferevent *bev;
+
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+  if (secure) {
+    SSL *ssl = SSL_new(worker.getSSLContext()->getCTX());
+    SSL_set_ex_data(ssl, alpnIndex, this);
+    bev = bufferevent_openssl_socket_new(base, fd, ssl,
+                                         BUFFEREVENT_SSL_ACCEPTING,
+                                         BEV_OPT_CLOSE_ON_FREE);
+
+  } else bev = bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE);
+
+  if (!bev) {
+    ::close(fd);
+    THROW("Failed to create HTTP/2 connection");
+  }
+
+  char peer[INET_ADDRSTRLEN] = "";
+  inet_ntop(AF_INET, &((const sockaddr_in *)addr)->sin_addr, peer,
+            sizeof(peer));
+
+  sessions.insert(new HTTP2Session(*this, bev, peer));
+  connections++;
+}
+
+
+void HTTP2Server::remove(HTTP2Session *session) {
+  sessions.erase(session);
+  delete session;
+}
+
+
+void HTTP2Server::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("sessions", sessions.size());
+  writer.insert("connections", connections);
+  writer.insert("streams", streams);
+  writer.insert("active", active);
+  writer.endDict();
+}
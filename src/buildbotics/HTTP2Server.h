@@ -0,0 +1,88 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_HTTP2_SERVER_H
+#define BUILDBOTICS_HTTP2_SERVER_H
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <vector>
+#include <set>
+#include <string>
+
+struct evconnlistener;
+struct sockaddr;
+
+namespace cb {
+  class IPAddress;
+  namespace JSON {class Writer;}
+}
+
+
+namespace Buildbotics {
+  class Worker;
+  class HTTP2Session;
+
+  /// Accepts HTTP/2 connections, h2 over TLS negotiated with ALPN or h2c
+  /// with prior knowledge.  Each stream becomes a Transaction of the
+  /// Worker's own Server, so routing and handlers are shared with HTTP/1.1.
+  /// Not thread safe, each Worker has its own.
+  class HTTP2Server {
+    Worker &worker;
+
+    std::vector<evconnlistener *> listeners;
+    std::set<HTTP2Session *> sessions;
+
+    uint64_t connections;
+    uint64_t streams;
+    uint32_t active;
+
+  public:
+    HTTP2Server(Worker &worker);
+    ~HTTP2Server();
+
+    Worker &getWorker() {return worker;}
+
+    void init();
+    void listen(const cb::IPAddress &addr, bool secure);
+    void accept(int fd, bool secure);
+    void connected(int fd, const sockaddr *addr, bool secure);
+    void remove(HTTP2Session *session);
+
+    void streamStarted() {streams++; active++;}
+    void streamFinished() {active--;}
+
+    void writeStats(cb::JSON::Writer &writer) const;
+  };
+}
+
+#endif // BUILDBOTICS_HTTP2_SERVER_H
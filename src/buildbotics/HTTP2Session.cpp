@@ -0,0 +1,511 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "HTTP2Session.h"
+#include "HTTP2Server.h"
+#include "Worker.h"
+#include "App.h"
+#include "Server.h"
+#include "Transaction.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/event/HTTPStatus.h>
+#include <cbang/log/Logger.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <event2/bufferevent.h>
+#include <event2/buffer.h>
+#include <event2/http.h>
+#include <event2/http_struct.h>
+#include <event2/keyvalq_struct.h>
+
+#include <nghttp2/nghttp2.h>
+
+#include <string.h>
+#include <stdlib.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const size_t maxOutput = 1 << 20;     // Buffered before blocking nghttp2
+  const int idleTimeout = 300;          // seconds
+  const uint32_t maxStreams = 100;
+  const uint32_t windowSize = 1 << 20;
+
+
+  HTTP2Session &getSession(void *data) {return *(HTTP2Session *)data;}
+
+
+  ssize_t sendCB(nghttp2_session *session, const uint8_t *data,
+                 size_t length, int flags, void *user) {
+    return getSession(user).send(data, length);
+  }
+
+
+  int beginHeadersCB(nghttp2_session *session, const nghttp2_frame *frame,
+                     void *user) {
+    return getSession(user).beginHeaders(*frame);
+  }
+
+
+  int headerCB(nghttp2_session *session, const nghttp2_frame *frame,
+               const uint8_t *name, size_t namelen, const uint8_t *value,
+               size_t valuelen, uint8_t flags, void *user) {
+    return getSession(user).header(*frame, string((const char *)name, namelen),
+                                   string((const char *)value, valuelen));
+  }
+
+
+  int dataChunkCB(nghttp2_session *session, uint8_t flags, int32_t id,
+                  const uint8_t *data, size_t length, void *user) {
+    return getSession(user).dataChunk(id, data, length);
+  }
+
+
+  int frameRecvCB(nghttp2_session *session, const nghttp2_frame *frame,
+                  void *user) {
+    return getSession(user).frameReceived(*frame);
+  }
+
+
+  int streamCloseCB(nghttp2_session *session, int32_t id, uint32_t error,
+                    void *user) {
+    return getSession(user).streamClosed(id);
+  }
+
+
+  ssize_t readBodyCB(nghttp2_session *session, int32_t id, uint8_t *buf,
+                     size_t length, uint32_t *flags,
+                     nghttp2_data_source *source, void *user) {
+    evbuffer *body = (evbuffer *)source->ptr;
+
+    int bytes = evbuffer_remove(body, buf, length);
+    if (bytes < 0) return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+    if (!evbuffer_get_length(body)) *flags |= NGHTTP2_DATA_FLAG_EOF;
+
+    return bytes;
+  }
+
+
+  bool isHopByHop(const string &name) {
+    return name == "connection" || name == "keep-alive" ||
+      name == "proxy-connection" || name == "transfer-encoding" ||
+      name == "upgrade" || name == "te";
+  }
+
+
+  bool parseMethod(const string &method, evhttp_cmd_type &type) {
+    if (method == "GET") type = EVHTTP_REQ_GET;
+    else if (method == "POST") type = EVHTTP_REQ_POST;
+    else if (method == "PUT") type = EVHTTP_REQ_PUT;
+    else if (method == "DELETE") type = EVHTTP_REQ_DELETE;
+    else if (method == "HEAD") type = EVHTTP_REQ_HEAD;
+    else if (method == "OPTIONS") type = EVHTTP_REQ_OPTIONS;
+    else if (method == "PATCH") type = EVHTTP_REQ_PATCH;
+    else return false;
+
+    return true;
+  }
+}
+
+
+HTTP2Session::Stream::Stream(HTTP2Session &session, int32_t id) :
+  session(session), id(id), req(evhttp_request_new(0, 0)), tx(0),
+  responded(false) {
+  if (!req) THROW("Failed to allocate HTTP/2 request");
+}
+
+
+HTTP2Session::Stream::~Stream() {
+  delete tx; // Returns its Arena
+
+  // Replies without a connection only mark the request for freeing
+  req->flags &= ~EVHTTP_REQ_DEFER_FREE;
+  evhttp_request_free(req);
+}
+
+
+void HTTP2Session::Stream::replied() {
+  if (responded || !evhttp_request_get_response_code(req)) return;
+  responded = true;
+  session.respond(*this);
+}
+
+
+void HTTP2Session::Stream::released() {
+  delete this; // Already out of its session, which may be gone
+}
+
+
+HTTP2Session::HTTP2Session(HTTP2Server &server, bufferevent *bev,
+                           const string &peer) :
+  server(server), bev(bev), peer(peer), session(0) {
+  nghttp2_session_callbacks *callbacks;
+  if (nghttp2_session_callbacks_new(&callbacks)) {
+    bufferevent_free(bev);
+    THROW("Failed to allocate HTTP/2 callbacks");
+  }
+
+  nghttp2_session_callbacks_set_send_callback(callbacks, sendCB);
+  nghttp2_session_callbacks_set_on_begin_headers_callback
+    (callbacks, beginHeadersCB);
+  nghttp2_session_callbacks_set_on_header_callback(callbacks, headerCB);
+  nghttp2_session_callbacks_set_on_data_chunk_recv_callback
+    (callbacks, dataChunkCB);
+  nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, frameRecvCB);
+  nghttp2_session_callbacks_set_on_stream_close_callback
+    (callbacks, streamCloseCB);
+
+  int ret = nghttp2_session_server_new(&session, callbacks, this);
+  nghttp2_session_callbacks_del(callbacks);
+
+  if (ret) {
+    bufferevent_free(bev);
+    THROWS("Failed to create HTTP/2 session: " << nghttp2_strerror(ret));
+  }
+
+  nghttp2_settings_entry settings[] = {
+    {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, maxStreams},
+    {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, windowSize},
+  };
+  nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, settings, 2);
+
+  struct timeval tv = {idleTimeout, 0};
+  bufferevent_set_timeouts(bev, &tv, 0);
+  bufferevent_setcb(bev, readCB, writeCB, eventCB, this);
+  bufferevent_enable(bev, EV_READ | EV_WRITE);
+
+  flush();
+}
+
+
+HTTP2Session::~HTTP2Session() {
+  nghttp2_session_del(session);
+  bufferevent_free(bev);
+
+  // Frees any Transactions still running, or orphans those with outgoing
+  // calls
+  while (!streams.empty()) release(*streams.begin());
+}
+
+
+bool HTTP2Session::read() {
+  evbuffer *input = bufferevent_get_input(bev);
+  size_t length = evbuffer_get_length(input);
+  const uint8_t *data = evbuffer_pullup(input, -1);
+
+  ssize_t bytes = nghttp2_session_mem_recv(session, data, length);
+  if (bytes < 0) {
+    LOG_DEBUG(3, "HTTP/2 from " << peer << ": " << nghttp2_strerror(bytes));
+    return false;
+  }
+
+  evbuffer_drain(input, bytes);
+
+  return flush();
+}
+
+
+bool HTTP2Session::flush() {
+  if (nghttp2_session_send(session)) return false;
+
+  // Done when neither side has anything left to say
+  return nghttp2_session_want_read(session) ||
+    nghttp2_session_want_write(session) ||
+    evbuffer_get_length(bufferevent_get_output(bev));
+}
+
+
+void HTTP2Session::close() {server.remove(this);}
+
+
+void HTTP2Session::dispatch(Stream &stream) {
+  evhttp_cmd_type type;
+  if (!parseMethod(stream.method, type)) return reply(stream, 501);
+  if (stream.path.empty() || stream.path[0] != '/')
+    return reply(stream, 400);
+
+  evhttp_request *req = stream.req;
+  evkeyvalq *headers = evhttp_request_get_input_headers(req);
+
+  string host = stream.authority;
+  string cookies;
+
+  for (unsigned i = 0; i < stream.headers.size(); i++) {
+    const string &name = stream.headers[i].first;
+    const string &value = stream.headers[i].second;
+
+    if (name == "host") {if (host.empty()) host = value;}
+
+    // HTTP/2 splits cookies, the handlers expect one header
+    else if (name == "cookie") cookies += (cookies.empty() ? "" : "; ") + value;
+
+    // Set below from the connection's peer
+    else if (name != "x-real-ip" && !isHopByHop(name))
+      evhttp_add_header(headers, name.c_str(), value.c_str());
+  }
+
+  evhttp_add_header(headers, "Host", host.c_str());
+  if (!cookies.empty()) evhttp_add_header(headers, "Cookie", cookies.c_str());
+  evhttp_add_header(headers, "X-Real-IP", peer.c_str());
+
+  // Fill in what libevent's HTTP/1.1 parser would have
+  req->kind = EVHTTP_REQUEST;
+  req->type = type;
+  req->major = 2;
+  req->minor = 0;
+  req->uri = strdup(stream.path.c_str());
+  req->uri_elems = req->uri ? evhttp_uri_parse(req->uri) : 0;
+  req->remote_host = strdup(peer.c_str());
+  if (!req->uri_elems) return reply(stream, 400);
+
+  // There is no connection to send on, a reply only sets the response
+  req->flags |= EVHTTP_REQ_DEFER_FREE;
+
+  Server &http = server.getWorker().getServer();
+  try {
+    stream.tx = (Transaction *)http.createRequest(req);
+  } catch (const Exception &e) {
+    LOG_ERROR("HTTP/2 request: " << e);
+    return reply(stream, Event::HTTP_SERVICE_UNAVAILABLE);
+  }
+
+  stream.tx->setResponder(&stream);
+  server.streamStarted();
+
+  try {
+    if (!http(*stream.tx)) stream.tx->sendError(Event::HTTP_NOT_FOUND);
+
+  } catch (const Exception &e) {
+    int code = e.getCode();
+    if (code < 400 || 600 <= code) code = Event::HTTP_INTERNAL_SERVER_ERROR;
+    stream.tx->sendError(code, e.getMessage());
+
+  } catch (const std::exception &e) {
+    stream.tx->sendError(Event::HTTP_INTERNAL_SERVER_ERROR, e.what());
+  }
+
+  // Handlers which are not Transactions reply without telling the stream
+  stream.replied();
+}
+
+
+void HTTP2Session::respond(Stream &stream) {
+  evhttp_request *req = stream.req;
+  evbuffer *body = evhttp_request_get_output_buffer(req);
+  bool head = stream.method == "HEAD";
+  if (head) evbuffer_drain(body, evbuffer_get_length(body));
+
+  headers_t headers;
+  int code = evhttp_request_get_response_code(req);
+  headers.push_back(headers_t::value_type(":status", String(code)));
+
+  evkeyvalq *output = evhttp_request_get_output_headers(req);
+  for (evkeyval *header = output->tqh_first; header;
+       header = header->next.tqe_next) {
+    string name = String::toLower(header->key);
+    if (isHopByHop(name) || (!head && name == "content-length")) continue;
+    headers.push_back(headers_t::value_type(name, header->value));
+  }
+
+  if (!head)
+    headers.push_back(headers_t::value_type
+                      ("content-length", String(evbuffer_get_length(body))));
+
+  submit(stream, headers, body);
+
+  // Replies can come from deep inside a Transaction, flush from the loop
+  bufferevent_trigger(bev, EV_WRITE, BEV_TRIG_IGNORE_WATERMARKS |
+                      BEV_TRIG_DEFER_CALLBACKS);
+}
+
+
+void HTTP2Session::reply(Stream &stream, int code) {
+  stream.responded = true;
+
+  headers_t headers;
+  headers.push_back(headers_t::value_type(":status", String(code)));
+  headers.push_back(headers_t::value_type("content-length", "0"));
+
+  submit(stream, headers, 0);
+}
+
+
+void HTTP2Session::submit(Stream &stream, const headers_t &headers,
+                          evbuffer *body) {
+  vector<nghttp2_nv> nv(headers.size());
+
+  for (unsigned i = 0; i < headers.size(); i++) {
+    nv[i].name = (uint8_t *)headers[i].first.data();
+    nv[i].namelen = headers[i].first.length();
+    nv[i].value = (uint8_t *)headers[i].second.data();
+    nv[i].valuelen = headers[i].second.length();
+    nv[i].flags = NGHTTP2_NV_FLAG_NONE;
+  }
+
+  // Headers are copied, the body is read as the flow control window allows
+  nghttp2_data_provider provider;
+  provider.source.ptr = body;
+  provider.read_callback = readBodyCB;
+
+  bool hasBody = body && evbuffer_get_length(body);
+  int ret = nghttp2_submit_response(session, stream.id, &nv[0], nv.size(),
+                                    hasBody ? &provider : 0);
+  if (ret)
+    LOG_WARNING("HTTP/2 response to " << peer << ": "
+                << nghttp2_strerror(ret));
+}
+
+
+void HTTP2Session::release(Stream *stream) {
+  streams.erase(stream);
+  if (stream->tx) server.streamFinished();
+
+  // Outgoing calls hold the Transaction, it has the stream released later
+  if (stream->tx && stream->tx->orphan()) return;
+
+  delete stream;
+}
+
+
+ssize_t HTTP2Session::send(const uint8_t *data, size_t length) {
+  evbuffer *output = bufferevent_get_output(bev);
+
+  // Resumed by writeCB() once the socket catches up
+  if (maxOutput <= evbuffer_get_length(output))
+    return NGHTTP2_ERR_WOULDBLOCK;
+
+  if (evbuffer_add(output, data, length)) return NGHTTP2_ERR_CALLBACK_FAILURE;
+
+  return length;
+}
+
+
+int HTTP2Session::beginHeaders(const nghttp2_frame &frame) {
+  if (frame.hd.type != NGHTTP2_HEADERS ||
+      frame.headers.cat != NGHTTP2_HCAT_REQUEST) return 0;
+
+  Stream *stream;
+  try {
+    stream = new Stream(*this, frame.hd.stream_id);
+  } catch (const Exception &e) {
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  streams.insert(stream);
+  nghttp2_session_set_stream_user_data(session, frame.hd.stream_id, stream);
+
+  return 0;
+}
+
+
+int HTTP2Session::header(const nghttp2_frame &frame, const string &name,
+                         const string &value) {
+  Stream *stream = (Stream *)
+    nghttp2_session_get_stream_user_data(session, frame.hd.stream_id);
+  if (!stream || frame.hd.type != NGHTTP2_HEADERS) return 0;
+
+  if (name == ":method") stream->method = value;
+  else if (name == ":path") stream->path = value;
+  else if (name == ":authority") stream->authority = value;
+  else if (name[0] != ':')
+    stream->headers.push_back(headers_t::value_type(name, value));
+
+  return 0;
+}
+
+
+int HTTP2Session::dataChunk(int32_t id, const uint8_t *data, size_t length) {
+  Stream *stream = (Stream *)nghttp2_session_get_stream_user_data(session, id);
+  if (!stream) return 0;
+
+  // Streams know their route, so only uploads get the large limit
+  App &app = server.getWorker().getApp();
+  evbuffer *body = evhttp_request_get_input_buffer(stream->req);
+  uint32_t maxBody = String::startsWith(stream->path, "/api/uploads/") ?
+    app.getUploadMaxSize() : app.getHTTP2MaxBodySize();
+  if (maxBody < evbuffer_get_length(body) + length) {
+    nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, id,
+                              NGHTTP2_REFUSED_STREAM);
+    return 0;
+  }
+
+  evbuffer_add(body, data, length);
+
+  return 0;
+}
+
+
+int HTTP2Session::frameReceived(const nghttp2_frame &frame) {
+  if ((frame.hd.type != NGHTTP2_HEADERS && frame.hd.type != NGHTTP2_DATA) ||
+      !(frame.hd.flags & NGHTTP2_FLAG_END_STREAM)) return 0;
+
+  Stream *stream = (Stream *)
+    nghttp2_session_get_stream_user_data(session, frame.hd.stream_id);
+
+  // Request complete
+  if (stream && !stream->tx && !stream->responded) dispatch(*stream);
+
+  return 0;
+}
+
+
+int HTTP2Session::streamClosed(int32_t id) {
+  Stream *stream = (Stream *)nghttp2_session_get_stream_user_data(session, id);
+  if (!stream) return 0;
+
+  release(stream);
+
+  return 0;
+}
+
+
+void HTTP2Session::readCB(bufferevent *bev, void *arg) {
+  HTTP2Session &session = getSession(arg);
+  if (!session.read()) session.close();
+}
+
+
+void HTTP2Session::writeCB(bufferevent *bev, void *arg) {
+  HTTP2Session &session = getSession(arg);
+  if (!session.flush()) session.close();
+}
+
+
+void HTTP2Session::eventCB(bufferevent *bev, short events, void *arg) {
+  // Connected is the end of the TLS handshake
+  if (events & BEV_EVENT_CONNECTED) return;
+  getSession(arg).close();
+}
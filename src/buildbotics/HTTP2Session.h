@@ -0,0 +1,123 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_HTTP2_SESSION_H
+#define BUILDBOTICS_HTTP2_SESSION_H
+
+#include "Responder.h"
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include <sys/types.h>
+
+struct bufferevent;
+struct evbuffer;
+struct evhttp_request;
+struct nghttp2_session;
+struct nghttp2_frame;
+
+
+namespace Buildbotics {
+  class HTTP2Server;
+  class Transaction;
+
+  /// One HTTP/2 connection.  nghttp2 handles framing, HPACK and flow
+  /// control.  Each stream is handed to the Worker's Server as a
+  /// Transaction, without an HTTP/1.1 connection, and its reply is read
+  /// back out of the request as the flow control window allows.
+  class HTTP2Session {
+  public:
+    typedef std::vector<std::pair<std::string, std::string> > headers_t;
+
+    struct Stream : public Responder {
+      HTTP2Session &session;
+      int32_t id;
+
+      std::string method;
+      std::string path;
+      std::string authority;
+      headers_t headers;
+
+      evhttp_request *req; // Request body in, response body out
+      Transaction *tx;     // Owned, lives until the stream is freed
+      bool responded;
+
+      Stream(HTTP2Session &session, int32_t id);
+      ~Stream();
+
+      // From Responder
+      void replied();
+      void released();
+    };
+
+  protected:
+    HTTP2Server &server;
+    bufferevent *bev;
+    std::string peer;
+    nghttp2_session *session;
+    std::set<Stream *> streams;
+
+  public:
+    HTTP2Session(HTTP2Server &server, bufferevent *bev,
+                 const std::string &peer);
+    ~HTTP2Session();
+
+    bool read();
+    bool flush();
+    void close();
+
+    void dispatch(Stream &stream);
+    void respond(Stream &stream);
+    void reply(Stream &stream, int code);
+    void submit(Stream &stream, const headers_t &headers, evbuffer *body);
+    void release(Stream *stream);
+
+    // nghttp2 callbacks
+    ssize_t send(const uint8_t *data, size_t length);
+    int beginHeaders(const nghttp2_frame &frame);
+    int header(const nghttp2_frame &frame, const std::string &name,
+               const std::string &value);
+    int dataChunk(int32_t id, const uint8_t *data, size_t length);
+    int frameReceived(const nghttp2_frame &frame);
+    int streamClosed(int32_t id);
+
+    // libevent callbacks
+    static void readCB(bufferevent *bev, void *arg);
+    static void writeCB(bufferevent *bev, void *arg);
+    static void eventCB(bufferevent *bev, short events, void *arg);
+  };
+}
+
+#endif // BUILDBOTICS_HTTP2_SESSION_H
@@ -30,25 +30,43 @@
 \******************************************************************************/
 
 #include "HTTPRE2Matcher.h"
+#include "Transaction.h"
+#include "Arena.h"
 
 #include <cbang/Exception.h>
 #include <cbang/event/Request.h>
 #include <cbang/event/RestoreURIPath.h>
 #include <cbang/log/Logger.h>
 
-#include <vector>
+#include <new>
 
 using namespace std;
 using namespace cb;
 using namespace Buildbotics;
 
 
+void RE2Captures::bind(Arena &arena) {
+  results = arena.allocate<re2::StringPiece>(max);
+  RE2::Arg *argObjs = arena.allocate<RE2::Arg>(max);
+  args = arena.allocate<const RE2::Arg *>(max);
+
+  for (unsigned i = 0; i < max; i++) {
+    new (&results[i]) re2::StringPiece;
+    new (&argObjs[i]) RE2::Arg(&results[i]);
+    args[i] = &argObjs[i];
+  }
+}
+
+
 HTTPRE2Matcher::HTTPRE2Matcher(unsigned methods, const string &search,
                                const string &replace,
-                               const SmartPointer<Event::HTTPHandler> &child) :
-  methods(methods), matchAll(search.empty()), regex(search), replace(replace),
-  child(child) {
+                               const SmartPointer<Event::HTTPHandler> &child,
+                               RE2Captures &captures) :
+  methods(methods), matchAll(search.empty()), regex(search),
+  groups(regex.NumberOfCapturingGroups()), replace(replace), child(child),
+  captures(captures) {
   if (regex.error_code()) THROWS("Failed to compile RE2: " << regex.error());
+  captures.reserve(groups);
 }
 
 
@@ -56,31 +74,23 @@ bool HTTPRE2Matcher::operator()(Event::Request &req) {
   if (!(methods & req.getMethod())) return false;
   if (matchAll) return (*child)(req);
 
-  int n = regex.NumberOfCapturingGroups();
-  vector<RE2::Arg> args(n);
-  vector<RE2::Arg *> argPtrs(n);
-  vector<string> results(n);
-
-  // Connect args
-  for (int i = 0; i < n; i++) {
-    args[i] = &results[i];
-    argPtrs[i] = &args[i];
-  }
-
   // Attempt match
   URI &uri = req.getURI();
-  string path = uri.getPath();
-  if (!RE2::FullMatchN(path, regex, argPtrs.data(), n))
+  if (!RE2::FullMatchN(uri.getPath(), regex, captures.getArgs(), groups))
     return false;
 
+  string path = uri.getPath();
   LOG_DEBUG(5, path << " matched " << regex.pattern());
 
   // Store results
   const map<int, string> &names = regex.CapturingGroupNames();
-  for (int i = 0; i < n; i++)
+  for (int i = 0; i < groups; i++)
     if (names.find(i + 1) != names.end())
-      req.insertArg(names.at(i + 1), results[i]);
-    else req.insertArg(results[i]);
+      req.insertArg(names.at(i + 1), captures.get(i).as_string());
+    else req.insertArg(captures.get(i).as_string());
+
+  // The Server only routes Transactions
+  static_cast<Transaction &>(req).setRoute(regex.pattern().c_str());
 
   // Replace path
   Event::RestoreURIPath restoreURIPath(uri);
@@ -38,17 +38,42 @@
 
 
 namespace Buildbotics {
+  class Arena;
+
+  /// Capture slots shared by all of a Server's matchers.  Bound once per
+  /// request in its Arena, so trying a route allocates nothing.
+  class RE2Captures {
+    unsigned max;
+    re2::StringPiece *results;
+    const RE2::Arg **args;
+
+  public:
+    RE2Captures() : max(0), results(0), args(0) {}
+
+    void reserve(unsigned n) {if (max < n) max = n;}
+    /// Called before a request is routed
+    void bind(Arena &arena);
+
+    const re2::StringPiece &get(unsigned i) const {return results[i];}
+    const RE2::Arg *const *getArgs() const {return args;}
+  };
+
+
   class HTTPRE2Matcher : public cb::Event::HTTPHandler {
     unsigned methods;
     bool matchAll;
     RE2 regex;
+    int groups;
     std::string replace;
     cb::SmartPointer<cb::Event::HTTPHandler> child;
+    const RE2Captures &captures;
 
   public:
+    /// @param captures must be bound to the request being matched
     HTTPRE2Matcher(unsigned methods, const std::string &search,
                    const std::string &replace,
-                   const cb::SmartPointer<cb::Event::HTTPHandler> &child);
+                   const cb::SmartPointer<cb::Event::HTTPHandler> &child,
+                   RE2Captures &captures);
 
     // From cb::Event::HTTPHandler
     bool operator()(cb::Event::Request &req);
@@ -0,0 +1,269 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "LocalStorage.h"
+#include "App.h"
+#include "Transaction.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/net/URI.h>
+#include <cbang/net/Base64.h>
+#include <cbang/openssl/Digest.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/os/SysError.h>
+#include <cbang/time/Time.h>
+#include <cbang/event/Buffer.h>
+#include <cbang/event/HTTPStatus.h>
+#include <cbang/log/Logger.h>
+
+#include <event2/buffer.h>
+
+#include <vector>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+
+using namespace cb;
+using namespace std;
+using namespace Buildbotics;
+
+
+namespace {
+  const unsigned objectMaxAge = Time::SEC_PER_DAY;
+
+
+  Base64 &tokenBase64() {
+    static Base64 base64('=', '-', '_', 0);
+    return base64;
+  }
+
+
+  bool secureEquals(const string &a, const string &b) {
+    if (a.length() != b.length()) return false;
+
+    unsigned char diff = 0;
+    for (unsigned i = 0; i < a.length(); i++) diff |= a[i] ^ b[i];
+
+    return !diff;
+  }
+
+
+  void writeAll(int fd, const char *data, size_t length) {
+    while (length) {
+      ssize_t n = write(fd, data, length);
+
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        THROWS("Failed to write upload: " << SysError());
+      }
+
+      data += n;
+      length -= n;
+    }
+  }
+}
+
+
+LocalStorage::LocalStorage(App &app, const string &root) :
+  app(app), root(root),
+  key(Digest::hash("buildbotics-storage:" + app.getSessionKey(), "sha256")) {
+  SystemUtilities::ensureDirectory(root + "/tmp");
+  SystemUtilities::ensureDirectory(root + "/objects");
+  SystemUtilities::ensureDirectory(root + "/files");
+
+  // Links name their objects by absolute path
+  char path[PATH_MAX];
+  if (!realpath(root.c_str(), path))
+    THROWS("Failed to resolve storage root '" << root << "': " << SysError());
+  this->root = path;
+}
+
+
+uint64_t LocalStorage::getMaxUploadSize() const {
+  // Otherwise uploads share the HTTP/1 listeners' body limit
+  if (app.hasUploadListeners()) return app.getUploadMaxSize();
+  return min(app.getUploadMaxSize(), app.getHTTPMaxBodySize());
+}
+
+
+void LocalStorage::prepareUpload(Upload &upload) {
+  uint64_t expires = Time::now() + app.getAWSUploadExpires();
+
+  // Format: <signature>.<key, size range and expiration>
+  string body = tokenBase64().encode(upload.key + "\n" +
+                                     String(upload.minSize) + "\n" +
+                                     String(upload.maxSize) + "\n" +
+                                     String(expires));
+
+  upload.method = "PUT";
+  upload.uploadURL =
+    app.getUploadURL() + "/api/uploads/" + sign(body) + "." + body;
+}
+
+
+void LocalStorage::store(Transaction &tx, const string &token) {
+  // Check token
+  string::size_type dot = token.find('.');
+  if (dot == string::npos)
+    THROWC("Invalid upload token", Event::HTTP_BAD_REQUEST);
+
+  string body = token.substr(dot + 1);
+  if (!secureEquals(sign(body), token.substr(0, dot)))
+    THROWC("Invalid upload token", Event::HTTP_UNAUTHORIZED);
+
+  vector<string> parts;
+  String::tokenize(tokenBase64().decode(body), parts, "\n");
+  if (parts.size() != 4)
+    THROWC("Invalid upload token", Event::HTTP_BAD_REQUEST);
+
+  const string &key = parts[0];
+  uint64_t minSize = String::parseU64(parts[1]);
+  uint64_t maxSize = String::parseU64(parts[2]);
+  uint64_t expires = String::parseU64(parts[3]);
+
+  if (expires < Time::now())
+    THROWC("Upload token expired", Event::HTTP_UNAUTHORIZED);
+
+  // The declared length must match the signed size range
+  if (tx.inHas("Content-Length")) {
+    uint64_t declared = String::parseU64(tx.inGet("Content-Length"));
+    if (declared < minSize || maxSize < declared)
+      THROWC("Invalid file size " << declared, Event::HTTP_BAD_REQUEST);
+  }
+
+  evbuffer *input = tx.getInputBuffer().getBuffer();
+  uint64_t length = evbuffer_get_length(input);
+  if (length < minSize || maxSize < length)
+    THROWC("Invalid file size " << length, Event::HTTP_BAD_REQUEST);
+
+  // Write the body straight from the input buffer chunks, hashing as we go
+  string tmp = root + "/tmp/upload-XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd == -1) THROWS("Failed to create '" << tmp << "': " << SysError());
+
+  Digest digest("sha256");
+
+  try {
+    int n = evbuffer_peek(input, -1, 0, 0, 0);
+    vector<evbuffer_iovec> chunks(n < 1 ? 1 : n);
+    n = evbuffer_peek(input, -1, 0, &chunks[0], n);
+
+    for (int i = 0; i < n; i++) {
+      const char *data = (const char *)chunks[i].iov_base;
+      digest.update((const uint8_t *)data, chunks[i].iov_len);
+      writeAll(fd, data, chunks[i].iov_len);
+    }
+
+    close(fd);
+    fd = -1;
+
+    // Content addressed, identical files are stored once
+    string hash = digest.toHexString();
+    string object = getObjectPath(hash);
+    SystemUtilities::ensureDirectory(SystemUtilities::dirname(object));
+
+    if (SystemUtilities::exists(object)) unlink(tmp.c_str());
+    else if (rename(tmp.c_str(), object.c_str()))
+      THROWS("Failed to store '" << object << "': " << SysError());
+
+    // Replace a previous upload atomically, the temporary name is unique
+    // while the upload file was
+    string link = getLinkPath(key);
+    string tmpLink = link + "." + tmp.substr(tmp.rfind('-') + 1);
+    SystemUtilities::ensureDirectory(SystemUtilities::dirname(link));
+
+    if (symlink(object.c_str(), tmpLink.c_str()))
+      THROWS("Failed to link '" << tmpLink << "': " << SysError());
+
+    if (rename(tmpLink.c_str(), link.c_str())) {
+      unlink(tmpLink.c_str());
+      THROWS("Failed to link '" << link << "': " << SysError());
+    }
+
+    LOG_DEBUG(3, "Stored " << key << " as " << hash);
+
+  } catch (...) {
+    if (fd != -1) close(fd);
+    unlink(tmp.c_str());
+    throw;
+  }
+
+  tx.reply(Event::HTTP_CREATED);
+}
+
+
+void LocalStorage::download(Transaction &tx, const string &path,
+                            const string &type) {
+  string link = getFile(path);
+
+  // The link target is named by its hash, a strong ETag
+  char target[PATH_MAX];
+  ssize_t n = readlink(link.c_str(), target, sizeof(target) - 1);
+  if (n < 0) THROWC("File not found", Event::HTTP_NOT_FOUND);
+
+  tx.sendFile(link, type, SystemUtilities::basename(string(target, n)),
+              objectMaxAge);
+}
+
+
+string LocalStorage::getFile(const string &path) const {
+  return getLinkPath(URI::decode(path.substr(1)));
+}
+
+
+string LocalStorage::sign(const string &data) const {
+  return tokenBase64().encode(Digest::signHMAC(key, data, "sha256"));
+}
+
+
+string LocalStorage::getObjectPath(const string &hash) const {
+  return root + "/objects/" + hash.substr(0, 2) + "/" + hash;
+}
+
+
+string LocalStorage::getLinkPath(const string &key) const {
+  vector<string> parts;
+  String::tokenize(key, parts, "/");
+
+  if (parts.size() < 2) THROWC("Invalid file key", Event::HTTP_BAD_REQUEST);
+  for (unsigned i = 0; i < parts.size(); i++)
+    if (parts[i] == "." || parts[i] == "..")
+      THROWC("Invalid file key", Event::HTTP_BAD_REQUEST);
+
+  return root + "/files/" + key;
+}
+
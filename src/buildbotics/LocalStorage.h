@@ -0,0 +1,76 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_LOCAL_STORAGE_H
+#define BUILDBOTICS_LOCAL_STORAGE_H
+
+#include "Storage.h"
+
+#include <cbang/StdTypes.h>
+
+
+namespace Buildbotics {
+  class App;
+
+  /// Files stored on local disk under storage-root.  Objects are content
+  /// addressed, objects/<ab>/<sha256>, so identical uploads share one copy.
+  /// Each upload key is a symlink, files/<guid>/<file>, to its object.
+  ///
+  /// Clients PUT the file body to the URL returned by prepareUpload(), which
+  /// carries a signed token limiting the key, size and lifetime of the
+  /// upload.  Downloads are sent with sendfile() and support Range and
+  /// conditional requests.
+  class LocalStorage : public Storage {
+    App &app;
+    std::string root;
+    std::string key;
+
+  public:
+    LocalStorage(App &app, const std::string &root);
+
+    // From Storage
+    const char *getName() const {return "local";}
+    uint64_t getMaxUploadSize() const;
+    void prepareUpload(Upload &upload);
+    void store(Transaction &tx, const std::string &token);
+    void download(Transaction &tx, const std::string &path,
+                  const std::string &type);
+    std::string getFile(const std::string &path) const;
+
+  protected:
+    std::string sign(const std::string &data) const;
+    std::string getObjectPath(const std::string &hash) const;
+    std::string getLinkPath(const std::string &key) const;
+  };
+}
+
+#endif // BUILDBOTICS_LOCAL_STORAGE_H
+
@@ -0,0 +1,122 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "MappedFileHandler.h"
+#include "FileTable.h"
+#include "ResourceHandler.h"
+#include "Compressor.h"
+
+#include <cbang/String.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/event/Request.h>
+#include <cbang/event/Buffer.h>
+
+#include <event2/buffer.h>
+
+#include <vector>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  void releaseFile(const void *data, size_t length, void *arg) {
+    delete (SmartPointer<FileTable::File> *)arg;
+  }
+}
+
+
+MappedFileHandler::MappedFileHandler(FileTable &table, const string &root) :
+  table(table), root(root), directory(SystemUtilities::isDirectory(root)) {}
+
+
+bool MappedFileHandler::operator()(Event::Request &req) {
+  string path = root;
+  SmartPointer<FileTable::File> file;
+
+  if (directory) {
+    string uriPath = req.getURI().getPath();
+
+    // Stay under root
+    vector<string> parts;
+    String::tokenize(uriPath, parts, "/");
+    for (unsigned i = 0; i < parts.size(); i++)
+      if (parts[i] == "..") return false;
+      else if (parts[i] != ".") path += "/" + parts[i];
+
+    file = table.lookup(path);
+
+    if (file.isNull()) {
+      path += "/index.html";
+      file = table.lookup(path);
+    }
+
+  } else file = table.lookup(path);
+
+  if (file.isNull()) return false;
+
+  // Precompressed version
+  SmartPointer<FileTable::File> sent = file;
+  const char *encoding = 0;
+
+  if (req.inHas("Accept-Encoding")) {
+    string accept = req.inGet("Accept-Encoding");
+    SmartPointer<FileTable::File> compressed;
+
+    if (Compressor::accepts(accept, "br") &&
+        !(compressed = table.lookup(path + ".br")).isNull()) encoding = "br";
+    else if (Compressor::accepts(accept, "gzip") &&
+             !(compressed = table.lookup(path + ".gz")).isNull())
+      encoding = "gzip";
+
+    if (!compressed.isNull() && compressed->data.length() < file->data.length())
+      sent = compressed;
+    else encoding = 0;
+  }
+
+  req.outSet("Vary", "Accept-Encoding");
+
+  if (ResourceHandler::checkCache(req, path, sent->etag)) return true;
+
+  if (encoding) req.outSet("Content-Encoding", encoding);
+  req.setContentType(ResourceHandler::getContentType(path));
+
+  // The reference keeps the contents alive until the response is sent
+  if (!sent->data.empty())
+    evbuffer_add_reference(req.getOutputBuffer().getBuffer(),
+                           sent->data.data(), sent->data.length(),
+                           releaseFile,
+                           new SmartPointer<FileTable::File>(sent));
+  req.reply();
+
+  return true;
+}
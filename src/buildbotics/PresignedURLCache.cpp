@@ -0,0 +1,80 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "PresignedURLCache.h"
+#include "App.h"
+
+#include <cbang/time/Time.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const unsigned maxURLs = 100000;
+}
+
+
+PresignedURLCache::PresignedURLCache(App &app) :
+  app(app), windowStart(0), hits(0), misses(0) {}
+
+
+const string &PresignedURLCache::get(const string &path, unsigned &maxAge) {
+  uint64_t now = Time::now();
+  unsigned window = app.getAWSDownloadWindow();
+  uint64_t start = now - now % window;
+
+  // URLs from the previous window expire too soon to hand out
+  if (start != windowStart || maxURLs <= urls.size()) {
+    urls.clear();
+    windowStart = start;
+  }
+
+  maxAge = start + window - now;
+
+  urls_t::iterator it = urls.find(path);
+  if (it != urls.end()) {
+    hits++;
+    return it->second;
+  }
+
+  misses++;
+
+  // Valid for the rest of this window plus one more so cached copies work
+  AWS4PresignedURL url =
+    app.getS3URL(path, HTTP::RequestMethod::HTTP_GET, 2 * window);
+  url.setTS(start);
+  app.signS3URL(url);
+
+  return urls[path] = url.toString();
+}
+
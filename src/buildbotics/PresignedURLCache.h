@@ -0,0 +1,73 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_PRESIGNED_URL_CACHE_H
+#define BUILDBOTICS_PRESIGNED_URL_CACHE_H
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <map>
+
+
+namespace Buildbotics {
+  class App;
+
+  /// Presigned S3 GET URLs for private files.  Signing time is rounded down
+  /// to the start of the aws-download-window so every request in a window
+  /// gets the same URL, which browsers and CDNs can then cache.  URLs are
+  /// memoized per file until the window rolls over.  Not thread safe, each
+  /// Worker has its own.
+  class PresignedURLCache {
+    App &app;
+    uint64_t windowStart;
+
+    typedef std::map<std::string, std::string> urls_t;
+    urls_t urls;
+
+    uint64_t hits;
+    uint64_t misses;
+
+  public:
+    PresignedURLCache(App &app);
+
+    /// @param path The S3 object path
+    /// @param maxAge Set to the number of seconds the URL may be cached
+    const std::string &get(const std::string &path, unsigned &maxAge);
+
+    uint64_t getHits() const {return hits;}
+    uint64_t getMisses() const {return misses;}
+    unsigned getSize() const {return urls.size();}
+  };
+}
+
+#endif // BUILDBOTICS_PRESIGNED_URL_CACHE_H
+
@@ -0,0 +1,189 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "RateLimiter.h"
+
+#include <cbang/Exception.h>
+#include <cbang/time/Timer.h>
+#include <cbang/json/Writer.h>
+
+#include <string.h>
+#include <math.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  uint64_t hash(const string &s, unsigned seed) {
+    // FNV-1a with a different offset per sketch row
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+
+    for (unsigned i = 0; i < s.length(); i++) {
+      h ^= (uint8_t)s[i];
+      h *= 1099511628211ULL;
+    }
+
+    return h ^ (h >> 29);
+  }
+}
+
+
+RateLimiter::RateLimiter() : maxClients(0) {
+  for (unsigned i = 0; i < CLASSES; i++) {
+    Class &c = classes[i];
+
+    c.rate = c.burst = c.windowStart = 0;
+    memset(c.sketch, 0, sizeof(c.sketch));
+    c.allowed = c.limited = c.evictions = 0;
+  }
+}
+
+
+void RateLimiter::init(const double *rates, double burstTime,
+                       unsigned maxClients) {
+  if (!maxClients) THROW("Rate limiter needs room for at least one client");
+
+  SmartLock lock(this);
+
+  this->maxClients = maxClients;
+
+  for (unsigned i = 0; i < CLASSES; i++) {
+    classes[i].rate = rates[i];
+    classes[i].burst = rates[i] * burstTime;
+    if (classes[i].burst < 1) classes[i].burst = 1;
+  }
+}
+
+
+const char *RateLimiter::getClassName(unsigned cls) {
+  static const char *names[] = {"search", "write", "read"};
+  return cls < CLASSES ? names[cls] : 0;
+}
+
+
+unsigned RateLimiter::check(unsigned cls, const string &client) {
+  Class &c = classes[cls];
+  if (!c.rate) return 0;
+
+  SmartLock lock(this);
+
+  double now = Timer::now();
+  unsigned retry = 0;
+  buckets_t::iterator it = c.buckets.find(client);
+
+  if (it != c.buckets.end()) {
+    Bucket &bucket = it->second;
+    c.lru.splice(c.lru.begin(), c.lru, bucket.it);
+    retry = take(c, bucket, now);
+
+  } else if (c.burst < count(c, client)) {
+    // A heavy hitter, limit it with its own bucket from now on
+    if (maxClients <= c.buckets.size() && !c.lru.empty()) {
+      c.buckets.erase(c.lru.back());
+      c.lru.pop_back();
+      c.evictions++;
+    }
+
+    Bucket &bucket = c.buckets[client];
+    bucket.tokens = c.burst;
+    bucket.last = now;
+    bucket.it = c.lru.insert(c.lru.begin(), client);
+    retry = take(c, bucket, now);
+  }
+
+  if (retry) c.limited++;
+  else c.allowed++;
+
+  return retry;
+}
+
+
+void RateLimiter::writeStats(JSON::Writer &writer) {
+  SmartLock lock(this);
+
+  writer.beginDict();
+
+  for (unsigned i = 0; i < CLASSES; i++) {
+    Class &c = classes[i];
+
+    writer.insertDict(getClassName(i));
+    writer.insert("rate", c.rate);
+    writer.insert("burst", c.burst);
+    writer.insert("clients", c.buckets.size());
+    writer.insert("allowed", c.allowed);
+    writer.insert("limited", c.limited);
+    writer.insert("evictions", c.evictions);
+    writer.endDict();
+  }
+
+  writer.endDict();
+}
+
+
+uint32_t RateLimiter::count(Class &c, const string &client) {
+  // Start a new window once a full burst could have been refilled
+  double now = Timer::now();
+  if (c.windowStart + c.burst / c.rate <= now) {
+    memset(c.sketch, 0, sizeof(c.sketch));
+    c.windowStart = now;
+  }
+
+  // Conservative update, only the smallest counters grow
+  uint32_t *counters[DEPTH];
+  uint32_t estimate = ~(uint32_t)0;
+
+  for (unsigned i = 0; i < DEPTH; i++) {
+    counters[i] = &c.sketch[i][hash(client, i) % WIDTH];
+    if (*counters[i] < estimate) estimate = *counters[i];
+  }
+
+  estimate++;
+  for (unsigned i = 0; i < DEPTH; i++)
+    if (*counters[i] < estimate) *counters[i] = estimate;
+
+  return estimate;
+}
+
+
+unsigned RateLimiter::take(Class &c, Bucket &bucket, double now) {
+  bucket.tokens += (now - bucket.last) * c.rate;
+  if (c.burst < bucket.tokens) bucket.tokens = c.burst;
+  bucket.last = now;
+
+  if (1 <= bucket.tokens) {
+    bucket.tokens--;
+    return 0;
+  }
+
+  return (unsigned)ceil((1 - bucket.tokens) / c.rate);
+}
@@ -0,0 +1,115 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_RATE_LIMITER_H
+#define BUILDBOTICS_RATE_LIMITER_H
+
+#include <cbang/StdTypes.h>
+#include <cbang/os/Mutex.h>
+
+#include <string>
+#include <list>
+#include <map>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  /// Token bucket rate limits per client and class of request, shared by
+  /// all Workers.  Requests are first counted in a count-min sketch which
+  /// is cleared once per burst period.  Only clients whose count exceeds
+  /// the burst are given a token bucket, so memory is bounded by the
+  /// sketch size plus at most maxClients buckets per class, least recently
+  /// used first out.  New buckets start full so a client wrongly counted as
+  /// heavy by the sketch is not limited at once.
+  class RateLimiter : public cb::Mutex {
+  public:
+    enum {
+      SEARCH,
+      WRITE,
+      READ,
+      CLASSES
+    };
+
+  protected:
+    static const unsigned DEPTH = 4;
+    static const unsigned WIDTH = 4096;
+
+    typedef std::list<std::string> lru_t;
+
+    struct Bucket {
+      double tokens;
+      double last;
+      lru_t::iterator it;
+    };
+
+    typedef std::map<std::string, Bucket> buckets_t;
+
+    struct Class {
+      double rate; // Per second, zero disables
+      double burst;
+      double windowStart;
+      uint32_t sketch[DEPTH][WIDTH];
+
+      buckets_t buckets;
+      lru_t lru; // Most recent first
+
+      uint64_t allowed;
+      uint64_t limited;
+      uint64_t evictions;
+    };
+
+    Class classes[CLASSES];
+    unsigned maxClients;
+
+  public:
+    RateLimiter();
+
+    /// @param rates per second for each class and @param burstTime the
+    /// seconds at full rate a client may use at once
+    void init(const double *rates, double burstTime, unsigned maxClients);
+    bool isEnabled(unsigned cls) const {return classes[cls].rate;}
+
+    static const char *getClassName(unsigned cls);
+
+    /// @return Zero if @param client may proceed or the seconds after which
+    /// it should retry
+    unsigned check(unsigned cls, const std::string &client);
+
+    void writeStats(cb::JSON::Writer &writer);
+
+  protected:
+    uint32_t count(Class &c, const std::string &client);
+    unsigned take(Class &c, Bucket &bucket, double now);
+  };
+}
+
+#endif // BUILDBOTICS_RATE_LIMITER_H
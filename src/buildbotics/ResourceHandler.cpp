@@ -0,0 +1,194 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "ResourceHandler.h"
+#include "Compressor.h"
+
+#include <cbang/String.h>
+#include <cbang/util/Resource.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/event/Request.h>
+#include <cbang/event/Buffer.h>
+#include <cbang/openssl/Digest.h>
+
+#include <event2/buffer.h>
+
+#include <vector>
+
+#include <ctype.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const char *immutableCache = "public, max-age=31536000, immutable";
+}
+
+
+ResourceHandler::ResourceHandler(const Resource &res, const Resource &dir) :
+  res(res), dir(dir) {}
+
+
+string ResourceHandler::getContentType(const string &path) {
+  string ext = String::toLower(SystemUtilities::extension(path));
+
+  if (ext == "html") return "text/html; charset=utf-8";
+  if (ext == "css") return "text/css; charset=utf-8";
+  if (ext == "js") return "application/javascript; charset=utf-8";
+  if (ext == "json" || ext == "map") return "application/json";
+  if (ext == "svg") return "image/svg+xml";
+  if (ext == "txt") return "text/plain; charset=utf-8";
+  if (ext == "xml") return "application/xml";
+  if (ext == "png") return "image/png";
+  if (ext == "jpg" || ext == "jpeg") return "image/jpeg";
+  if (ext == "gif") return "image/gif";
+  if (ext == "ico") return "image/x-icon";
+  if (ext == "woff") return "font/woff";
+  if (ext == "woff2") return "font/woff2";
+  if (ext == "ttf") return "font/ttf";
+  if (ext == "eot") return "application/vnd.ms-fontobject";
+
+  return "application/octet-stream";
+}
+
+
+string ResourceHandler::getETag(const char *data, unsigned length) {
+  string hash = Digest::hash(string(data, length), "sha256");
+  return "\"" + String::hexEncode(hash.substr(0, 16)) + "\"";
+}
+
+
+bool ResourceHandler::isFingerprinted(const string &path) {
+  string name = SystemUtilities::basename(path);
+
+  // A hash between the name and the extension, e.g. app.3f9a2c1b.js
+  size_t end = name.find_last_of('.');
+  if (end == string::npos) return false;
+
+  vector<string> parts;
+  String::tokenize(name.substr(0, end), parts, ".-_");
+
+  for (unsigned i = 1; i < parts.size(); i++) {
+    const string &part = parts[i];
+    if (part.length() < 8) continue;
+
+    unsigned j = 0;
+    while (j < part.length() && isxdigit(part[j])) j++;
+    if (j == part.length()) return true;
+  }
+
+  return false;
+}
+
+
+bool ResourceHandler::checkCache(Event::Request &req, const string &path,
+                                 const string &etag) {
+  req.outSet("ETag", etag);
+
+  // Fingerprinted names never change, everything else is revalidated
+  if (isFingerprinted(path)) req.outSet("Cache-Control", immutableCache);
+  else req.outSet("Cache-Control", "no-cache");
+
+  if (req.inHas("If-None-Match")) {
+    string match = req.inGet("If-None-Match");
+
+    if (match == "*" || match.find(etag) != string::npos) {
+      req.reply(Event::HTTP_NOT_MODIFIED);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+const string &ResourceHandler::getETag(const Resource &res) {
+  // Hashed once, the data is compiled in
+  etags_t::iterator it = etags.find(&res);
+  if (it != etags.end()) return it->second;
+
+  string etag = getETag(res.getData(), res.getLength());
+  return etags.insert(etags_t::value_type(&res, etag)).first->second;
+}
+
+
+bool ResourceHandler::operator()(Event::Request &req) {
+  const Resource *file = &res;
+  string path = res.getName();
+
+  if (res.isDirectory()) {
+    path = req.getURI().getPath();
+    while (!path.empty() && path[0] == '/') path = path.substr(1);
+
+    file = path.empty() ? &res : res.find(path);
+    if (file && file->isDirectory()) {
+      path += path.empty() ? "index.html" : "/index.html";
+      file = file->find("index.html");
+    }
+
+    if (!file) return false;
+  }
+
+  const Resource *sent = file;
+  const char *encoding = 0;
+
+  // Precompressed version
+  if (req.inHas("Accept-Encoding")) {
+    string accept = req.inGet("Accept-Encoding");
+    const Resource *compressed = 0;
+
+    if (Compressor::accepts(accept, "br") &&
+        (compressed = dir.find(path + ".br"))) encoding = "br";
+    else if (Compressor::accepts(accept, "gzip") &&
+             (compressed = dir.find(path + ".gz"))) encoding = "gzip";
+
+    if (compressed && compressed->getLength() < file->getLength())
+      sent = compressed;
+    else encoding = 0;
+  }
+
+  req.outSet("Vary", "Accept-Encoding");
+
+  // Each encoding is a separate representation with its own ETag
+  if (checkCache(req, path, getETag(*sent))) return true;
+
+  if (encoding) req.outSet("Content-Encoding", encoding);
+  req.setContentType(getContentType(path));
+
+  // Resources are static, no copy needed
+  evbuffer_add_reference(req.getOutputBuffer().getBuffer(), sent->getData(),
+                         sent->getLength(), 0, 0);
+  req.reply();
+
+  return true;
+}
@@ -0,0 +1,79 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_RESOURCE_HANDLER_H
+#define BUILDBOTICS_RESOURCE_HANDLER_H
+
+#include <cbang/event/HTTPHandler.h>
+
+#include <string>
+#include <map>
+
+namespace cb {class Resource;}
+
+
+namespace Buildbotics {
+  /// Serves embedded resources without copying them.  When the client
+  /// accepts it, the .br or .gz version precompressed at build time is sent
+  /// instead.  Responses carry content hash ETags and fingerprinted names
+  /// are cached as immutable.
+  class ResourceHandler : public cb::Event::HTTPHandler {
+    const cb::Resource &res;
+    const cb::Resource &dir;
+
+    typedef std::map<const cb::Resource *, std::string> etags_t;
+    etags_t etags;
+
+  public:
+    /// @param res The directory or file to serve
+    /// @param dir The directory holding @param res's compressed versions
+    ResourceHandler(const cb::Resource &res, const cb::Resource &dir);
+
+    static std::string getContentType(const std::string &path);
+    static std::string getETag(const char *data, unsigned length);
+
+    /// @return True if @param path's name contains a content hash, such as
+    /// app.3f9a2c1b.js, so that it can never change.
+    static bool isFingerprinted(const std::string &path);
+
+    /// Set the ETag and Cache-Control for @param path and answer
+    /// conditional requests.  @return True if 304 Not Modified was sent.
+    static bool checkCache(cb::Event::Request &req, const std::string &path,
+                           const std::string &etag);
+
+    const std::string &getETag(const cb::Resource &res);
+
+    // From cb::Event::HTTPHandler
+    bool operator()(cb::Event::Request &req);
+  };
+}
+
+#endif // BUILDBOTICS_RESOURCE_HANDLER_H
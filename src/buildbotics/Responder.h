@@ -0,0 +1,51 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_RESPONDER_H
+#define BUILDBOTICS_RESPONDER_H
+
+
+namespace Buildbotics {
+  /// Sends the reply of a Transaction which is not bound to a libevent
+  /// HTTP/1.1 connection.  Told after the Transaction has set its response
+  /// code, headers and body.
+  class Responder {
+  public:
+    virtual ~Responder() {}
+
+    virtual void replied() = 0;
+    /// Called from the event loop once an orphaned Transaction's outgoing
+    /// calls have returned.  Frees the Responder and its Transaction.
+    virtual void released() = 0;
+  };
+}
+
+#endif // BUILDBOTICS_RESPONDER_H
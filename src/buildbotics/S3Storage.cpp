@@ -0,0 +1,83 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "S3Storage.h"
+#include "App.h"
+#include "Worker.h"
+#include "Transaction.h"
+#include "AWS4Post.h"
+
+#include <cbang/time/Time.h>
+
+using namespace cb;
+using namespace std;
+using namespace Buildbotics;
+
+
+void S3Storage::prepareUpload(Upload &upload) {
+  AWS4Post *post =
+    new AWS4Post(app.getAWSBucket(), upload.key, app.getAWSUploadExpires(),
+                 Time::now(), "s3", app.getAWSRegion());
+  upload.form = post;
+
+  post->setLengthRange(upload.minSize, upload.maxSize);
+  post->insert("Content-Type", upload.type);
+  post->insert("acl", app.getAWSPrivate() ? "private" : "public-read");
+  post->insert("success_action_status", "201");
+  post->addCondition("name", upload.file);
+  post->sign(app.getAWSID(), app.getAWSSecret());
+
+  upload.method = "POST";
+  upload.uploadURL = app.getAWSBucketURL() + "/";
+}
+
+
+void S3Storage::download(Transaction &tx, const string &path,
+                         const string &type) {
+  unsigned maxAge = Time::SEC_PER_HOUR;
+  string url = getURL(tx.getWorker(), path, maxAge);
+
+  tx.setCache(maxAge);
+  tx.redirect(url);
+}
+
+
+string S3Storage::getURL(Worker &worker, const string &path) {
+  unsigned maxAge;
+  return getURL(worker, path, maxAge);
+}
+
+
+string S3Storage::getURL(Worker &worker, const string &path,
+                         unsigned &maxAge) {
+  if (app.getAWSPrivate()) return worker.getPresignedURLs().get(path, maxAge);
+  return app.getAWSBucketURL() + path;
+}
@@ -0,0 +1,64 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_S3_STORAGE_H
+#define BUILDBOTICS_S3_STORAGE_H
+
+#include "Storage.h"
+
+
+namespace Buildbotics {
+  class App;
+
+  /// Files are uploaded directly to S3 with signed POST policies and
+  /// downloads are redirected to the bucket.
+  class S3Storage : public Storage {
+    App &app;
+
+  public:
+    S3Storage(App &app) : app(app) {}
+
+    // From Storage
+    const char *getName() const {return "s3";}
+    bool hasMultipart() const {return true;}
+    void prepareUpload(Upload &upload);
+    void download(Transaction &tx, const std::string &path,
+                  const std::string &type);
+    std::string getURL(Worker &worker, const std::string &path);
+
+    /// @param maxAge Set to the number of seconds the URL may be cached
+    std::string getURL(Worker &worker, const std::string &path,
+                       unsigned &maxAge);
+  };
+}
+
+#endif // BUILDBOTICS_S3_STORAGE_H
+
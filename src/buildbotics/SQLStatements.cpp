@@ -0,0 +1,166 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "SQLStatements.h"
+
+using namespace Buildbotics;
+
+
+const SQLLiteral SQL::login
+  ("CALL Login(%(provider)s, %(id)s, %(name)s, %(email)s, %(avatar)s);");
+const SQLLiteral SQL::getUser("CALL GetUser(%(provider)s, %(id)s)");
+const SQLLiteral SQL::getInfo("CALL GetInfo()");
+const SQLLiteral SQL::getPermissions("CALL GetPermissions()");
+const SQLLiteral SQL::findProfiles
+  ("CALL FindProfiles(%(query)s, %(limit)u, %(offset)u)");
+const SQLLiteral SQL::registerProfile
+  ("CALL Register(%(profile)s, %(provider)s, %(id)s)");
+const SQLLiteral SQL::available("CALL Available(%(profile)s)");
+const SQLLiteral SQL::suggest("CALL Suggest(%(provider)s, %(id)s, 5)");
+const SQLLiteral SQL::putProfile
+  ("CALL PutProfile(%(profile)s, %(fullname)s, %(location)s, %(url)s, "
+   "%(bio)s)");
+const SQLLiteral SQL::getProfile("CALL GetProfile(%(profile)s)");
+const SQLLiteral SQL::getProfileAvatar("CALL GetProfileAvatar(%(profile)s)");
+const SQLLiteral SQL::confirmProfileAvatar
+  ("CALL ConfirmProfileAvatar(%(profile)s, %(url)s)");
+const SQLLiteral SQL::follow("CALL Follow(%(user)s, %(profile)s)");
+const SQLLiteral SQL::unfollow("CALL Unfollow(%(user)s, %(profile)s)");
+const SQLLiteral SQL::findThings
+  ("CALL FindThings(%(query)s, %(license)s, %(limit)u, %(offset)u)");
+const SQLLiteral SQL::thingAvailable
+  ("CALL ThingAvailable(%(profile)s, %(thing)s)");
+const SQLLiteral SQL::getThing
+  ("CALL GetThing(%(profile)s, %(thing)s, %(view_id)s)");
+const SQLLiteral SQL::publishThing("CALL PublishThing(%(profile)s, %(thing)s)");
+const SQLLiteral SQL::putThing
+  ("CALL PutThing(%(profile)s, %(thing)s, %(type)s, %(title)s, %(license)s, "
+   "%(instructions)s)");
+const SQLLiteral SQL::renameThing
+  ("CALL RenameThing(%(profile)s, %(thing)s, %(name)s)");
+const SQLLiteral SQL::deleteThing("CALL DeleteThing(%(profile)s, %(thing)s)");
+const SQLLiteral SQL::starThing
+  ("CALL StarThing(%(user)s, %(profile)s, %(thing)s)");
+const SQLLiteral SQL::unstarThing
+  ("CALL UnstarThing(%(user)s, %(profile)s, %(thing)s)");
+const SQLLiteral SQL::multiTagThing
+  ("CALL MultiTagThing(%(profile)s, %(thing)s, %(tags)s)");
+const SQLLiteral SQL::multiUntagThing
+  ("CALL MultiUntagThing(%(profile)s, %(thing)s, %(tags)s)");
+const SQLLiteral SQL::postComment
+  ("CALL PostComment(%(owner)s, %(profile)s, %(thing)s, %(parent)u, %(text)s)");
+const SQLLiteral SQL::updateComment
+  ("CALL UpdateComment(%(owner)s, %(comment)u, %(text)s)");
+const SQLLiteral SQL::deleteComment
+  ("CALL DeleteComment(%(owner)s, %(comment)u)");
+const SQLLiteral SQL::upvoteComment
+  ("CALL UpvoteComment(%(owner)s, %(comment)u)");
+const SQLLiteral SQL::downvoteComment
+  ("CALL DownvoteComment(%(owner)s, %(comment)u)");
+const SQLLiteral SQL::downloadFile
+  ("CALL DownloadFile(%(profile)s, %(thing)s, %(file)s, %(count)b)");
+const SQLLiteral SQL::getMultipartUpload
+  ("CALL GetMultipartUpload(%(profile)s, %(thing)s, %(file)s, %(upload_id)s)");
+const SQLLiteral SQL::updateFile
+  ("CALL UpdateFile(%(profile)s, %(thing)s, %(file)s, %(caption)s, "
+   "%(visibility)s, %(rename)s)");
+const SQLLiteral SQL::deleteFile
+  ("CALL DeleteFile(%(profile)s, %(thing)s, %(file)s)");
+const SQLLiteral SQL::confirmFile
+  ("CALL ConfirmFile(%(profile)s, %(thing)s, %(file)s)");
+const SQLLiteral SQL::fileUp("CALL FileUp(%(profile)s, %(thing)s, %(file)s)");
+const SQLLiteral SQL::fileDown
+  ("CALL FileDown(%(profile)s, %(thing)s, %(file)s)");
+const SQLLiteral SQL::getTags("CALL GetTags(%(limit)u)");
+const SQLLiteral SQL::findThingsByTag
+  ("CALL FindThingsByTag(%(tag)s, %(limit)u, %(offset)u)");
+const SQLLiteral SQL::getLicenses("CALL GetLicenses()");
+const SQLLiteral SQL::getEvents
+  ("CALL GetEvents(%(subject)s, %(action)s, %(object_type)s, %(object)s, "
+   "%(owner)s, %(following)b, %(since)s, %(limit)u)");
+const SQLLiteral SQL::startMultipartUpload
+  ("CALL StartMultipartUpload(%(profile)s, %(thing)s, %(file)s, %(type)s, "
+   "%(size)u, %(path)s, %(caption)s, %(visibility)s, %(upload_id)s)");
+const SQLLiteral SQL::completeMultipartUpload
+  ("CALL CompleteMultipartUpload(%(profile)s, %(thing)s, %(file)s, "
+   "%(upload_id)s)");
+const SQLLiteral SQL::abortMultipartUpload
+  ("CALL AbortMultipartUpload(%(profile)s, %(thing)s, %(file)s, "
+   "%(upload_id)s)");
+
+
+const SQLLiteral *const SQL::statements[] = {
+  &login,
+  &getUser,
+  &getInfo,
+  &getPermissions,
+  &findProfiles,
+  &registerProfile,
+  &available,
+  &suggest,
+  &putProfile,
+  &getProfile,
+  &getProfileAvatar,
+  &confirmProfileAvatar,
+  &follow,
+  &unfollow,
+  &findThings,
+  &thingAvailable,
+  &getThing,
+  &publishThing,
+  &putThing,
+  &renameThing,
+  &deleteThing,
+  &starThing,
+  &unstarThing,
+  &multiTagThing,
+  &multiUntagThing,
+  &postComment,
+  &updateComment,
+  &deleteComment,
+  &upvoteComment,
+  &downvoteComment,
+  &downloadFile,
+  &getMultipartUpload,
+  &updateFile,
+  &deleteFile,
+  &confirmFile,
+  &fileUp,
+  &fileDown,
+  &getTags,
+  &findThingsByTag,
+  &getLicenses,
+  &getEvents,
+  &startMultipartUpload,
+  &completeMultipartUpload,
+  &abortMultipartUpload,
+  0
+};
@@ -0,0 +1,92 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_SQL_STATEMENTS_H
+#define BUILDBOTICS_SQL_STATEMENTS_H
+
+#include "SQLTemplateCache.h"
+
+
+namespace Buildbotics {
+  /// The statements Transaction renders through its Worker's
+  /// SQLTemplateCache
+  namespace SQL {
+    extern const SQLLiteral login;
+    extern const SQLLiteral getUser;
+    extern const SQLLiteral getInfo;
+    extern const SQLLiteral getPermissions;
+    extern const SQLLiteral findProfiles;
+    extern const SQLLiteral registerProfile;
+    extern const SQLLiteral available;
+    extern const SQLLiteral suggest;
+    extern const SQLLiteral putProfile;
+    extern const SQLLiteral getProfile;
+    extern const SQLLiteral getProfileAvatar;
+    extern const SQLLiteral confirmProfileAvatar;
+    extern const SQLLiteral follow;
+    extern const SQLLiteral unfollow;
+    extern const SQLLiteral findThings;
+    extern const SQLLiteral thingAvailable;
+    extern const SQLLiteral getThing;
+    extern const SQLLiteral publishThing;
+    extern const SQLLiteral putThing;
+    extern const SQLLiteral renameThing;
+    extern const SQLLiteral deleteThing;
+    extern const SQLLiteral starThing;
+    extern const SQLLiteral unstarThing;
+    extern const SQLLiteral multiTagThing;
+    extern const SQLLiteral multiUntagThing;
+    extern const SQLLiteral postComment;
+    extern const SQLLiteral updateComment;
+    extern const SQLLiteral deleteComment;
+    extern const SQLLiteral upvoteComment;
+    extern const SQLLiteral downvoteComment;
+    extern const SQLLiteral downloadFile;
+    extern const SQLLiteral getMultipartUpload;
+    extern const SQLLiteral updateFile;
+    extern const SQLLiteral deleteFile;
+    extern const SQLLiteral confirmFile;
+    extern const SQLLiteral fileUp;
+    extern const SQLLiteral fileDown;
+    extern const SQLLiteral getTags;
+    extern const SQLLiteral findThingsByTag;
+    extern const SQLLiteral getLicenses;
+    extern const SQLLiteral getEvents;
+    extern const SQLLiteral startMultipartUpload;
+    extern const SQLLiteral completeMultipartUpload;
+    extern const SQLLiteral abortMultipartUpload;
+
+    /// All of the above, null terminated
+    extern const SQLLiteral *const statements[];
+  }
+}
+
+#endif // BUILDBOTICS_SQL_STATEMENTS_H
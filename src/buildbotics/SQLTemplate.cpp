@@ -0,0 +1,176 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "SQLTemplate.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/json/Value.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const string specialChars("\0\n\r\\'\"\032", 7);
+}
+
+
+SQLTemplate::SQLTemplate(const string &sql) : sql(sql), literalLength(0) {
+  string::size_type start = 0;
+  string::size_type i = 0;
+
+  while ((i = sql.find('%', i)) != string::npos) {
+    // Literal up to here
+    if (start < i) {
+      Part part = {0, (unsigned)start, (unsigned)(i - start), ""};
+      parts.push_back(part);
+      literalLength += i - start;
+    }
+
+    if (i + 1 < sql.length() && sql[i + 1] == '%') {
+      start = i + 1; // Keep one %
+      i += 2;
+      continue;
+    }
+
+    string::size_type end = sql.find(')', i);
+    if (i + 1 == sql.length() || sql[i + 1] != '(' || end == string::npos ||
+        end + 1 == sql.length())
+      THROWS("Invalid SQL template at " << i << ": " << sql);
+
+    char type = sql[end + 1];
+    if (string("suifb").find(type) == string::npos)
+      THROWS("Invalid SQL template type '" << type << "': " << sql);
+
+    Part part = {type, 0, 0, sql.substr(i + 2, end - i - 2)};
+    parts.push_back(part);
+
+    start = i = end + 2;
+  }
+
+  if (start < sql.length()) {
+    Part part = {0, (unsigned)start, (unsigned)(sql.length() - start), ""};
+    parts.push_back(part);
+    literalLength += sql.length() - start;
+  }
+}
+
+
+unsigned SQLTemplate::estimate(const JSON::Value &dict) const {
+  unsigned length = literalLength;
+
+  for (unsigned i = 0; i < parts.size(); i++) {
+    const Part &part = parts[i];
+    if (!part.type) continue;
+
+    if (part.type == 's' && dict.has(part.name) &&
+        dict.get(part.name)->isString())
+      length += dict.getString(part.name).length() * 2 + 2;
+    else length += 24;
+  }
+
+  return length;
+}
+
+
+void SQLTemplate::render(string &out, const JSON::Value &dict) const {
+  for (unsigned i = 0; i < parts.size(); i++) {
+    const Part &part = parts[i];
+
+    if (!part.type) {
+      out.append(sql, part.offset, part.length);
+      continue;
+    }
+
+    if (!dict.has(part.name) || dict.get(part.name)->isNull()) {
+      out.append("NULL");
+      continue;
+    }
+
+    const JSON::Value &value = *dict.get(part.name);
+
+    switch (part.type) {
+    case 's':
+      out.push_back('\'');
+      escape(out, value.isString() ? value.getString() : value.toString());
+      out.push_back('\'');
+      break;
+
+    case 'u':
+      out.append(String(value.isString() ?
+                        String::parseU64(value.getString()) :
+                        value.getU64()));
+      break;
+
+    case 'i':
+      out.append(String(value.isString() ?
+                        String::parseS64(value.getString()) :
+                        value.getS64()));
+      break;
+
+    case 'f':
+      out.append(String(value.isString() ?
+                        String::parseDouble(value.getString()) :
+                        value.getNumber()));
+      break;
+
+    case 'b':
+      out.append((value.isString() ? String::parseBool(value.getString()) :
+                  value.toBoolean()) ? "true" : "false");
+      break;
+    }
+  }
+}
+
+
+void SQLTemplate::escape(string &out, const string &s) {
+  string::size_type start = 0;
+  string::size_type i;
+
+  // Copy the runs between special characters
+  while ((i = s.find_first_of(specialChars, start)) != string::npos) {
+    out.append(s, start, i - start);
+
+    switch (s[i]) {
+    case 0: out.append("\\0"); break;
+    case '\n': out.append("\\n"); break;
+    case '\r': out.append("\\r"); break;
+    case '\032': out.append("\\Z"); break;
+    default: out.push_back('\\'); out.push_back(s[i]); break;
+    }
+
+    start = i + 1;
+  }
+
+  out.append(s, start, string::npos);
+}
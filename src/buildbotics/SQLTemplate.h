@@ -0,0 +1,71 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_SQL_TEMPLATE_H
+#define BUILDBOTICS_SQL_TEMPLATE_H
+
+#include <string>
+#include <vector>
+
+namespace cb {namespace JSON {class Value;}}
+
+
+namespace Buildbotics {
+  /// An SQL format string parsed once into literal spans and typed slots.
+  /// %(name)s renders a quoted and escaped string, %(name)u an unsigned
+  /// integer, %(name)i an integer, %(name)f a real and %(name)b a boolean.
+  /// Missing and null values render as NULL.  %% is a literal %.
+  class SQLTemplate {
+    struct Part {
+      char type; // 0 for a literal span of sql
+      unsigned offset;
+      unsigned length;
+      std::string name;
+    };
+
+    std::string sql;
+    std::vector<Part> parts;
+    unsigned literalLength;
+
+  public:
+    SQLTemplate(const std::string &sql);
+
+    /// @return An upper bound of the rendered length for most values
+    unsigned estimate(const cb::JSON::Value &dict) const;
+    void render(std::string &out, const cb::JSON::Value &dict) const;
+
+    /// Append @param s escaped as mysql_real_escape_string() does for a
+    /// UTF-8 connection without NO_BACKSLASH_ESCAPES
+    static void escape(std::string &out, const std::string &s);
+  };
+}
+
+#endif // BUILDBOTICS_SQL_TEMPLATE_H
@@ -0,0 +1,72 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "SQLTemplateCache.h"
+
+#include <cbang/json/Writer.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+const SQLTemplate &SQLTemplateCache::get(const SQLLiteral &sql) {
+  templates_t::iterator it = templates.find(sql.get());
+  if (it != templates.end()) return *it->second;
+
+  SmartPointer<SQLTemplate> tmpl = new SQLTemplate(sql.get());
+  templates[sql.get()] = tmpl;
+
+  return *tmpl;
+}
+
+
+const string &SQLTemplateCache::render(const SQLLiteral &sql,
+                                       const JSON::Value &dict) {
+  const SQLTemplate &tmpl = get(sql);
+
+  // Keeps its capacity between calls
+  buffer.clear();
+  buffer.reserve(tmpl.estimate(dict));
+  tmpl.render(buffer, dict);
+  renders++;
+
+  return buffer;
+}
+
+
+void SQLTemplateCache::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("templates", templates.size());
+  writer.insert("renders", renders);
+  writer.insert("buffer", buffer.capacity());
+  writer.endDict();
+}
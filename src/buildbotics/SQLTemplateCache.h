@@ -0,0 +1,85 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_SQL_TEMPLATE_CACHE_H
+#define BUILDBOTICS_SQL_TEMPLATE_CACHE_H
+
+#include "SQLTemplate.h"
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <map>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  /// SQL in a string literal, which lives as long as the process.  Only
+  /// arrays convert, so a pointer to a temporary buffer cannot be cached by
+  /// address.
+  class SQLLiteral {
+    const char *sql;
+
+  public:
+    template <unsigned N>
+    explicit SQLLiteral(const char (&sql)[N]) : sql(sql) {}
+
+    const char *get() const {return sql;}
+  };
+
+
+  /// Compiled SQLTemplates keyed by the address of their SQLLiteral and a
+  /// buffer reused for rendering.  Not thread safe, each Worker has its
+  /// own.
+  class SQLTemplateCache {
+    typedef std::map<const char *, cb::SmartPointer<SQLTemplate> >
+    templates_t;
+    templates_t templates;
+
+    std::string buffer;
+    uint64_t renders;
+
+  public:
+    SQLTemplateCache() : renders(0) {}
+
+    const SQLTemplate &get(const SQLLiteral &sql);
+
+    /// @return The rendered SQL, valid until the next call
+    const std::string &render(const SQLLiteral &sql,
+                              const cb::JSON::Value &dict);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+  };
+}
+
+#endif // BUILDBOTICS_SQL_TEMPLATE_CACHE_H
@@ -31,8 +31,12 @@
 
 #include "Server.h"
 #include "App.h"
+#include "Worker.h"
 #include "Transaction.h"
+#include "Arena.h"
 #include "HTTPRE2Matcher.h"
+#include "ResourceHandler.h"
+#include "MappedFileHandler.h"
 
 #include <cbang/openssl/SSLContext.h>
 
@@ -40,8 +44,6 @@
 #include <cbang/event/PendingRequest.h>
 #include <cbang/event/Buffer.h>
 #include <cbang/event/RedirectSecure.h>
-#include <cbang/event/ResourceHTTPHandler.h>
-#include <cbang/event/FileHandler.h>
 
 #include <cbang/config/Options.h>
 #include <cbang/util/Resource.h>
@@ -58,10 +60,11 @@ namespace Buildbotics {
 }
 
 
-Server::Server(App &app) :
-  Event::WebServer(app.getOptions(), app.getEventBase(), new SSLContext,
+Server::Server(Worker &worker) :
+  Event::WebServer(worker.getOptions(), worker.getEventBase(),
+                   worker.getSSLContext(),
                    SmartPointer<HTTPHandlerFactory>::Phony(this)),
-  app(app) {
+  worker(worker), app(worker.getApp()) {
 }
 
 
@@ -72,10 +75,14 @@ void Server::init() {
   HTTPHandlerGroup &api = *addGroup(HTTP_ANY, "/api/.*");
 
   // Force /api/auth/.* secure
-  if (getNumSecureListenPorts()) {
-    uint32_t port = getSecureListenPort(0).getPort();
-    api.addHandler(HTTP_ANY, "/auth/.*", new Event::RedirectSecure(port));
-  }
+  uint32_t securePort = 0;
+  if (getNumSecureListenPorts())
+    securePort = getSecureListenPort(0).getPort();
+  else if (!app.getSecureListenAddresses().empty())
+    securePort = app.getSecureListenAddresses()[0].getPort();
+
+  if (securePort)
+    api.addHandler(HTTP_ANY, "/auth/.*", new Event::RedirectSecure(securePort));
 
 #define ADD_TM(GROUP, METHODS, PATTERN, FUNC)                           \
   (GROUP).addMember<Transaction>(METHODS, PATTERN, &Transaction::FUNC)
@@ -93,83 +100,104 @@ void Server::init() {
 #define COMMENTS_RE THING_RE "/comments"
 #define COMMENT_RE COMMENTS_RE                          \
   "/(?P<comment>\\d+)(/owner/(?P<owner>" NAME_RE "))?"
-#define FILE_RE THING_RE "/files/(?P<file>" FILENAME_RE ")"
+#define FILES_RE THING_RE "/files"
+#define FILE_RE FILES_RE "/(?P<file>" FILENAME_RE ")"
 #define THING_TAGS_RE THING_RE "/tags/(?P<tags>" TAG_RE "(," TAG_RE ")*)"
 #define TAGS_RE "/api/tags"
 #define TAG_PATH_RE TAGS_RE "/(?P<tag>" TAG_RE "(," TAG_RE ")*)"
 #define FILE_URL_RE                                                     \
   "/(?P<profile>" NAME_RE ")/(?P<thing>" NAME_RE ")/(?P<file>" FILENAME_RE ")"
 
+  // Limit each client's request rate
+  ADD_TM(api, HTTP_ANY, "", apiRateLimit);
+
+  // Read your own queued writes
+  ADD_TM(api, HTTP_GET, "", apiFlushWrites);
+
+  // Also dispatched by Transaction::writesFlushed()
+  apiRoutes = api.addGroup(HTTP_ANY, "");
+  HTTPHandlerGroup &routes = *apiRoutes;
+
   // Auth
-  ADD_TM(api, HTTP_GET, "/api/auth/user", apiAuthUser);
-  ADD_TM(api, HTTP_GET | HTTP_POST,
+  ADD_TM(routes, HTTP_GET, "/api/auth/user", apiAuthUser);
+  ADD_TM(routes, HTTP_GET | HTTP_POST,
          "/api/auth/(?P<provider>(google)|(github)|(twitter)|(facebook))"
          "(/callback)?", apiAuthLogin);
-  ADD_TM(api, HTTP_GET, "/api/auth/logout", apiAuthLogout);
+  ADD_TM(routes, HTTP_GET, "/api/auth/logout", apiAuthLogout);
 
   // Info
-  ADD_TM(api, HTTP_GET, "/api/info", apiGetInfo);
+  ADD_TM(routes, HTTP_GET, "/api/info", apiGetInfo);
 
   // Permissions
-  ADD_TM(api, HTTP_GET, "/api/permissions", apiGetPermissions);
+  ADD_TM(routes, HTTP_GET, "/api/permissions", apiGetPermissions);
+
+  // Stats
+  ADD_TM(routes, HTTP_GET, "/api/stats", apiGetStats);
 
   // Profiles
-  ADD_TM(api, HTTP_GET, "/api/profiles", apiGetProfiles);
-  ADD_TM(api, HTTP_PUT, PROFILE_RE "/register", apiProfileRegister);
-  ADD_TM(api, HTTP_GET, PROFILE_RE "/available", apiProfileAvailable);
-  ADD_TM(api, HTTP_GET, "/api/suggest", apiProfileSuggest);
-  ADD_TM(api, HTTP_PUT, PROFILE_RE, apiPutProfile);
-  ADD_TM(api, HTTP_GET, PROFILE_RE, apiGetProfile);
-  ADD_TM(api, HTTP_GET, PROFILE_RE "/avatar", apiGetProfileAvatar);
-  ADD_TM(api, HTTP_PUT, PROFILE_AVATAR_RE , apiPutProfileAvatar);
-  ADD_TM(api, HTTP_PUT, PROFILE_AVATAR_RE "/confirm" , apiConfirmProfileAvatar);
+  ADD_TM(routes, HTTP_GET, "/api/profiles", apiGetProfiles);
+  ADD_TM(routes, HTTP_PUT, PROFILE_RE "/register", apiProfileRegister);
+  ADD_TM(routes, HTTP_GET, PROFILE_RE "/available", apiProfileAvailable);
+  ADD_TM(routes, HTTP_GET, "/api/suggest", apiProfileSuggest);
+  ADD_TM(routes, HTTP_PUT, PROFILE_RE, apiPutProfile);
+  ADD_TM(routes, HTTP_GET, PROFILE_RE, apiGetProfile);
+  ADD_TM(routes, HTTP_GET, PROFILE_RE "/avatar", apiGetProfileAvatar);
+  ADD_TM(routes, HTTP_PUT, PROFILE_AVATAR_RE , apiPutProfileAvatar);
+  ADD_TM(routes, HTTP_PUT, PROFILE_AVATAR_RE "/confirm",
+         apiConfirmProfileAvatar);
 
   // Follow
-  ADD_TM(api, HTTP_PUT, PROFILE_RE "/follow", apiFollow);
-  ADD_TM(api, HTTP_DELETE, PROFILE_RE "/follow", apiUnfollow);
+  ADD_TM(routes, HTTP_PUT, PROFILE_RE "/follow", apiFollow);
+  ADD_TM(routes, HTTP_DELETE, PROFILE_RE "/follow", apiUnfollow);
 
   // Things
-  ADD_TM(api, HTTP_GET, "/api/things", apiGetThings);
-  ADD_TM(api, HTTP_GET, THING_RE "/available", apiThingAvailable);
-  ADD_TM(api, HTTP_GET, THING_RE, apiGetThing);
-  ADD_TM(api, HTTP_PUT, THING_RE, apiPutThing);
-  ADD_TM(api, HTTP_PUT, THING_RE "/publish", apiPublishThing);
-  ADD_TM(api, HTTP_PUT, THING_RE "/rename", apiRenameThing);
-  ADD_TM(api, HTTP_DELETE, THING_RE, apiDeleteThing);
+  ADD_TM(routes, HTTP_GET, "/api/things", apiGetThings);
+  ADD_TM(routes, HTTP_GET, THING_RE "/available", apiThingAvailable);
+  ADD_TM(routes, HTTP_GET, THING_RE, apiGetThing);
+  ADD_TM(routes, HTTP_PUT, THING_RE, apiPutThing);
+  ADD_TM(routes, HTTP_PUT, THING_RE "/publish", apiPublishThing);
+  ADD_TM(routes, HTTP_PUT, THING_RE "/rename", apiRenameThing);
+  ADD_TM(routes, HTTP_DELETE, THING_RE, apiDeleteThing);
 
   // Stars
-  ADD_TM(api, HTTP_PUT, STAR_RE, apiStarThing);
-  ADD_TM(api, HTTP_DELETE, STAR_RE, apiUnstarThing);
+  ADD_TM(routes, HTTP_PUT, STAR_RE, apiStarThing);
+  ADD_TM(routes, HTTP_DELETE, STAR_RE, apiUnstarThing);
 
   // Comments
-  ADD_TM(api, HTTP_POST, COMMENTS_RE, apiPostComment);
-  ADD_TM(api, HTTP_PUT, COMMENT_RE, apiUpdateComment);
-  ADD_TM(api, HTTP_DELETE, COMMENT_RE, apiDeleteComment);
-  ADD_TM(api, HTTP_PUT, COMMENT_RE "/up", apiUpvoteComment);
-  ADD_TM(api, HTTP_PUT, COMMENT_RE "/down", apiDownvoteComment);
+  ADD_TM(routes, HTTP_POST, COMMENTS_RE, apiPostComment);
+  ADD_TM(routes, HTTP_PUT, COMMENT_RE, apiUpdateComment);
+  ADD_TM(routes, HTTP_DELETE, COMMENT_RE, apiDeleteComment);
+  ADD_TM(routes, HTTP_PUT, COMMENT_RE "/up", apiUpvoteComment);
+  ADD_TM(routes, HTTP_PUT, COMMENT_RE "/down", apiDownvoteComment);
 
   // Files
-  ADD_TM(api, HTTP_POST, FILE_RE, apiUploadFile);
-  ADD_TM(api, HTTP_PUT, FILE_RE, apiUpdateFile);
-  ADD_TM(api, HTTP_DELETE, FILE_RE, apiDeleteFile);
-  ADD_TM(api, HTTP_PUT, FILE_RE "/confirm", apiConfirmFile);
-  ADD_TM(api, HTTP_POST, FILE_RE "/up", apiFileUp);
-  ADD_TM(api, HTTP_POST, FILE_RE "/down", apiFileDown);
+  ADD_TM(routes, HTTP_POST, FILES_RE, apiUploadFiles);
+  ADD_TM(routes, HTTP_POST, FILE_RE, apiUploadFile);
+  ADD_TM(routes, HTTP_PUT, FILE_RE, apiUpdateFile);
+  ADD_TM(routes, HTTP_DELETE, FILE_RE, apiDeleteFile);
+  ADD_TM(routes, HTTP_PUT, FILE_RE "/confirm", apiConfirmFile);
+  ADD_TM(routes, HTTP_POST, FILE_RE "/multipart", apiStartMultipart);
+  ADD_TM(routes, HTTP_GET, FILE_RE "/multipart", apiGetMultipart);
+  ADD_TM(routes, HTTP_PUT, FILE_RE "/multipart", apiCompleteMultipart);
+  ADD_TM(routes, HTTP_DELETE, FILE_RE "/multipart", apiAbortMultipart);
+  ADD_TM(routes, HTTP_POST, FILE_RE "/up", apiFileUp);
+  ADD_TM(routes, HTTP_POST, FILE_RE "/down", apiFileDown);
+  ADD_TM(routes, HTTP_PUT, "/api/uploads/(?P<token>[-\\w.=]+)", apiStoreUpload);
 
   // Tags
-  ADD_TM(api, HTTP_GET, TAGS_RE, apiGetTags);
-  ADD_TM(api, HTTP_GET, TAG_PATH_RE, apiGetTagThings);
-  ADD_TM(api, HTTP_PUT, THING_TAGS_RE, apiTagThing);
-  ADD_TM(api, HTTP_DELETE, THING_TAGS_RE, apiUntagThing);
+  ADD_TM(routes, HTTP_GET, TAGS_RE, apiGetTags);
+  ADD_TM(routes, HTTP_GET, TAG_PATH_RE, apiGetTagThings);
+  ADD_TM(routes, HTTP_PUT, THING_TAGS_RE, apiTagThing);
+  ADD_TM(routes, HTTP_DELETE, THING_TAGS_RE, apiUntagThing);
 
   // Licenses
-  ADD_TM(api, HTTP_GET, "/api/licenses", apiGetLicenses);
+  ADD_TM(routes, HTTP_GET, "/api/licenses", apiGetLicenses);
 
   // Events
-  ADD_TM(api, HTTP_GET, "/api/events", apiGetEvents);
+  ADD_TM(routes, HTTP_GET, "/api/events", apiGetEvents);
 
   // API not found
-  ADD_TM(api, HTTP_ANY, "", apiNotFound);
+  ADD_TM(routes, HTTP_ANY, "", apiNotFound);
 
   // Docs
   HTTPHandlerGroup &docs = *addGroup(HTTP_ANY, "/docs/.*");
@@ -197,7 +225,21 @@ void Server::init() {
 
 
 Event::Request *Server::createRequest(evhttp_request *req) {
-  return new Transaction(app, req);
+  Arena &arena = worker.getArenaPool().acquire();
+  return new (arena) Transaction(worker, arena, req);
+}
+
+
+bool Server::operator()(Event::Request &req) {
+  // Every request is a Transaction, see createRequest()
+  captures.bind(static_cast<Transaction &>(req).getArena());
+  return WebServer::operator()(req);
+}
+
+
+bool Server::dispatchRoutes(Event::Request &req) {
+  captures.bind(static_cast<Transaction &>(req).getArena());
+  return (*apiRoutes)(req);
 }
 
 
@@ -205,15 +247,17 @@ SmartPointer<Event::HTTPHandler>
 Server::createMatcher(unsigned methods, const string &search,
                       const string &replace,
                       const SmartPointer<Event::HTTPHandler> &child) {
-  return new HTTPRE2Matcher(methods, search, replace, child);
+  return new HTTPRE2Matcher(methods, search, replace, child, captures);
 }
 
 
 SmartPointer<Event::HTTPHandler> Server::createHandler(const Resource &res) {
-  return new Event::ResourceHTTPHandler(res);
+  // The only single file resource served is http/index.html
+  if (res.isDirectory()) return new ResourceHandler(res, res);
+  return new ResourceHandler(res, *resource0.find("http"));
 }
 
 
 SmartPointer<Event::HTTPHandler> Server::createHandler(const string &path) {
-  return new Event::FileHandler(path);
+  return new MappedFileHandler(worker.getFileTable(), path);
 }
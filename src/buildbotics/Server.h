@@ -32,25 +32,37 @@
 #ifndef BUILDBOTICS_SERVER_H
 #define BUILDBOTICS_SERVER_H
 
+#include "HTTPRE2Matcher.h"
+
 #include <cbang/event/WebServer.h>
 
 
 namespace Buildbotics {
   class App;
+  class Worker;
   class User;
 
   class Server : public cb::Event::WebServer,
                  public cb::Event::HTTPHandlerFactory {
+    Worker &worker;
     App &app;
 
+    cb::SmartPointer<cb::Event::HTTPHandlerGroup> apiRoutes;
+    RE2Captures captures;
+
   public:
-    Server(App &app);
+    Server(Worker &worker);
 
     void init();
 
+    /// Dispatch @param req to the API routes after rate limiting and
+    /// flushing writes
+    bool dispatchRoutes(cb::Event::Request &req);
+
 
     // From cb::Event::HTTPHandler
     cb::Event::Request *createRequest(evhttp_request *req);
+    bool operator()(cb::Event::Request &req);
 
     // From cb::Event::HTTPHandlerFactory
     cb::SmartPointer<cb::Event::HTTPHandler>
@@ -0,0 +1,210 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_SESSION_TABLE_H
+#define BUILDBOTICS_SESSION_TABLE_H
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+namespace Buildbotics {
+  /// The first 32 bytes of a session, stored inline
+  struct SessionToken {
+    enum {SIZE = 32};
+    char data[SIZE];
+
+    SessionToken() {memset(data, 0, SIZE);}
+
+    explicit SessionToken(const std::string &session) {
+      unsigned len = session.length() < SIZE ? session.length() : SIZE;
+      memcpy(data, session.data(), len);
+      memset(data + len, 0, SIZE - len);
+    }
+
+    std::string toString() const {
+      return std::string(data, strnlen(data, SIZE));
+    }
+
+    /// All bytes mixed so the low bits are usable as a table index
+    uint64_t hash() const {
+      uint64_t h = 0;
+
+      for (unsigned i = 0; i < SIZE; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 32;
+      }
+
+      // murmur3 fmix64
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      return h ^ (h >> 33);
+    }
+
+    bool operator==(const SessionToken &o) const {
+#if defined(__AVX2__)
+      __m256i x = _mm256_loadu_si256((const __m256i *)data);
+      __m256i y = _mm256_loadu_si256((const __m256i *)o.data);
+      return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) == -1;
+
+#elif defined(__SSE2__)
+      __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)data),
+                                  _mm_loadu_si128((const __m128i *)o.data));
+      __m128i hi =
+        _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + 16)),
+                       _mm_loadu_si128((const __m128i *)(o.data + 16)));
+      return _mm_movemask_epi8(_mm_and_si128(lo, hi)) == 0xffff;
+
+#else
+      return !memcmp(data, o.data, SIZE);
+#endif
+    }
+
+    bool operator!=(const SessionToken &o) const {return !(*this == o);}
+  };
+
+
+  /// Open addressing hash table with linear probing and backward shift
+  /// deletion, so no tombstones accumulate.  Pointers returned by find() and
+  /// insert() are invalidated by any later insert() or erase().
+  template <typename T>
+  class SessionTable {
+    struct Slot {
+      SessionToken key;
+      bool used;
+      T value;
+
+      Slot() : used(false) {}
+    };
+
+    std::vector<Slot> slots;
+    unsigned count;
+
+  public:
+    /// @param capacity must be a power of two
+    SessionTable(unsigned capacity = 1024) : slots(capacity), count(0) {}
+
+    unsigned size() const {return count;}
+    unsigned capacity() const {return slots.size();}
+    uint64_t getMemoryUsage() const {return slots.size() * sizeof(Slot);}
+
+
+    T *find(const SessionToken &key) {
+      unsigned mask = slots.size() - 1;
+
+      for (unsigned i = key.hash() & mask; slots[i].used; i = (i + 1) & mask)
+        if (slots[i].key == key) return &slots[i].value;
+
+      return 0;
+    }
+
+
+    T &insert(const SessionToken &key, bool &inserted) {
+      // Keep the load factor at or below 3/4
+      if (slots.size() * 3 <= (count + 1) * 4) resize(slots.size() * 2);
+
+      unsigned mask = slots.size() - 1;
+      unsigned i = key.hash() & mask;
+
+      for (; slots[i].used; i = (i + 1) & mask)
+        if (slots[i].key == key) {
+          inserted = false;
+          return slots[i].value;
+        }
+
+      slots[i].key = key;
+      slots[i].used = true;
+      slots[i].value = T();
+      count++;
+      inserted = true;
+
+      return slots[i].value;
+    }
+
+
+    bool erase(const SessionToken &key) {
+      unsigned mask = slots.size() - 1;
+      unsigned i = key.hash() & mask;
+
+      for (;; i = (i + 1) & mask) {
+        if (!slots[i].used) return false;
+        if (slots[i].key == key) break;
+      }
+
+      // Shift following entries back into the hole
+      for (unsigned j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+        unsigned home = slots[j].key.hash() & mask;
+
+        // Leave entries whose home is cyclically in (i, j]
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+          continue;
+
+        slots[i] = slots[j];
+        i = j;
+      }
+
+      slots[i].used = false;
+      slots[i].value = T();
+      count--;
+
+      return true;
+    }
+
+
+  protected:
+    void resize(unsigned size) {
+      std::vector<Slot> old(size);
+      old.swap(slots);
+
+      unsigned mask = size - 1;
+      for (unsigned i = 0; i < old.size(); i++)
+        if (old[i].used) {
+          unsigned j = old[i].key.hash() & mask;
+          while (slots[j].used) j = (j + 1) & mask;
+          slots[j] = old[i];
+        }
+    }
+  };
+}
+
+#endif // BUILDBOTICS_SESSION_TABLE_H
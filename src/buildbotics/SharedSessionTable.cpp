@@ -0,0 +1,279 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "SharedSessionTable.h"
+#include "User.h"
+
+#include <cbang/Exception.h>
+#include <cbang/os/SysError.h>
+#include <cbang/time/Time.h>
+#include <cbang/log/Logger.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const char magic[8] = {'B', 'B', 'S', 'E', 'S', 'S', '0', '3'};
+  const unsigned probeLength = 8;
+  const unsigned readRetries = 16;
+
+
+  bool copyString(char *dst, unsigned size, const string &src) {
+    if (size <= src.length()) return false;
+    memcpy(dst, src.c_str(), src.length() + 1);
+    return true;
+  }
+}
+
+
+SharedSessionTable::SharedSessionTable() :
+  fd(-1), map(0), mapSize(0), header(0), entries(0), mask(0) {}
+
+
+SharedSessionTable::~SharedSessionTable() {
+  close();
+}
+
+
+void SharedSessionTable::open(const string &path, unsigned capacity) {
+  close();
+
+  // Round capacity up to a power of two
+  unsigned size = 1;
+  while (size < capacity) size <<= 1;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd == -1) THROWS("Failed to open '" << path << "': " << SysError());
+
+  // Exclusive lock while the file is initialized or validated
+  if (flock(fd, LOCK_EX) == -1) {
+    close();
+    THROWS("Failed to lock '" << path << "': " << SysError());
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close();
+    THROWS("Failed to stat '" << path << "': " << SysError());
+  }
+
+  bool create = !st.st_size;
+  if (!create) {
+    if (st.st_size < (off_t)(sizeof(Header) + sizeof(Entry))) {
+      close();
+      THROWS("Invalid shared session file '" << path << "'");
+    }
+
+    size = (st.st_size - sizeof(Header)) / sizeof(Entry);
+  }
+
+  mapSize = sizeof(Header) + (uint64_t)size * sizeof(Entry);
+  if (create && ftruncate(fd, mapSize) == -1) {
+    close();
+    THROWS("Failed to size '" << path << "': " << SysError());
+  }
+
+  map = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    map = 0;
+    close();
+    THROWS("Failed to map '" << path << "': " << SysError());
+  }
+
+  header = (Header *)map;
+  entries = (Entry *)((char *)map + sizeof(Header));
+  mask = size - 1;
+
+  if (create) {
+    header->entrySize = sizeof(Entry);
+    header->capacity = size;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(header->magic, magic, sizeof(magic));
+  }
+
+  flock(fd, LOCK_UN);
+
+  if (memcmp(header->magic, magic, sizeof(magic)) ||
+      header->entrySize != sizeof(Entry) || header->capacity != size ||
+      (size & mask)) {
+    close();
+    THROWS("Incompatible shared session file '" << path << "'");
+  }
+
+  LOG_INFO(1, "Shared session table '" << path << "' with " << size
+           << " entries");
+}
+
+
+void SharedSessionTable::create(unsigned capacity) {
+  close();
+
+  unsigned size = 1;
+  while (size < capacity) size <<= 1;
+
+  mapSize = sizeof(Header) + (uint64_t)size * sizeof(Entry);
+  map = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+             -1, 0);
+  if (map == MAP_FAILED) {
+    map = 0;
+    THROWS("Failed to map shared session table: " << SysError());
+  }
+
+  header = (Header *)map;
+  entries = (Entry *)((char *)map + sizeof(Header));
+  mask = size - 1;
+
+  memcpy(header->magic, magic, sizeof(magic));
+  header->entrySize = sizeof(Entry);
+  header->capacity = size;
+}
+
+
+void SharedSessionTable::close() {
+  if (map) munmap(map, mapSize);
+  if (fd != -1) ::close(fd);
+
+  fd = -1;
+  map = 0;
+  header = 0;
+  entries = 0;
+}
+
+
+bool SharedSessionTable::get(const SessionToken &token, Entry &e) const {
+  if (!map) return false;
+
+  uint64_t now = Time::now();
+  unsigned start = token.hash() & mask;
+
+  for (unsigned i = 0; i < probeLength; i++)
+    if (read(entries[(start + i) & mask], e) && e.token == token)
+      return now <= e.expires;
+
+  return false;
+}
+
+
+bool SharedSessionTable::put(const SessionToken &token, const User &user) {
+  if (!map) return false;
+
+  // Pick a slot with this token, an expired slot or the oldest slot
+  uint64_t now = Time::now();
+  unsigned start = token.hash() & mask;
+  Entry *target = 0;
+
+  for (unsigned i = 0; i < probeLength; i++) {
+    Entry &e = entries[(start + i) & mask];
+
+    if (e.token == token || e.expires < now) {target = &e; break;}
+    if (!target || e.expires < target->expires) target = &e;
+  }
+
+  // Lock the entry, skip the update if another writer holds it
+  uint32_t seq = __atomic_load_n(&target->seq, __ATOMIC_RELAXED);
+  if ((seq & 1) ||
+      !__atomic_compare_exchange_n(&target->seq, &seq, seq + 1, false,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return false;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  target->token = token;
+  target->expires = user.getExpires();
+  target->auth = user.getAuth();
+
+  bool ok =
+    copyString(target->provider, sizeof(target->provider),
+               user.getProvider()) &&
+    copyString(target->id, sizeof(target->id), user.getID()) &&
+    copyString(target->name, sizeof(target->name), user.getName());
+
+  if (!ok) target->expires = 0; // Does not fit, leave the slot free
+
+  __atomic_store_n(&target->seq, seq + 2, __ATOMIC_RELEASE);
+
+  return ok;
+}
+
+
+uint32_t SharedSessionTable::getGeneration(const string &key) const {
+  uint32_t *gen = findGeneration(key);
+  return gen ? __atomic_load_n(gen, __ATOMIC_ACQUIRE) : 0;
+}
+
+
+void SharedSessionTable::invalidate(const string &key) {
+  uint32_t *gen = findGeneration(key);
+  if (gen) __atomic_add_fetch(gen, 1, __ATOMIC_RELEASE);
+}
+
+
+bool SharedSessionTable::read(const Entry &src, Entry &dst) {
+  for (unsigned i = 0; i < readRetries; i++) {
+    uint32_t seq = __atomic_load_n(&src.seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) continue;
+
+    memcpy(&dst, &src, sizeof(Entry));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&src.seq, __ATOMIC_RELAXED) == seq) {
+      // Guard against a corrupt file
+      dst.provider[sizeof(dst.provider) - 1] = 0;
+      dst.id[sizeof(dst.id) - 1] = 0;
+      dst.name[sizeof(dst.name) - 1] = 0;
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+uint32_t *SharedSessionTable::findGeneration(const string &key) const {
+  if (!map) return 0;
+
+  // FNV-1a, collisions only cause extra invalidations
+  uint32_t hash = 2166136261U;
+  for (unsigned i = 0; i < key.length(); i++)
+    hash = (hash ^ (uint8_t)key[i]) * 16777619U;
+
+  return &header->generations[hash % GENERATIONS];
+}
@@ -0,0 +1,108 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_SHARED_SESSION_TABLE_H
+#define BUILDBOTICS_SHARED_SESSION_TABLE_H
+
+#include "SessionTable.h"
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+
+
+namespace Buildbotics {
+  class User;
+
+  /// Decoded sessions shared by all server processes on a host through a
+  /// memory mapped file, or through an anonymous mapping by the threads and
+  /// forked worker processes of one server.  Each entry is guarded by a
+  /// seqlock so readers never block.  Entries are never deleted, expired
+  /// entries are simply reused.
+  ///
+  /// The table also holds generation counters, hashed by user, which are
+  /// bumped to invalidate data every process and thread caches per user.
+  class SharedSessionTable {
+  public:
+    struct Entry {
+      uint32_t seq; // Odd while an update is in progress
+      uint32_t reserved;
+      SessionToken token;
+      uint64_t expires;
+      uint64_t auth;
+      char provider[16];
+      char id[72];
+      char name[72];
+    };
+
+  protected:
+    static const unsigned GENERATIONS = 4096;
+
+    struct Header {
+      char magic[8];
+      uint32_t entrySize;
+      uint32_t capacity;
+      uint32_t generations[GENERATIONS];
+    };
+
+    int fd;
+    void *map;
+    uint64_t mapSize;
+    Header *header;
+    Entry *entries;
+    unsigned mask;
+
+  public:
+    SharedSessionTable();
+    ~SharedSessionTable();
+
+    bool isOpen() const {return map;}
+    void open(const std::string &path, unsigned capacity);
+    /// Anonymous table shared by threads and forked children
+    void create(unsigned capacity);
+    void close();
+
+    /// @return true if a live entry for @param token was copied to @param e
+    bool get(const SessionToken &token, Entry &e) const;
+    bool put(const SessionToken &token, const User &user);
+
+    /// @return The generation of the data cached for user @param key
+    uint32_t getGeneration(const std::string &key) const;
+    /// Invalidate data cached for user @param key everywhere
+    void invalidate(const std::string &key);
+
+  protected:
+    static bool read(const Entry &src, Entry &dst);
+    uint32_t *findGeneration(const std::string &key) const;
+  };
+}
+
+#endif // BUILDBOTICS_SHARED_SESSION_TABLE_H
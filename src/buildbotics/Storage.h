@@ -0,0 +1,78 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_STORAGE_H
+#define BUILDBOTICS_STORAGE_H
+
+#include "Upload.h"
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+
+
+namespace Buildbotics {
+  class Transaction;
+  class Worker;
+
+  /// Where uploaded files live.  One instance is shared by all Workers so
+  /// implementations must be thread safe.
+  class Storage {
+  public:
+    virtual ~Storage() {}
+
+    virtual const char *getName() const = 0;
+    virtual bool hasMultipart() const {return false;}
+    /// @return The largest single upload accepted or zero if unlimited
+    virtual uint64_t getMaxUploadSize() const {return 0;}
+
+    /// Fill in how the client uploads @param upload.  Called on a TaskPool
+    /// thread.
+    virtual void prepareUpload(Upload &upload) = 0;
+
+    /// Accept a direct upload authorized by @param token.
+    virtual void store(Transaction &tx, const std::string &token);
+
+    /// Respond to a download of the stored object at @param path.
+    virtual void download(Transaction &tx, const std::string &path,
+                          const std::string &type) = 0;
+
+    /// The local file holding @param path or an empty string.
+    virtual std::string getFile(const std::string &path) const {return "";}
+
+    /// A URL the server can fetch @param path from or an empty string.
+    virtual std::string getURL(Worker &worker, const std::string &path)
+    {return "";}
+  };
+}
+
+#endif // BUILDBOTICS_STORAGE_H
+
@@ -0,0 +1,308 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "Supervisor.h"
+#include "App.h"
+
+#include <cbang/Exception.h>
+#include <cbang/os/SysError.h>
+#include <cbang/log/Logger.h>
+#include <cbang/util/DefaultCatch.h>
+#include <cbang/time/Time.h>
+#include <cbang/json/Reader.h>
+#include <cbang/json/BufferWriter.h>
+#include <cbang/io/StringInputSource.h>
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const unsigned readRetries = 16;
+  const unsigned restartDelay = 5;  // Seconds, after a worker dies young
+  const unsigned drainTimeout = 30; // Seconds before SIGKILL on shutdown
+}
+
+
+Supervisor::Supervisor(App &app) :
+  app(app), slots(0), processes(0), index(-1), quit(false), quitTime(0) {}
+
+
+Supervisor::~Supervisor() {
+  if (slots) munmap(slots, processes * sizeof(Slot));
+}
+
+
+void Supervisor::init(unsigned processes) {
+  // Shared with the worker processes across fork()
+  void *map = mmap(0, processes * sizeof(Slot), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) THROWS("Failed to map stats board: " << SysError());
+
+  slots = (Slot *)map;
+  this->processes = processes;
+  restartAt.assign(processes, 0);
+  pids.assign(processes, 0);
+}
+
+
+bool Supervisor::run() {
+  sigset_t set, oldSet;
+  sigemptyset(&set);
+  sigaddset(&set, SIGCHLD);
+  sigaddset(&set, SIGTERM);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGUSR1);
+  sigprocmask(SIG_BLOCK, &set, &oldSet);
+
+  LOG_INFO(1, "Supervising " << processes << " worker processes");
+
+  while (true) {
+    uint64_t now = Time::now();
+
+    if (!quit)
+      for (unsigned i = 0; i < processes; i++)
+        if (!pids[i] && restartAt[i] <= now && spawn(i)) {
+          sigprocmask(SIG_SETMASK, &oldSet, 0);
+          return true;
+        }
+
+    if (quit && !getRunning()) break;
+
+    // Wait for a signal
+    struct timespec timeout = {0, 250000000};
+    int sig = sigtimedwait(&set, 0, &timeout);
+
+    if (sig == SIGTERM || sig == SIGINT) {
+      LOG_INFO(1, "Draining worker processes");
+      if (!quit) quitTime = now;
+      quit = true;
+      signalAll(SIGTERM);
+
+    } else if (sig == SIGUSR1) {
+      JSON::BufferWriter buf;
+      writeStats(buf);
+      buf.flush();
+      LOG_INFO(1, "Worker stats: " << string(buf.data(), buf.size()));
+    }
+
+    reap();
+
+    if (!quit && app.shouldQuit()) {
+      quit = true;
+      quitTime = now;
+      signalAll(SIGTERM);
+    }
+
+    if (quit && quitTime + drainTimeout < now) {
+      LOG_WARNING("Worker processes did not exit, killing");
+      signalAll(SIGKILL);
+      quitTime = now;
+    }
+  }
+
+  sigprocmask(SIG_SETMASK, &oldSet, 0);
+
+  return false;
+}
+
+
+void Supervisor::publish(const string &stats) {
+  if (!isChild()) return;
+
+  Slot &slot = slots[index];
+  uint32_t length = stats.length();
+  if (sizeof(slot.stats) < length) length = 0; // Too big, publish nothing
+
+  uint32_t seq = beginWrite(slot);
+  memcpy(slot.stats, stats.data(), length);
+  slot.length = length;
+  endWrite(slot, seq);
+}
+
+
+void Supervisor::writeStats(JSON::Writer &writer) const {
+  writer.beginList();
+
+  for (unsigned i = 0; i < processes; i++) {
+    Slot slot;
+    if (!read(i, slot)) continue;
+
+    writer.appendDict();
+    writer.insert("index", i);
+    writer.insert("pid", slot.pid);
+    writer.insert("started", Time(slot.started).toString());
+    writer.insert("restarts", slot.restarts);
+
+    if (slot.length)
+      try {
+        string stats(slot.stats, slot.length);
+        writer.beginInsert("stats");
+        JSON::Reader(StringInputSource(stats)).parse()->write(writer);
+      } CATCH_ERROR;
+
+    writer.endDict();
+  }
+
+  writer.endList();
+}
+
+
+bool Supervisor::spawn(unsigned i) {
+  // Written before fork() while no worker owns the slot
+  Slot &slot = slots[i];
+  uint32_t seq = beginWrite(slot);
+  uint64_t lastStarted = slot.started;
+  if (slot.started) slot.restarts++;
+  slot.started = Time::now();
+  slot.length = 0;
+  endWrite(slot, seq);
+
+  pid_t pid = fork();
+
+  if (pid == -1) {
+    LOG_ERROR("Failed to fork worker process: " << SysError());
+    restartAt[i] = Time::now() + restartDelay;
+
+    seq = beginWrite(slot);
+    if (lastStarted) slot.restarts--;
+    slot.started = lastStarted;
+    endWrite(slot, seq);
+
+    return false;
+  }
+
+  if (!pid) {
+    // Worker process, now the slot's only writer
+    index = i;
+    seq = beginWrite(slot);
+    slot.pid = getpid();
+    endWrite(slot, seq);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    return true;
+  }
+
+  pids[i] = pid;
+
+  LOG_INFO(1, "Started worker process " << i << " pid=" << pid);
+
+  return false;
+}
+
+
+void Supervisor::reap() {
+  while (true) {
+    int status;
+    pid_t pid = waitpid(-1, &status, WNOHANG);
+    if (pid <= 0) break;
+
+    for (unsigned i = 0; i < processes; i++)
+      if (pids[i] == pid) {
+        pids[i] = 0;
+
+        // The worker is gone, the slot is ours again
+        uint32_t seq = beginWrite(slots[i]);
+        slots[i].pid = 0;
+        endWrite(slots[i], seq);
+
+        if (WIFSIGNALED(status))
+          LOG_WARNING("Worker process " << i << " pid=" << pid
+                      << " killed by signal " << WTERMSIG(status));
+        else LOG_INFO(1, "Worker process " << i << " pid=" << pid
+                      << " exited with " << WEXITSTATUS(status));
+
+        // Do not spin on a worker which fails at startup
+        if (Time::now() < slots[i].started + restartDelay)
+          restartAt[i] = Time::now() + restartDelay;
+
+        break;
+      }
+  }
+}
+
+
+void Supervisor::signalAll(int sig) {
+  for (unsigned i = 0; i < processes; i++)
+    if (pids[i]) kill(pids[i], sig);
+}
+
+
+unsigned Supervisor::getRunning() const {
+  unsigned count = 0;
+
+  for (unsigned i = 0; i < processes; i++)
+    if (pids[i]) count++;
+
+  return count;
+}
+
+
+bool Supervisor::read(unsigned i, Slot &slot) const {
+  const Slot &src = slots[i];
+
+  for (unsigned j = 0; j < readRetries; j++) {
+    uint32_t seq = __atomic_load_n(&src.seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) continue;
+
+    memcpy(&slot, &src, sizeof(Slot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&src.seq, __ATOMIC_RELAXED) == seq) {
+      if (sizeof(slot.stats) < slot.length) slot.length = 0;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+uint32_t Supervisor::beginWrite(Slot &slot) {
+  uint32_t seq = __atomic_load_n(&slot.seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot.seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  return seq;
+}
+
+
+void Supervisor::endWrite(Slot &slot, uint32_t seq) {
+  __atomic_store_n(&slot.seq, seq + 2, __ATOMIC_RELEASE);
+}
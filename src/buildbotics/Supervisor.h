@@ -0,0 +1,105 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_SUPERVISOR_H
+#define BUILDBOTICS_SUPERVISOR_H
+
+#include <cbang/StdTypes.h>
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  class App;
+
+  /// Prefork process supervisor.  The supervisor process forks the worker
+  /// processes, which inherit the listen sockets bound by App, restarts them
+  /// when they die and forwards SIGTERM and SIGINT to them on shutdown.  Each
+  /// worker process publishes its stats to a shared memory board which any
+  /// process can read.  Each Slot has one writer at a time under its
+  /// seqlock, the supervisor before fork() and after the worker is reaped,
+  /// the worker in between.
+  class Supervisor {
+    struct Slot {
+      uint32_t seq; // Odd while an update is in progress
+      int32_t pid;
+      uint64_t started;
+      uint32_t restarts;
+      uint32_t length;
+      char stats[16360];
+    };
+
+    App &app;
+    Slot *slots;
+    unsigned processes;
+    std::vector<uint64_t> restartAt;
+    std::vector<pid_t> pids; // Supervisor's own view of the workers
+    int index;
+    bool quit;
+    uint64_t quitTime;
+
+  public:
+    Supervisor(App &app);
+    ~Supervisor();
+
+    bool isEnabled() const {return slots;}
+    bool isChild() const {return 0 <= index;}
+    unsigned getIndex() const {return index < 0 ? 0 : index;}
+
+    void init(unsigned processes);
+
+    /// Supervises the worker processes.  Returns true in a newly forked
+    /// worker process and false in the supervisor once all workers exited.
+    bool run();
+
+    /// Called by a worker process
+    void publish(const std::string &stats);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+
+  protected:
+    bool spawn(unsigned i);
+    void reap();
+    void signalAll(int sig);
+    unsigned getRunning() const;
+    bool read(unsigned i, Slot &slot) const;
+    static uint32_t beginWrite(Slot &slot);
+    static void endWrite(Slot &slot, uint32_t seq);
+  };
+}
+
+#endif // BUILDBOTICS_SUPERVISOR_H
+
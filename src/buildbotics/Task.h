@@ -0,0 +1,67 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_TASK_H
+#define BUILDBOTICS_TASK_H
+
+#include <string>
+
+
+namespace Buildbotics {
+  /// A CPU heavy request stage.  run() is called on a TaskPool thread and
+  /// must not touch the event loop.  complete() is then called back on the
+  /// event loop of the Worker which submitted the task, unless the task was
+  /// cancelled on that loop first.  Tasks are passed between threads by raw
+  /// pointer with one owner at a time, never reference counted, and are
+  /// freed by the Worker after completion.
+  class Task {
+    std::string error;
+    bool cancelled;
+
+  public:
+    Task() : cancelled(false) {}
+    virtual ~Task() {}
+
+    const std::string &getError() const {return error;}
+    void setError(const std::string &error) {this->error = error;}
+    bool failed() const {return !error.empty();}
+
+    /// Called on the Worker's event loop when the requester goes away
+    void cancel() {cancelled = true;}
+    bool isCancelled() const {return cancelled;}
+
+    virtual void run() = 0;
+    virtual void complete() = 0;
+  };
+}
+
+#endif // BUILDBOTICS_TASK_H
+
@@ -0,0 +1,169 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "TaskPool.h"
+#include "Worker.h"
+
+#include <cbang/Exception.h>
+#include <cbang/os/SmartLock.h>
+#include <cbang/log/Logger.h>
+#include <cbang/json/Writer.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  class PoolThread : public Thread {
+    TaskPool &pool;
+
+  public:
+    PoolThread(TaskPool &pool) : pool(pool) {}
+
+    // From Thread
+    void run() {pool.runThread();}
+  };
+}
+
+
+TaskPool::TaskPool() :
+  maxQueued(0), quit(false), active(0), peakQueued(0), submitted(0),
+  completed(0), failed(0), rejected(0) {}
+
+
+TaskPool::~TaskPool() {
+  stop();
+}
+
+
+void TaskPool::start(unsigned threads, unsigned maxQueued) {
+  this->maxQueued = maxQueued;
+
+  for (unsigned i = 0; i < threads; i++) {
+    SmartPointer<Thread> thread = new PoolThread(*this);
+    this->threads.push_back(thread);
+    thread->start();
+  }
+
+  LOG_INFO(3, "Started " << threads << " task threads");
+}
+
+
+void TaskPool::stop() {
+  if (threads.empty()) return;
+
+  lock();
+  quit = true;
+  broadcast();
+  unlock();
+
+  for (unsigned i = 0; i < threads.size(); i++) threads[i]->join();
+  threads.clear();
+
+  // Completions can no longer be delivered
+  for (unsigned i = 0; i < queue.size(); i++) delete queue[i].task;
+  queue.clear();
+}
+
+
+bool TaskPool::submit(Task *task, Worker &worker) {
+  SmartLock lock(this);
+
+  if (threads.empty() || quit || maxQueued <= queue.size()) {
+    rejected++;
+    return false;
+  }
+
+  queue.push_back(Entry(task, &worker));
+  submitted++;
+  if (peakQueued < queue.size()) peakQueued = queue.size();
+
+  signal();
+
+  return true;
+}
+
+
+void TaskPool::writeStats(JSON::Writer &writer) {
+  SmartLock lock(this);
+
+  writer.beginDict();
+  writer.insert("threads", threads.size());
+  writer.insert("queued", queue.size());
+  writer.insert("max_queued", maxQueued);
+  writer.insert("peak_queued", peakQueued);
+  writer.insert("active", active);
+  writer.insert("submitted", submitted);
+  writer.insert("completed", completed);
+  writer.insert("failed", failed);
+  writer.insert("inline", rejected);
+  writer.endDict();
+}
+
+
+void TaskPool::runThread() {
+  lock();
+
+  while (true) {
+    while (queue.empty() && !quit) wait();
+    if (quit) break;
+
+    Entry entry = queue.front();
+    queue.pop_front();
+    active++;
+
+    unlock();
+
+    try {
+      entry.task->run();
+    } catch (const Exception &e) {
+      entry.task->setError(e.getMessage());
+    } catch (const std::exception &e) {
+      entry.task->setError(e.what());
+    }
+
+    bool taskFailed = entry.task->failed();
+    if (taskFailed) LOG_WARNING("Task failed: " << entry.task->getError());
+
+    // Hands the task back, it must not be touched after this
+    entry.worker->taskDone(entry.task);
+
+    lock();
+
+    active--;
+    completed++;
+    if (taskFailed) failed++;
+  }
+
+  unlock();
+}
+
@@ -0,0 +1,90 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_TASK_POOL_H
+#define BUILDBOTICS_TASK_POOL_H
+
+#include "Task.h"
+
+#include <cbang/SmartPointer.h>
+#include <cbang/os/Thread.h>
+#include <cbang/os/Condition.h>
+
+#include <deque>
+#include <vector>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  class Worker;
+
+  /// A bounded pool of threads which runs Tasks off the event loops.  When
+  /// the pool is disabled or its queue is full submit() returns false and
+  /// the caller should run the task inline.
+  class TaskPool : public cb::Condition {
+    struct Entry {
+      Task *task; // Owned while queued or running
+      Worker *worker;
+
+      Entry(Task *task, Worker *worker) : task(task), worker(worker) {}
+    };
+
+    std::vector<cb::SmartPointer<cb::Thread> > threads;
+    std::deque<Entry> queue;
+    unsigned maxQueued;
+    bool quit;
+
+    // Stats
+    unsigned active;
+    unsigned peakQueued;
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t rejected;
+
+  public:
+    TaskPool();
+    ~TaskPool();
+
+    void start(unsigned threads, unsigned maxQueued);
+    void stop();
+
+    /// Thread safe.  Takes ownership of @param task on success.
+    bool submit(Task *task, Worker &worker);
+    void writeStats(cb::JSON::Writer &writer);
+
+    void runThread();
+  };
+}
+
+#endif // BUILDBOTICS_TASK_POOL_H
+
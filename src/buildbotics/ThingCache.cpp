@@ -0,0 +1,179 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "ThingCache.h"
+
+#include <cbang/String.h>
+#include <cbang/time/Time.h>
+#include <cbang/json/Writer.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const unsigned maxViews = 10000; // Per flush
+}
+
+
+ThingCache::ThingCache() :
+  maxEntries(0), timeout(0), generation(0), hits(0), misses(0),
+  invalidations(0), evictions(0) {}
+
+
+void ThingCache::init(unsigned maxEntries, unsigned timeout) {
+  SmartLock lock(this);
+  this->maxEntries = maxEntries;
+  this->timeout = timeout;
+}
+
+
+string ThingCache::getKey(const string &owner, const string &thing) {
+  return String::toLower(owner + "/" + thing);
+}
+
+
+const char *ThingCache::getSectionName(unsigned i) {
+  static const char *names[] = {"thing", "files", "comments", "stars"};
+  return i < SECTIONS ? names[i] : 0;
+}
+
+
+string ThingCache::splice(const string *sections) {
+  string json = "{";
+
+  for (unsigned i = 0; i < SECTIONS; i++) {
+    if (i) json += ",";
+    json += string("\"") + getSectionName(i) + "\":" + sections[i];
+  }
+
+  return json + "}";
+}
+
+
+bool ThingCache::get(const string &key, string &json) {
+  SmartLock lock(this);
+
+  entries_t::iterator it = entries.find(key);
+  if (it == entries.end() || it->second.valid != ALL ||
+      it->second.expires < Time::now()) {
+    misses++;
+    return false;
+  }
+
+  hits++;
+  lru.splice(lru.begin(), lru, it->second.it);
+  json = splice(it->second.sections);
+
+  return true;
+}
+
+
+uint64_t ThingCache::getGeneration() {
+  SmartLock lock(this);
+  return generation;
+}
+
+
+void ThingCache::insert(const string &key, const string *sections,
+                        uint64_t generation) {
+  SmartLock lock(this);
+
+  if (!maxEntries || generation != this->generation) return;
+
+  entries_t::iterator it = entries.find(key);
+  if (it != entries.end()) erase(it);
+
+  Entry &entry = entries[key];
+  for (unsigned i = 0; i < SECTIONS; i++) entry.sections[i] = sections[i];
+  entry.valid = ALL;
+  entry.expires = Time::now() + timeout;
+  entry.it = lru.insert(lru.begin(), key);
+
+  while (maxEntries < entries.size()) {
+    erase(entries.find(lru.back()));
+    evictions++;
+  }
+}
+
+
+void ThingCache::invalidate(const string &key, unsigned sections) {
+  SmartLock lock(this);
+
+  generation++;
+  invalidations++;
+
+  entries_t::iterator it = entries.find(key);
+  if (it == entries.end()) return;
+
+  Entry &entry = it->second;
+  entry.valid &= ~sections;
+
+  for (unsigned i = 0; i < SECTIONS; i++)
+    if (sections & (1 << i)) entry.sections[i].clear();
+
+  if (!entry.valid) erase(it);
+}
+
+
+void ThingCache::addView(const string &owner, const string &thing,
+                         const string &user) {
+  SmartLock lock(this);
+  if (views.size() < maxViews) views.push_back(View(owner, thing, user));
+}
+
+
+void ThingCache::takeViews(views_t &views) {
+  SmartLock lock(this);
+  views.swap(this->views);
+}
+
+
+void ThingCache::writeStats(JSON::Writer &writer) {
+  SmartLock lock(this);
+
+  writer.beginDict();
+  writer.insert("size", entries.size());
+  writer.insert("max_size", maxEntries);
+  writer.insert("hits", hits);
+  writer.insert("misses", misses);
+  writer.insert("invalidations", invalidations);
+  writer.insert("evictions", evictions);
+  writer.insert("queued_views", views.size());
+  writer.endDict();
+}
+
+
+void ThingCache::erase(entries_t::iterator it) {
+  lru.erase(it->second.it);
+  entries.erase(it);
+}
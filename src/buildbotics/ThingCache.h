@@ -0,0 +1,135 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_THING_CACHE_H
+#define BUILDBOTICS_THING_CACHE_H
+
+#include <cbang/StdTypes.h>
+#include <cbang/os/Mutex.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  /// Serialized GetThing() responses shared by all Workers.  Each section of
+  /// a thing is stored separately and invalidated by the handlers which
+  /// change it.  A response is spliced from the cached sections when all are
+  /// present.  Entries also expire after a timeout which bounds staleness
+  /// caused by changes made through other server processes.
+  ///
+  /// Views of cached things are queued and written to the DB in batches.
+  class ThingCache : public cb::Mutex {
+  public:
+    enum {
+      THING = 1 << 0,
+      FILES = 1 << 1,
+      COMMENTS = 1 << 2,
+      STARS = 1 << 3,
+      ALL = (1 << 4) - 1
+    };
+
+    static const unsigned SECTIONS = 4;
+
+    struct View {
+      std::string owner;
+      std::string thing;
+      std::string user;
+
+      View(const std::string &owner, const std::string &thing,
+           const std::string &user) : owner(owner), thing(thing), user(user) {}
+    };
+
+    typedef std::vector<View> views_t;
+
+  protected:
+    unsigned maxEntries;
+    unsigned timeout;
+
+    typedef std::list<std::string> lru_t;
+    lru_t lru; // Most recent first
+
+    struct Entry {
+      std::string sections[SECTIONS];
+      unsigned valid;
+      uint64_t expires;
+      lru_t::iterator it;
+    };
+
+    typedef std::map<std::string, Entry> entries_t;
+    entries_t entries;
+
+    // Incremented on every invalidation.  A fill which started before an
+    // invalidation may hold stale data and is dropped.
+    uint64_t generation;
+
+    views_t views;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+    uint64_t evictions;
+
+  public:
+    ThingCache();
+
+    void init(unsigned maxEntries, unsigned timeout);
+    bool isEnabled() const {return maxEntries;}
+
+    static std::string getKey(const std::string &owner,
+                              const std::string &thing);
+    static const char *getSectionName(unsigned i);
+    static std::string splice(const std::string *sections);
+
+    /// @return True and the spliced response in @param json on a hit
+    bool get(const std::string &key, std::string &json);
+    uint64_t getGeneration();
+    void insert(const std::string &key, const std::string *sections,
+                uint64_t generation);
+    void invalidate(const std::string &key, unsigned sections);
+
+    void addView(const std::string &owner, const std::string &thing,
+                 const std::string &user);
+    void takeViews(views_t &views);
+
+    void writeStats(cb::JSON::Writer &writer);
+
+  protected:
+    void erase(entries_t::iterator it);
+  };
+}
+
+#endif // BUILDBOTICS_THING_CACHE_H
+
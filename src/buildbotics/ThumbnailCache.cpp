@@ -0,0 +1,239 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "ThumbnailCache.h"
+#include "Thumbnailer.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/os/SysError.h>
+#include <cbang/os/SmartLock.h>
+#include <cbang/json/Writer.h>
+#include <cbang/log/Logger.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+ThumbnailCache::ThumbnailCache() :
+  maxSize(0), size(0), hits(0), misses(0), evictions(0) {}
+
+
+void ThumbnailCache::init(const string &root, uint64_t maxSize) {
+  SmartLock lock(this);
+
+  this->root = root;
+  this->maxSize = maxSize;
+  SystemUtilities::ensureDirectory(root);
+
+  // Rebuild the index, in no particular order
+  DIR *dir = opendir(root.c_str());
+  if (!dir) THROWS("Failed to open '" << root << "': " << SysError());
+
+  struct dirent *subdir;
+  while ((subdir = readdir(dir))) {
+    if (subdir->d_name[0] == '.') continue;
+
+    string path = root + "/" + subdir->d_name;
+    DIR *files = opendir(path.c_str());
+    if (!files) continue;
+
+    struct dirent *file;
+    while ((file = readdir(files))) {
+      string name = file->d_name;
+      string::size_type dot = name.find('.');
+      if (!dot || dot == string::npos) continue;
+
+      struct stat st;
+      string filename = path + "/" + name;
+      if (!stat(filename.c_str(), &st) && S_ISREG(st.st_mode))
+        add(name.substr(0, dot), filename, st.st_size);
+    }
+
+    closedir(files);
+  }
+
+  closedir(dir);
+
+  LOG_INFO(1, "Thumbnail cache has " << entries.size() << " files, "
+           << size << " bytes");
+  evict();
+}
+
+
+string ThumbnailCache::lookup(const string &name) {
+  string file;
+
+  {
+    SmartLock lock(this);
+
+    entries_t::iterator it = entries.find(name);
+    if (it == entries.end()) {
+      misses++;
+      return "";
+    }
+
+    file = it->second.file;
+  }
+
+  // Stat outside the lock
+  bool exists = SystemUtilities::exists(file);
+
+  SmartLock lock(this);
+
+  // The entry may have been replaced or evicted meanwhile
+  entries_t::iterator it = entries.find(name);
+  if (it != entries.end() && it->second.file == file) {
+    if (exists) {
+      hits++;
+      lru.splice(lru.begin(), lru, it->second.it);
+      return file;
+    }
+
+    erase(it); // Removed by someone else
+  }
+
+  misses++;
+  return "";
+}
+
+
+string ThumbnailCache::insert(const string &name, const string &ext,
+                              const string &data) {
+  string dir = root + "/" + name.substr(0, 2);
+  string file = dir + "/" + name + "." + ext;
+
+  // Write outside the lock, rename is atomic for concurrent readers
+  SystemUtilities::ensureDirectory(dir);
+
+  string tmp = dir + "/.thumb-XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd == -1) THROWS("Failed to create '" << tmp << "': " << SysError());
+  close(fd);
+
+  *SystemUtilities::oopen(tmp) << data;
+  if (rename(tmp.c_str(), file.c_str()))
+    THROWS("Failed to store '" << file << "': " << SysError());
+
+  SmartLock lock(this);
+
+  entries_t::iterator it = entries.find(name);
+  if (it != entries.end()) erase(it);
+
+  add(name, file, data.length());
+  evict();
+
+  return file;
+}
+
+
+bool ThumbnailCache::claim(const string &name, Thumbnailer &thumbnailer) {
+  SmartLock lock(this);
+
+  claims_t::iterator it = claims.find(name);
+  if (it == claims.end()) {
+    claims[name];
+    return true;
+  }
+
+  it->second.push_back(&thumbnailer);
+  return false;
+}
+
+
+void ThumbnailCache::release(const string &name, const string &file) {
+  vector<Thumbnailer *> waiters;
+
+  {
+    SmartLock lock(this);
+
+    claims_t::iterator it = claims.find(name);
+    if (it == claims.end()) return;
+
+    waiters.swap(it->second);
+    claims.erase(it);
+  }
+
+  for (unsigned i = 0; i < waiters.size(); i++)
+    waiters[i]->remoteDone(name, file);
+}
+
+
+void ThumbnailCache::writeStats(JSON::Writer &writer) {
+  SmartLock lock(this);
+
+  writer.beginDict();
+  writer.insert("files", entries.size());
+  writer.insert("size", size);
+  writer.insert("max_size", maxSize);
+  writer.insert("hits", hits);
+  writer.insert("misses", misses);
+  writer.insert("evictions", evictions);
+  writer.insert("claims", claims.size());
+  writer.endDict();
+}
+
+
+void ThumbnailCache::add(const string &name, const string &file,
+                         uint64_t size) {
+  Entry &entry = entries[name];
+  entry.file = file;
+  entry.size = size;
+  entry.it = lru.insert(lru.begin(), name);
+
+  this->size += size;
+}
+
+
+void ThumbnailCache::erase(entries_t::iterator it) {
+  size -= it->second.size;
+  lru.erase(it->second.it);
+  entries.erase(it);
+}
+
+
+void ThumbnailCache::evict() {
+  while (maxSize < size && !lru.empty()) {
+    entries_t::iterator it = entries.find(lru.back());
+    unlink(it->second.file.c_str());
+    erase(it);
+    evictions++;
+  }
+}
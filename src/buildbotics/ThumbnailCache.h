@@ -0,0 +1,109 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_THUMBNAIL_CACHE_H
+#define BUILDBOTICS_THUMBNAIL_CACHE_H
+
+#include <cbang/StdTypes.h>
+#include <cbang/os/Mutex.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  class Thumbnailer;
+
+  /// A size bounded, least recently used, on disk cache of generated
+  /// thumbnails shared by all Workers of a process.  Files are stored as
+  /// <ab>/<name>.<ext> and the index is rebuilt from the directory at
+  /// startup.  Each server process has its own directory.  Files removed by
+  /// others are treated as misses.
+  class ThumbnailCache : public cb::Mutex {
+    std::string root;
+    uint64_t maxSize;
+    uint64_t size;
+
+    typedef std::list<std::string> lru_t;
+    lru_t lru; // Most recent first
+
+    struct Entry {
+      std::string file;
+      uint64_t size;
+      lru_t::iterator it;
+    };
+
+    typedef std::map<std::string, Entry> entries_t;
+    entries_t entries;
+
+    // Thumbnails being generated and the other Thumbnailers waiting on them
+    typedef std::map<std::string, std::vector<Thumbnailer *> > claims_t;
+    claims_t claims;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+
+  public:
+    ThumbnailCache();
+
+    void init(const std::string &root, uint64_t maxSize);
+
+    /// @return The cached file for @param name or an empty string.
+    std::string lookup(const std::string &name);
+
+    /// Store @param data and evict old entries.  @return The file name.
+    std::string insert(const std::string &name, const std::string &ext,
+                       const std::string &data);
+
+    /// Claim generation of @param name.  @return true if the caller must
+    /// generate it and then call release(), otherwise @param thumbnailer is
+    /// told by Thumbnailer::remoteDone() when the claimant is done.
+    bool claim(const std::string &name, Thumbnailer &thumbnailer);
+    /// Drop the claim on @param name.  @param file is empty on failure.
+    void release(const std::string &name, const std::string &file);
+
+    void writeStats(cb::JSON::Writer &writer);
+
+  protected:
+    void add(const std::string &name, const std::string &file,
+             uint64_t size);
+    void erase(entries_t::iterator it);
+    void evict();
+  };
+}
+
+#endif // BUILDBOTICS_THUMBNAIL_CACHE_H
+
@@ -0,0 +1,434 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "Thumbnailer.h"
+#include "App.h"
+#include "Worker.h"
+#include "Transaction.h"
+#include "Task.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/net/URI.h>
+#include <cbang/openssl/Digest.h>
+#include <cbang/os/SystemUtilities.h>
+#include <cbang/os/SmartLock.h>
+#include <cbang/json/Writer.h>
+#include <cbang/event/Event.h>
+#include <cbang/event/Client.h>
+#include <cbang/event/Request.h>
+#include <cbang/event/PendingRequest.h>
+#include <cbang/event/HTTPStatus.h>
+#include <cbang/util/DefaultCatch.h>
+#include <cbang/time/Time.h>
+#include <cbang/log/Logger.h>
+
+#include <gd.h>
+
+#include <vector>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  // Thumbnail names include the source path, which never changes
+  const unsigned thumbnailMaxAge = 365 * Time::SEC_PER_DAY;
+
+
+  bool isPNG(const string &data) {
+    return String::startsWith(data, "\x89PNG");
+  }
+
+
+  bool isJPEG(const string &data) {
+    return String::startsWith(data, "\xff\xd8");
+  }
+
+
+  bool isGIF(const string &data) {
+    return String::startsWith(data, "GIF8");
+  }
+
+
+  unsigned getBE16(const string &data, unsigned offset) {
+    return (uint8_t)data[offset] << 8 | (uint8_t)data[offset + 1];
+  }
+
+
+  uint64_t getBE32(const string &data, unsigned offset) {
+    return (uint64_t)getBE16(data, offset) << 16 | getBE16(data, offset + 2);
+  }
+
+
+  /// Read the image dimensions from its header without decoding it
+  bool getDimensions(const string &data, uint64_t &width, uint64_t &height) {
+    if (isPNG(data)) {
+      // IHDR is always the first chunk
+      if (data.length() < 24) return false;
+      width = getBE32(data, 16);
+      height = getBE32(data, 20);
+      return true;
+    }
+
+    if (isGIF(data)) {
+      // Logical screen size, little endian
+      if (data.length() < 10) return false;
+      width = (uint8_t)data[6] | (uint8_t)data[7] << 8;
+      height = (uint8_t)data[8] | (uint8_t)data[9] << 8;
+      return true;
+    }
+
+    if (isJPEG(data)) {
+      // Walk the markers to the start of frame
+      unsigned i = 2;
+      while (i + 4 <= data.length()) {
+        if ((uint8_t)data[i] != 0xff) return false;
+        uint8_t marker = data[i + 1];
+
+        if (marker == 0xff) {i++; continue;} // Fill byte
+        if (marker == 0x01 || (0xd0 <= marker && marker <= 0xd8)) {
+          i += 2;
+          continue;
+        }
+        if (marker == 0xd9 || marker == 0xda) return false; // EOI or SOS
+
+        if (0xc0 <= marker && marker <= 0xcf && marker != 0xc4 &&
+            marker != 0xc8 && marker != 0xcc) {
+          if (data.length() < i + 9) return false;
+          height = getBE16(data, i + 5);
+          width = getBE16(data, i + 7);
+          return true;
+        }
+
+        i += 2 + getBE16(data, i + 2);
+      }
+    }
+
+    return false;
+  }
+
+
+  /// Fit @param data within @param pixels square, never enlarging.  Images
+  /// larger than @param maxPixels in total are refused before decoding.
+  /// JPEGs stay JPEGs, everything else becomes a PNG.
+  string resize(const string &data, unsigned pixels, uint64_t maxPixels,
+                string &ext) {
+    uint64_t srcWidth, srcHeight;
+    if (!getDimensions(data, srcWidth, srcHeight))
+      THROW("Unsupported or invalid image");
+    if (maxPixels && maxPixels / (srcHeight ? srcHeight : 1) < srcWidth)
+      THROW("Image too large " << srcWidth << "x" << srcHeight);
+
+    int length = data.length();
+    void *ptr = (void *)data.data();
+
+    gdImagePtr src = 0;
+    if (isPNG(data)) src = gdImageCreateFromPngPtr(length, ptr);
+    else if (isJPEG(data)) src = gdImageCreateFromJpegPtr(length, ptr);
+    else if (isGIF(data)) src = gdImageCreateFromGifPtr(length, ptr);
+    if (!src) THROW("Unsupported or invalid image");
+
+    int width = gdImageSX(src);
+    int height = gdImageSY(src);
+    int longest = width < height ? height : width;
+
+    if ((int)pixels < longest) {
+      width = width * pixels / longest;
+      height = height * pixels / longest;
+      if (!width) width = 1;
+      if (!height) height = 1;
+    }
+
+    gdImagePtr dst = gdImageCreateTrueColor(width, height);
+    if (!dst) {
+      gdImageDestroy(src);
+      THROW("Failed to allocate thumbnail");
+    }
+
+    gdImageAlphaBlending(dst, 0);
+    gdImageSaveAlpha(dst, 1);
+    gdImageCopyResampled(dst, src, 0, 0, 0, 0, width, height,
+                         gdImageSX(src), gdImageSY(src));
+    gdImageDestroy(src);
+
+    int size = 0;
+    void *out;
+    if (isJPEG(data)) {
+      out = gdImageJpegPtr(dst, &size, 85);
+      ext = "jpg";
+
+    } else {
+      out = gdImagePngPtr(dst, &size);
+      ext = "png";
+    }
+
+    gdImageDestroy(dst);
+    if (!out) THROW("Failed to encode thumbnail");
+
+    string result((const char *)out, size);
+    gdFree(out);
+
+    return result;
+  }
+
+
+  string getType(const string &file) {
+    return String::endsWith(file, ".jpg") ? "image/jpeg" : "image/png";
+  }
+}
+
+
+class Thumbnailer::Job : public Task {
+  Thumbnailer &thumbnailer;
+  string name;
+  unsigned pixels;
+  string source;
+  string data;
+  string file;
+
+  typedef vector<Transaction *> waiters_t;
+  waiters_t waiters;
+
+public:
+  Job(Thumbnailer &thumbnailer, const string &name, unsigned pixels) :
+    thumbnailer(thumbnailer), name(name), pixels(pixels) {}
+
+  void setSource(const string &source) {this->source = source;}
+  void add(Transaction &tx) {waiters.push_back(&tx);}
+
+
+  void remove(Transaction &tx) {
+    for (waiters_t::iterator it = waiters.begin(); it != waiters.end(); it++)
+      if (*it == &tx) {
+        waiters.erase(it);
+        break;
+      }
+  }
+
+
+  void reply(const string &file, const string &error) {
+    waiters_t waiters;
+    waiters.swap(this->waiters);
+
+    for (unsigned i = 0; i < waiters.size(); i++)
+      try {
+        if (file.empty())
+          waiters[i]->sendError(Event::HTTP_BAD_GATEWAY, error);
+        else waiters[i]->sendFile(file, getType(file), name, thumbnailMaxAge);
+      } CATCH_ERROR;
+  }
+
+
+  bool fetched(Event::Request &req) {
+    int code = req.getResponseCode();
+
+    if (code == Event::HTTP_OK || code == Event::HTTP_PARTIAL_CONTENT) {
+      // One byte more than the limit was requested
+      if (getMaxSourceSize() < req.getInput().length())
+        setError("Original image too large");
+      else data = req.getInput();
+
+    } else LOG_WARNING("Failed to fetch image for thumbnail "
+                       << req.getURI().getPath() << ": " << code);
+
+    // Takes ownership
+    thumbnailer.getWorker().submit(this);
+
+    return true;
+  }
+
+
+  uint64_t getMaxSourceSize() const {
+    return thumbnailer.getWorker().getApp().getThumbnailMaxSourceSize();
+  }
+
+
+  // From Task
+  void run() {
+    if (failed()) return;
+
+    if (data.empty()) {
+      if (source.empty()) THROW("Failed to fetch original image");
+      if (getMaxSourceSize() < SystemUtilities::getFileSize(source))
+        THROW("Original image too large");
+      data = SystemUtilities::read(source);
+    }
+
+    string ext;
+    uint64_t maxPixels =
+      thumbnailer.getWorker().getApp().getThumbnailMaxPixels();
+    string thumb = resize(data, pixels, maxPixels, ext);
+    data.clear();
+
+    file = thumbnailer.getWorker().getApp().getThumbnailCache()
+      .insert(name, ext, thumb);
+  }
+
+
+  void complete() {
+    if (failed()) file.clear();
+
+    // Deregister first so replies which free a Transaction cannot touch the
+    // list being walked
+    thumbnailer.jobDone(name, file);
+    reply(file, getError());
+  }
+};
+
+
+Thumbnailer::Thumbnailer(Worker &worker) :
+  worker(worker),
+  remoteEvent(&worker.getEventBase()
+              .newEvent(this, &Thumbnailer::remoteEventCB)),
+  generated(0), coalesced(0), failed(0) {}
+
+
+unsigned Thumbnailer::getPixels(const string &size) {
+  if (size == "thumb") return 32;
+  if (size == "asmall") return 150;
+  if (size == "alarge") return 200;
+  return 0;
+}
+
+
+void Thumbnailer::get(Transaction &tx, const string &path,
+                      const string &size) {
+  unsigned pixels = getPixels(size);
+  if (!pixels) THROWX("Invalid image size '" << size << "'",
+                      Event::HTTP_BAD_REQUEST);
+
+  string name = String::hexEncode
+    (Digest::hash(path + "?size=" + String(pixels), "sha256"));
+
+  App &app = worker.getApp();
+  string file = app.getThumbnailCache().lookup(name);
+  if (!file.empty())
+    return tx.sendFile(file, getType(file), name, thumbnailMaxAge);
+
+  // Coalesce concurrent requests
+  jobs_t::iterator it = jobs.find(name);
+  if (it != jobs.end()) {
+    it->second->add(tx);
+    coalesced++;
+    return;
+  }
+
+  ThumbnailCache &cache = app.getThumbnailCache();
+  Job *job = new Job(*this, name, pixels);
+  job->add(tx);
+  jobs[name] = job;
+
+  // Another Worker is generating it, wait for remoteDone()
+  if (!cache.claim(name, *this)) {
+    coalesced++;
+    return;
+  }
+
+  try {
+    Storage &storage = app.getStorage();
+    string source = storage.getFile(path);
+
+    if (!source.empty()) {
+      job->setSource(source);
+      worker.submit(job);
+      return;
+    }
+
+    SmartPointer<Event::PendingRequest> pr = worker.getEventClient()
+      .callMember(URI(storage.getURL(worker, path)), Event::HTTP_GET, 0, 0,
+                  job, &Job::fetched);
+
+    // One byte more than the limit shows an original is too large without
+    // buffering all of it
+    pr->outSet("Range", "bytes=0-" + String(app.getThumbnailMaxSourceSize()));
+    pr->send();
+
+  } catch (...) {
+    jobs.erase(name);
+    cache.release(name, "");
+    delete job;
+    throw;
+  }
+}
+
+
+void Thumbnailer::cancel(Transaction &tx) {
+  for (jobs_t::iterator it = jobs.begin(); it != jobs.end(); it++)
+    it->second->remove(tx);
+}
+
+
+void Thumbnailer::jobDone(const string &name, const string &file) {
+  jobs.erase(name);
+  if (file.empty()) failed++;
+  else generated++;
+
+  worker.getApp().getThumbnailCache().release(name, file);
+}
+
+
+void Thumbnailer::remoteDone(const string &name, const string &file) {
+  SmartLock lock(&remoteLock);
+  remote.push_back(make_pair(name, file));
+  remoteEvent->activate();
+}
+
+
+void Thumbnailer::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("pending", jobs.size());
+  writer.insert("generated", generated);
+  writer.insert("coalesced", coalesced);
+  writer.insert("failed", failed);
+  writer.endDict();
+}
+
+
+void Thumbnailer::remoteEventCB(Event::Event &e, int signal, unsigned flags) {
+  remote_t done;
+
+  {
+    SmartLock lock(&remoteLock);
+    done.swap(remote);
+  }
+
+  for (unsigned i = 0; i < done.size(); i++) {
+    jobs_t::iterator it = jobs.find(done[i].first);
+    if (it == jobs.end()) continue;
+
+    Job *job = it->second;
+    jobs.erase(it);
+    job->reply(done[i].second, "Failed to generate thumbnail");
+    delete job;
+  }
+}
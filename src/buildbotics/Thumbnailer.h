@@ -0,0 +1,101 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_THUMBNAILER_H
+#define BUILDBOTICS_THUMBNAILER_H
+
+#include <cbang/StdTypes.h>
+#include <cbang/os/Mutex.h>
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace cb {
+  namespace Event {class Event;}
+  namespace JSON {class Writer;}
+}
+
+
+namespace Buildbotics {
+  class Worker;
+  class Transaction;
+
+  /// Serves resized images from the App's ThumbnailCache.  Misses fetch the
+  /// original from Storage and resize it on the TaskPool.  Concurrent
+  /// requests for the same thumbnail wait on one job, across Workers by
+  /// claiming it in the ThumbnailCache.  Not thread safe, each Worker has its
+  /// own, except for remoteDone().
+  class Thumbnailer {
+    Worker &worker;
+
+    class Job;
+    typedef std::map<std::string, Job *> jobs_t;
+    jobs_t jobs;
+
+    // Jobs finished by other Workers, name and file
+    typedef std::vector<std::pair<std::string, std::string> > remote_t;
+    cb::Mutex remoteLock;
+    remote_t remote;
+    cb::Event::Event *remoteEvent;
+
+    uint64_t generated;
+    uint64_t coalesced;
+    uint64_t failed;
+
+  public:
+    Thumbnailer(Worker &worker);
+
+    Worker &getWorker() {return worker;}
+
+    /// @return The bounding box size for @param size or zero if unknown
+    static unsigned getPixels(const std::string &size);
+
+    /// Respond to @param tx with the @param size thumbnail of the stored
+    /// image at @param path.
+    void get(Transaction &tx, const std::string &path,
+             const std::string &size);
+    /// Stop waiting on any job for @param tx.  Called when it is freed.
+    void cancel(Transaction &tx);
+    void jobDone(const std::string &name, const std::string &file);
+    /// Called from any thread when another Worker finished the thumbnail
+    /// @param name claimed by this one.  @param file is empty on failure.
+    void remoteDone(const std::string &name, const std::string &file);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+
+  protected:
+    void remoteEventCB(cb::Event::Event &e, int signal, unsigned flags);
+  };
+}
+
+#endif // BUILDBOTICS_THUMBNAILER_H
+
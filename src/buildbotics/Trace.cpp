@@ -0,0 +1,121 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "Trace.h"
+
+#include <cbang/time/Timer.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  bool isHex(const string &s, unsigned offset, unsigned length) {
+    if (s.length() < offset + length) return false;
+
+    for (unsigned i = offset; i < offset + length; i++)
+      if (!isxdigit(s[i])) return false;
+
+    return true;
+  }
+}
+
+
+Trace::Trace() :
+  sampled(false), wallStart(Timer::now()), start(now()), end(0), count(0) {}
+
+
+uint64_t Trace::now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+void Trace::setParent(const string &traceparent) {
+  // version "-" trace-id "-" parent-id "-" trace-flags
+  if (traceparent.length() < 55 || !isHex(traceparent, 3, 32) ||
+      !isHex(traceparent, 36, 16) || !isHex(traceparent, 53, 2)) return;
+
+  id = traceparent.substr(3, 32);
+  parentID = traceparent.substr(36, 16);
+  sampled = strtoul(traceparent.substr(53, 2).c_str(), 0, 16) & 1;
+}
+
+
+void Trace::setID(const string &id) {
+  if (id.length() == 32 && isHex(id, 0, 32)) this->id = id;
+}
+
+
+unsigned Trace::begin(const char *name) {
+  if (count == MAX_SPANS) return MAX_SPANS;
+
+  Span &span = spans[count];
+  span.name = name;
+  span.start = now();
+  span.end = span.busy = 0;
+
+  return count++;
+}
+
+
+void Trace::end(unsigned span) {
+  if (span < count && !spans[span].end) spans[span].end = now();
+}
+
+
+void Trace::addBusy(unsigned span, uint64_t busy) {
+  if (span < count) spans[span].busy += busy;
+}
+
+
+void Trace::end(const char *name) {
+  for (unsigned i = count; i; i--)
+    if (!spans[i - 1].end && !strcmp(spans[i - 1].name, name))
+      return end(i - 1);
+}
+
+
+void Trace::finish() {
+  if (end) return;
+  end = now();
+
+  // Close any spans left open
+  for (unsigned i = 0; i < count; i++)
+    if (!spans[i].end) spans[i].end = end;
+}
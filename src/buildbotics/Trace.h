@@ -0,0 +1,98 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_TRACE_H
+#define BUILDBOTICS_TRACE_H
+
+#include <cbang/StdTypes.h>
+
+#include <string>
+
+
+namespace Buildbotics {
+  /// Timing of the phases of one request.  Times are monotonic nanoseconds,
+  /// converted to wall clock time with the start time when written.  Spans
+  /// past the maximum are dropped.
+  class Trace {
+  public:
+    static const unsigned MAX_SPANS = 32;
+
+    struct Span {
+      const char *name;
+      uint64_t start;
+      uint64_t end; // Zero while open
+      uint64_t busy; // Time spent in callbacks, if tracked
+    };
+
+  protected:
+    std::string id;       // 32 hex digits
+    std::string parentID; // 16 hex digits, from an incoming traceparent
+    bool sampled;         // Requested by the caller
+
+    double wallStart;
+    uint64_t start;
+    uint64_t end;
+
+    Span spans[MAX_SPANS];
+    unsigned count;
+
+  public:
+    Trace();
+
+    static uint64_t now();
+
+    /// Take the trace ID from a W3C traceparent or X-Trace-ID header
+    void setParent(const std::string &traceparent);
+    void setID(const std::string &id);
+    const std::string &getID() const {return id;}
+    bool hasID() const {return !id.empty();}
+    const std::string &getParentID() const {return parentID;}
+    bool isSampled() const {return sampled;}
+
+    double getWallStart() const {return wallStart;}
+    uint64_t getStart() const {return start;}
+    uint64_t getEnd() const {return end;}
+    uint64_t getDuration() const {return (end ? end : now()) - start;}
+
+    unsigned getCount() const {return count;}
+    const Span &getSpan(unsigned i) const {return spans[i];}
+
+    /// @return A span index for end(), or MAX_SPANS if there is no room
+    unsigned begin(const char *name);
+    void end(unsigned span);
+    void addBusy(unsigned span, uint64_t busy);
+    /// End the last open span named @param name, if any
+    void end(const char *name);
+    void finish();
+  };
+}
+
+#endif // BUILDBOTICS_TRACE_H
@@ -0,0 +1,319 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "Tracer.h"
+#include "Trace.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/time/Timer.h>
+#include <cbang/log/Logger.h>
+#include <cbang/json/BufferWriter.h>
+#include <cbang/os/SmartLock.h>
+#include <cbang/os/SysError.h>
+#include <cbang/util/DefaultCatch.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  const unsigned maxQueuedLines = 4096;
+
+
+  class TracerThread : public Thread {
+    Tracer &tracer;
+
+  public:
+    TracerThread(Tracer &tracer) : tracer(tracer) {}
+
+    // From Thread
+    void run() {tracer.runThread();}
+  };
+
+
+  void insertAttribute(JSON::Writer &writer, const char *key,
+                       const string &value, const char *type = "stringValue") {
+    writer.beginAppend();
+    writer.beginDict();
+    writer.insert("key", key);
+    writer.insertDict("value");
+    writer.insert(type, value);
+    writer.endDict();
+    writer.endDict();
+  }
+
+
+  string toNanos(const Trace &trace, uint64_t t) {
+    // OTLP JSON encodes 64-bit integers as strings
+    uint64_t wall = (uint64_t)(trace.getWallStart() * 1e9);
+    return String(wall + t - trace.getStart());
+  }
+}
+
+
+Tracer::Tracer() :
+  sampleRate(0), threshold(0), fd(-1), state(0), quit(false), traces(0),
+  sampled(0), slow(0), dropped(0) {}
+
+
+Tracer::~Tracer() {
+  stop();
+  if (fd != -1) close(fd);
+}
+
+
+void Tracer::init(double sampleRate, double threshold, const string &path) {
+  SmartLock lock(this);
+
+  this->sampleRate = sampleRate;
+  this->threshold = threshold;
+  state = Trace::now() ^ ((uint64_t)getpid() << 32);
+
+  if (!path.empty() && fd == -1) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1)
+      THROWS("Failed to open trace file '" << path << "': " << SysError());
+  }
+
+  if (isEnabled() && thread.isNull()) {
+    thread = new TracerThread(*this);
+    thread->start();
+  }
+}
+
+
+void Tracer::stop() {
+  if (thread.isNull()) return;
+
+  lock();
+  quit = true;
+  broadcast();
+  unlock();
+
+  // Queued lines are written first
+  thread->join();
+  thread.release();
+}
+
+
+string Tracer::newID(unsigned bytes) {
+  SmartLock lock(this);
+  return nextID(bytes);
+}
+
+
+string Tracer::nextID(unsigned bytes) {
+  char buf[33];
+  snprintf(buf, 17, "%016llx", (unsigned long long)next());
+  if (16 <= bytes)
+    snprintf(buf + 16, 17, "%016llx", (unsigned long long)next());
+
+  return buf;
+}
+
+
+void Tracer::submit(const Trace &trace, const string &method,
+                    const string &path, const char *route, int status) {
+  double duration = trace.getDuration() / 1e9;
+  bool isSlow = threshold && threshold <= duration;
+  string traceID;
+  string rootID;
+  string spanIDs[Trace::MAX_SPANS];
+
+  {
+    SmartLock lock(this);
+
+    traces++;
+    if (isSlow) slow++;
+
+    if (!isSlow && !trace.isSampled() &&
+        (!sampleRate || sampleRate <= next() / 18446744073709551616.0))
+      return;
+
+    if (maxQueuedLines <= lines.size()) {
+      dropped++;
+      return;
+    }
+
+    sampled++;
+
+    // All IDs at once, the rest is formatted outside the lock
+    traceID = trace.hasID() ? trace.getID() : nextID(16);
+    rootID = nextID(8);
+    for (unsigned i = 0; i < trace.getCount(); i++) spanIDs[i] = nextID(8);
+  }
+
+  JSON::BufferWriter writer(0, true);
+  writer.beginDict();
+  writer.insertList("resourceSpans");
+  writer.beginAppend();
+  writer.beginDict();
+
+  writer.insertDict("resource");
+  writer.insertList("attributes");
+  insertAttribute(writer, "service.name", "buildbotics");
+  writer.endList();
+  writer.endDict();
+
+  writer.insertList("scopeSpans");
+  writer.beginAppend();
+  writer.beginDict();
+  writer.insertDict("scope");
+  writer.insert("name", "buildbotics");
+  writer.endDict();
+  writer.insertList("spans");
+
+  // Root span for the whole request
+  writer.beginAppend();
+  writer.beginDict();
+  writeSpan(writer, trace, traceID, rootID, trace.getParentID(),
+            (method + " " + (route ? route : path)).c_str(), trace.getStart(),
+            trace.getEnd());
+  writer.insert("kind", 2); // SERVER
+  writer.insertList("attributes");
+  insertAttribute(writer, "http.method", method);
+  insertAttribute(writer, "http.target", path);
+  if (route) insertAttribute(writer, "http.route", route);
+  insertAttribute(writer, "http.status_code", String(status), "intValue");
+  writer.endList();
+  if (500 <= status) {
+    writer.insertDict("status");
+    writer.insert("code", 2); // ERROR
+    writer.endDict();
+  }
+  writer.endDict();
+
+  // Phases
+  for (unsigned i = 0; i < trace.getCount(); i++) {
+    const Trace::Span &span = trace.getSpan(i);
+
+    writer.beginAppend();
+    writer.beginDict();
+    writeSpan(writer, trace, traceID, spanIDs[i], rootID, span.name,
+              span.start, span.end);
+    if (span.busy) {
+      writer.insertList("attributes");
+      insertAttribute(writer, "callback.time_ns", String(span.busy),
+                      "intValue");
+      writer.endList();
+    }
+    writer.endDict();
+  }
+
+  writer.endList();
+  writer.endDict();
+  writer.endList();
+  writer.endDict();
+  writer.endList();
+  writer.endDict();
+  writer.flush();
+
+  SmartLock lock(this);
+  lines.push_back(string(writer.data(), writer.size()));
+  signal();
+}
+
+
+void Tracer::writeStats(JSON::Writer &writer) {
+  SmartLock lock(this);
+
+  writer.beginDict();
+  writer.insert("traces", traces);
+  writer.insert("sampled", sampled);
+  writer.insert("slow", slow);
+  writer.insert("queued", lines.size());
+  writer.insert("dropped", dropped);
+  writer.endDict();
+}
+
+
+void Tracer::runThread() {
+  lock();
+
+  while (true) {
+    while (lines.empty() && !quit) wait();
+    if (lines.empty()) break;
+
+    deque<string> batch;
+    batch.swap(lines);
+
+    unlock();
+
+    try {
+      for (unsigned i = 0; i < batch.size(); i++)
+        if (fd == -1) LOG_INFO(1, "Trace: " << batch[i]);
+        else write(batch[i]);
+    } CATCH_ERROR;
+
+    lock();
+  }
+
+  unlock();
+}
+
+
+void Tracer::write(const string &line) {
+  // One write() per line, appends to a regular file are not interleaved
+  string buffer = line + '\n';
+
+  while (::write(fd, buffer.data(), buffer.length()) == -1)
+    if (errno != EINTR)
+      THROWS("Failed to write trace: " << SysError());
+}
+
+
+uint64_t Tracer::next() {
+  // splitmix64
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+
+void Tracer::writeSpan(JSON::Writer &writer, const Trace &trace,
+                       const string &traceID, const string &id,
+                       const string &parentID,
+                       const char *name, uint64_t start, uint64_t end) {
+  writer.insert("traceId", traceID);
+  writer.insert("spanId", id);
+  if (!parentID.empty()) writer.insert("parentSpanId", parentID);
+  writer.insert("name", name);
+  writer.insert("startTimeUnixNano", toNanos(trace, start));
+  writer.insert("endTimeUnixNano", toNanos(trace, end));
+}
@@ -0,0 +1,100 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_TRACER_H
+#define BUILDBOTICS_TRACER_H
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+#include <cbang/os/Thread.h>
+#include <cbang/os/Condition.h>
+
+#include <string>
+#include <deque>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  class Trace;
+
+  /// Writes a sample of request Traces, and every Trace slower than a
+  /// threshold, as OTLP JSON lines to a file or else to the log.  Lines are
+  /// formatted by the submitting Worker and written by a background thread
+  /// from a bounded queue.  Each line is one write() to an O_APPEND file, so
+  /// lines from several processes do not interleave.  Shared by all Workers.
+  class Tracer : public cb::Condition {
+    double sampleRate;
+    double threshold; // Seconds
+    int fd; // The trace file or -1
+
+    uint64_t state; // Random ID generator
+
+    cb::SmartPointer<cb::Thread> thread;
+    std::deque<std::string> lines;
+    bool quit;
+
+    uint64_t traces;
+    uint64_t sampled;
+    uint64_t slow;
+    uint64_t dropped;
+
+  public:
+    Tracer();
+    ~Tracer();
+
+    void init(double sampleRate, double threshold, const std::string &path);
+    void stop();
+    bool isEnabled() const {return sampleRate || threshold;}
+
+    /// @return A random hex ID of @param bytes, eight or sixteen
+    std::string newID(unsigned bytes = 16);
+
+    /// Thread safe
+    void submit(const Trace &trace, const std::string &method,
+                const std::string &path, const char *route, int status);
+
+    void writeStats(cb::JSON::Writer &writer);
+
+    void runThread();
+
+  protected:
+    void write(const std::string &line);
+    uint64_t next();
+    std::string nextID(unsigned bytes);
+    void writeSpan(cb::JSON::Writer &writer, const Trace &trace,
+                   const std::string &traceID, const std::string &id,
+                   const std::string &parentID,
+                   const char *name, uint64_t start, uint64_t end);
+  };
+}
+
+#endif // BUILDBOTICS_TRACER_H
@@ -31,7 +31,19 @@
 
 #include "Transaction.h"
 #include "App.h"
-#include "AWS4Post.h"
+#include "Worker.h"
+#include "AWS4PresignedURL.h"
+#include "Storage.h"
+#include "Thumbnailer.h"
+#include "ThingCache.h"
+#include "Compressor.h"
+#include "Arena.h"
+#include "ArenaPool.h"
+#include "RateLimiter.h"
+#include "Tracer.h"
+#include "Task.h"
+#include "Responder.h"
+#include "SQLStatements.h"
 
 #include <cbang/event/Client.h>
 #include <cbang/event/Buffer.h>
@@ -39,6 +51,7 @@
 #include <cbang/event/Event.h>
 
 #include <cbang/json/JSON.h>
+#include <cbang/json/BufferWriter.h>
 #include <cbang/log/Logger.h>
 #include <cbang/util/DefaultCatch.h>
 #include <cbang/db/maria/EventDB.h>
@@ -47,23 +60,204 @@
 #include <cbang/net/URI.h>
 #include <cbang/io/StringInputSource.h>
 #include <cbang/os/SystemUtilities.h>
+#include <cbang/os/SysError.h>
 
 #include <mysql/mysqld_error.h>
+#include <event2/buffer.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace cb;
 using namespace Buildbotics;
 
 
-Transaction::Transaction(App &app, evhttp_request *req) :
-  Request(req), Event::OAuth2Login(app.getEventClient()), app(app),
-  jsonFields(0) {
+namespace {
+  const unsigned maxAuthCacheSize = 64 * 1024;
+
+
+  const unsigned maxBatchUploads = 100;
+  const unsigned maxMultipartParts = 10000; // S3 limit
+  const uint64_t maxMultipartSize = 5ULL << 40; // S3 limit
+  const unsigned s3RequestExpires = 15 * 60;
+  const char *httpDateFormat = "%a, %d %b %Y %H:%M:%S GMT";
+  const size_t arenaHeader = 16; // Keeps the Transaction aligned
+  const int tooManyRequests = 429;
+
+
+  string xmlTag(const string &xml, const string &name) {
+    string open = "<" + name + ">";
+    string::size_type start = xml.find(open);
+    if (start == string::npos) return "";
+
+    start += open.length();
+    string::size_type end = xml.find("</" + name + ">", start);
+    if (end == string::npos) return "";
+
+    return xml.substr(start, end - start);
+  }
+
+
+  string xmlEscape(const string &s) {
+    string result;
+
+    for (unsigned i = 0; i < s.length(); i++)
+      switch (s[i]) {
+      case '&': result += "&amp;"; break;
+      case '<': result += "&lt;"; break;
+      case '>': result += "&gt;"; break;
+      default: result += s[i]; break;
+      }
+
+    return result;
+  }
+
+
+  /// Parse a single "bytes=" range.  Returns false if it cannot be satisfied.
+  /// Malformed and multiple ranges are ignored, per RFC 7233.
+  bool parseRange(const string &range, uint64_t size, uint64_t &offset,
+                  uint64_t &length) {
+    if (!String::startsWith(range, "bytes=") ||
+        range.find(',') != string::npos) return true;
+
+    string spec = String::trim(range.substr(6));
+    string::size_type dash = spec.find('-');
+    if (dash == string::npos) return true;
+
+    string first = spec.substr(0, dash);
+    string last = spec.substr(dash + 1);
+
+    try {
+      if (first.empty()) {
+        // Suffix range, the final N bytes
+        if (last.empty()) return true;
+        uint64_t suffix = String::parseU64(last);
+        if (!suffix || !size) return false;
+
+        if (size < suffix) suffix = size;
+        offset = size - suffix;
+        length = suffix;
+        return true;
+      }
+
+      uint64_t start = String::parseU64(first);
+      uint64_t end = last.empty() ? size - 1 : String::parseU64(last);
+      if (end < start) return true;
+      if (size <= start) return false;
+      if (size <= end) end = size - 1;
+
+      offset = start;
+      length = end - start + 1;
+
+    } catch (const Exception &e) {}
+
+    return true;
+  }
+
+
+  class PrepareUploadsTask : public Task {
+    Transaction &tx; // Only used by complete(), see Transaction::submit()
+    uploads_t uploads;
+    Storage &storage;
+    string sql;
+    JSON::ValuePtr args;
+    bool batch;
+
+  public:
+    PrepareUploadsTask(Transaction &tx, const uploads_t &uploads,
+                       const string &sql, const JSON::ValuePtr &args,
+                       bool batch) :
+      tx(tx), uploads(uploads), storage(tx.getApp().getStorage()), sql(sql),
+      args(args), batch(batch) {}
+
+    // From Task
+    void run() {
+      for (unsigned i = 0; i < uploads.size(); i++)
+        storage.prepareUpload(uploads[i]);
+    }
+
+    void complete() {
+      tx.taskCompleted();
+
+      if (failed())
+        return tx.sendError(HTTP_INTERNAL_SERVER_ERROR, getError());
+
+      try {
+        tx.uploadsPrepared(uploads, sql, args, batch);
+      } catch (const Exception &e) {
+        tx.sendError(HTTP_INTERNAL_SERVER_ERROR, e.getMessage());
+      }
+    }
+  };
+}
+
+
+Transaction::Transaction(Worker &worker, Arena &arena, evhttp_request *req) :
+  Request(req), Event::OAuth2Login(worker.getEventClient()), worker(worker),
+  app(worker.getApp()), arena(arena), jsonFields(0), thingGeneration(0),
+  changedThing(0), task(0), responder(0), outgoing(0), orphaned(false),
+  outgoingMember(0),
+  tracing(app.getTracer().isEnabled()), traceStatus(0),
+  dbSpan(Trace::MAX_SPANS), rowsSpan(Trace::MAX_SPANS), queryMember(0) {
   LOG_DEBUG(5, "Transaction()");
+
+  if (tracing) {
+    if (inHas("traceparent")) trace.setParent(inGet("traceparent"));
+    else if (inHas("X-Trace-ID")) trace.setID(inGet("X-Trace-ID"));
+    trace.begin("route");
+  }
 }
 
 
 Transaction::~Transaction() {
   LOG_DEBUG(5, "~Transaction()");
+
+  // Changes made by this user are now visible
+  if (!user.isNull() && getMethod() != HTTP_GET) user->invalidateAuthCache();
+
+  if (task) task->cancel();
+  if (!thumbnailSize.empty()) worker.getThumbnailer().cancel(*this);
+  if (!db.isNull()) worker.releaseDBConnection();
+  worker.getWriteFlusher().cancel(*this);
+
+  if (tracing)
+    try {
+      trace.finish();
+      app.getTracer().submit(trace, getMethod().toString(),
+                             getURI().getPath(), arena.getRoute(),
+                             traceStatus);
+    } CATCH_ERROR;
+}
+
+
+void *Transaction::operator new(size_t size, Arena &arena) {
+  // The Arena is stored just before the object
+  char *ptr = (char *)arena.allocate(arenaHeader + size);
+  *(Arena **)ptr = &arena;
+  return ptr + arenaHeader;
+}
+
+
+void Transaction::operator delete(void *ptr) {
+  if (!ptr) return;
+
+  // Everything else in the arena died with the Transaction
+  Arena *arena = *(Arena **)((char *)ptr - arenaHeader);
+  arena->getPool().release(arena);
+}
+
+
+void Transaction::operator delete(void *ptr, Arena &arena) {
+  arena.getPool().release(&arena); // The constructor threw
+}
+
+
+void Transaction::setRoute(const char *route) {
+  arena.setRoute(route);
+  if (tracing) trace.end("route");
 }
 
 
@@ -93,7 +287,9 @@ bool Transaction::lookupUser(bool skipAuthCheck) {
   }
 
   // Get user
-  user = app.getUserManager().get(session);
+  unsigned span = tracing ? trace.begin("user") : Trace::MAX_SPANS;
+  user = worker.getUserManager().get(session);
+  trace.end(span);
 
   // Check if we have a user and it's not expired
   if (user.isNull() || user->hasExpired()) {
@@ -102,9 +298,9 @@ bool Transaction::lookupUser(bool skipAuthCheck) {
     return false;
   }
 
-  // Check if the user auth is expiring soon
-  if (user->isExpiring()) {
-    app.getUserManager().updateSession(user);
+  // Check if the user auth is expiring soon or needs a new session format
+  if (user->isExpiring() || user->isOutdated()) {
+    worker.getUserManager().updateSession(user);
     setAuthCookie();
   }
 
@@ -136,6 +332,7 @@ void Transaction::authorize(unsigned flags) {
   lookupUser();
 
   if (user.isNull() || !user->isAuthenticated()) pleaseLogin();
+  if (getMethod() != HTTP_GET) user->invalidateAuthCache();
   if (user->getAuth() && AuthFlags::AUTH_ADMIN) return;
   if ((user->getAuth() & flags) != flags)
     THROWX("Not authorized", HTTP_UNAUTHORIZED);
@@ -179,8 +376,183 @@ bool Transaction::hasTag(const string &tag) const {
 
 void Transaction::query(event_db_member_functor_t member, const string &s,
                         const SmartPointer<JSON::Value> &dict) {
-  if (db.isNull()) db = app.getDBConnection();
-  db->query(this, member, s, dict);
+  connectDB();
+  db->query(this, traceQuery(member), s, dict);
+}
+
+
+void Transaction::query(event_db_member_functor_t member,
+                        const SQLLiteral &sql,
+                        const SmartPointer<JSON::Value> &dict) {
+  if (dict.isNull()) return query(member, string(sql.get()));
+
+  connectDB();
+  db->query(this, traceQuery(member),
+            worker.getSQLTemplates().render(sql, *dict));
+}
+
+
+void Transaction::connectDB() {
+  if (!db.isNull()) return;
+
+  unsigned span = tracing ? trace.begin("db_connection") : Trace::MAX_SPANS;
+  db = worker.getDBConnection();
+  trace.end(span);
+}
+
+
+Transaction::event_db_member_functor_t
+Transaction::traceQuery(event_db_member_functor_t member) {
+  if (!tracing) return member;
+
+  queryMember = member;
+  dbSpan = trace.begin("db");
+  rowsSpan = Trace::MAX_SPANS;
+
+  return &Transaction::queryTraced;
+}
+
+
+void Transaction::traceReply(int code) {
+  if (!tracing) return;
+
+  traceStatus = code;
+  if (!trace.hasID()) trace.setID(app.getTracer().newID());
+  outSet("X-Trace-ID", trace.getID());
+  trace.begin("write");
+}
+
+
+void Transaction::sendFile(const string &path, const string &type,
+                           const string &hash, unsigned maxAge) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) THROWX("File not found", HTTP_NOT_FOUND);
+
+  struct stat st;
+  if (fstat(fd, &st)) {
+    close(fd);
+    THROWS("Failed to stat '" << path << "': " << SysError());
+  }
+
+  uint64_t size = st.st_size;
+  string etag = "\"" + hash + "\"";
+
+  outSet("ETag", etag);
+  outSet("Last-Modified", Time(st.st_mtime).toString(httpDateFormat));
+  outSet("Accept-Ranges", "bytes");
+  setCache(maxAge);
+
+  if (notModified(etag, st.st_mtime)) {
+    close(fd);
+    traceReply(HTTP_NOT_MODIFIED);
+    Request::reply(HTTP_NOT_MODIFIED);
+    replied();
+    return;
+  }
+
+  // Range
+  uint64_t offset = 0;
+  uint64_t length = size;
+  int code = HTTP_OK;
+
+  if (inHas("Range") && (!inHas("If-Range") || inGet("If-Range") == etag)) {
+    if (!parseRange(inGet("Range"), size, offset, length)) {
+      close(fd);
+      outSet("Content-Range", "bytes */" + String(size));
+      traceReply(HTTP_REQUESTED_RANGE_NOT_SATISFIABLE);
+      Request::reply(HTTP_REQUESTED_RANGE_NOT_SATISFIABLE);
+      replied();
+      return;
+    }
+
+    if (length != size) {
+      code = HTTP_PARTIAL_CONTENT;
+      outSet("Content-Range", "bytes " + String(offset) + "-" +
+             String(offset + length - 1) + "/" + String(size));
+    }
+  }
+
+  if (type.find('/') != string::npos) setContentType(type);
+
+  // Zero copy, libevent sends file segments with sendfile() and closes fd
+  if (!length) close(fd);
+  else if (evbuffer_add_file(getOutputBuffer().getBuffer(), fd, offset,
+                             length)) {
+    close(fd);
+    THROWS("Failed to send '" << path << "'");
+  }
+
+  traceReply(code);
+  Request::reply(code);
+  replied();
+}
+
+
+bool Transaction::notModified(const string &etag, uint64_t modified) {
+  if (inHas("If-None-Match")) {
+    string match = inGet("If-None-Match");
+    return match == "*" || match.find(etag) != string::npos;
+  }
+
+  if (inHas("If-Modified-Since"))
+    try {
+      return modified <= Time::parse(inGet("If-Modified-Since"),
+                                     httpDateFormat);
+    } catch (const Exception &e) {} // Ignore invalid dates
+
+  return false;
+}
+
+
+void Transaction::thingChanged(const JSON::Value &args, unsigned sections) {
+  changedThingKey =
+    ThingCache::getKey(args.getString("profile"), args.getString("thing"));
+  changedThing |= sections;
+}
+
+
+void Transaction::invalidateThing() {
+  // After the write so that concurrent reads cannot cache the old state
+  if (changedThing) app.getThingCache().invalidate(changedThingKey,
+                                                   changedThing);
+  changedThing = 0;
+}
+
+
+bool Transaction::queueWrite(unsigned type, const JSON::Value &args,
+                             bool on) {
+  string thing = type == WriteQueue::STAR ? args.getString("thing") : "";
+
+  app.getWriteQueue().add(WriteQueue::Write(type, user->getName(),
+                                            args.getString("profile"), thing,
+                                            on));
+
+  getJSONWriter()->write("ok");
+  setContentType("application/json");
+  reply();
+
+  return true;
+}
+
+
+void Transaction::writesFlushed(bool success) {
+  // The writes were queued again, do not retry in a loop
+  if (!success)
+    return sendError(HTTP_SERVICE_UNAVAILABLE,
+                     "Failed to save changes, please retry");
+
+  // Cached auth data may include the user's follows
+  user->invalidateAuthCache();
+
+  try {
+    // Flush again in case there are more writes, then skip to the routes
+    if (!worker.getWriteFlusher().flush(*this, user->getName()) &&
+        !worker.getServer().dispatchRoutes(*this)) apiNotFound();
+
+  } catch (const Exception &e) {
+    sendError(e.getCode() ? e.getCode() : HTTP_INTERNAL_SERVER_ERROR,
+              e.getMessage());
+  }
 }
 
 
@@ -190,48 +562,186 @@ bool Transaction::pleaseLogin() {
 }
 
 
-string Transaction::postFile(const std::string &path, const string &file,
-                             const string &type, uint32_t minSize,
-                             uint32_t maxSize) {
+void Transaction::submit(Task *task) {
+  this->task = task;
+  worker.submit(task);
+}
+
+
+Upload Transaction::newUpload(const string &path, const string &file) {
+  Upload upload;
+  upload.file = file;
+
   // Create GUID
   Digest hash("sha256");
   hash.update(path);
   hash.update(file);
   hash.updateWith(Timer::now());
-  string guid = hash.toBase64();
+  upload.guid = hash.toBase64();
 
   // Create key
-  string key = guid + "/" + file;
+  upload.key = upload.guid + "/" + file;
+  upload.path = "/" + URI::encode(upload.key);
+  upload.fileURL = path + "/" + file;
+
+  return upload;
+}
+
+
+Upload Transaction::createUpload(const string &path, const string &file,
+                                 const string &type, uint32_t minSize,
+                                 uint32_t maxSize) {
+  uint64_t limit = app.getStorage().getMaxUploadSize();
+  if (limit && limit < maxSize)
+    THROWXS("File larger than " << limit << " bytes",
+            HTTP_REQUEST_ENTITY_TOO_LARGE);
 
-  // Create URLs
-  string uploadURL = "https://" + app.getAWSBucket() + ".s3.amazonaws.com/";
-  string fileURL = path + "/" + file;
+  Upload upload = newUpload(path, file);
 
-  // Build POST
-  AWS4Post post(app.getAWSBucket(), key, app.getAWSUploadExpires(),
-                Time::now(), "s3", app.getAWSRegion());
+  upload.type = type;
+  upload.minSize = minSize;
+  upload.maxSize = maxSize;
+
+  return upload;
+}
+
+
+void Transaction::postFile(const string &path, const string &file,
+                           const string &type, uint32_t minSize,
+                           uint32_t maxSize, const JSON::ValuePtr &args,
+                           const string &urlField, const string &sql) {
+  uploads_t uploads;
+  uploads.push_back(createUpload(path, file, type, minSize, maxSize));
+  args->insert(urlField, uploads[0].path);
+
+  // Prepare off the event loop, S3 policies are signed
+  submit(new PrepareUploadsTask(*this, uploads, sql, args, false));
+}
 
-  post.setLengthRange(minSize, maxSize);
-  post.insert("Content-Type", type);
-  post.insert("acl", "public-read");
-  post.insert("success_action_status", "201");
-  post.addCondition("name", file);
-  post.sign(app.getAWSID(), app.getAWSSecret());
 
+void Transaction::uploadsPrepared(const uploads_t &uploads, const string &sql,
+                                  const JSON::ValuePtr &args, bool batch) {
   // Write JSON
   setContentType("application/json");
   writer = getJSONWriter();
-  writer->beginDict();
-  writer->insert("upload_url", uploadURL);
-  writer->insert("file_url", URI::encode(fileURL));
-  writer->insert("guid", guid);
-  writer->beginInsert("post");
-  post.write(*writer);
-  writer->endDict();
+  if (batch) writer->beginList();
+
+  for (unsigned i = 0; i < uploads.size(); i++) {
+    if (batch) writer->appendDict();
+    else writer->beginDict();
+
+    writer->insert("upload_url", uploads[i].uploadURL);
+    if (uploads[i].method != "POST")
+      writer->insert("method", uploads[i].method);
+    writer->insert("file_url", URI::encode(uploads[i].fileURL));
+    writer->insert("guid", uploads[i].guid);
+    if (!uploads[i].form.isNull()) {
+      writer->beginInsert("post");
+      uploads[i].form->write(*writer);
+    }
+    writer->endDict();
+  }
+
+  if (batch) writer->endList();
   writer.release();
 
-  // Return URL
-  return "/" + URI::encode(key);
+  // Write to DB
+  query(&Transaction::returnReply, sql, args);
+}
+
+
+void Transaction::checkUploadFile(const string &file, const string &type) {
+  // Restrict by extension
+  string ext = String::toLower(SystemUtilities::extension(file));
+  if (ext == "exe" || ext == "com" || ext == "bat" || ext == "lnk" ||
+      ext == "chm" || ext == "hta")
+    THROWXS("Uploading ." << ext << " files is not allowed.",
+            HTTP_UNAUTHORIZED);
+
+  // Restrict by media-type
+  if (type == "application/x-msdownload" ||
+      type == "application/x-msdos-program" ||
+      type == "application/x-msdos-windows" ||
+      type == "application/x-download" ||
+      type == "application/bat" ||
+      type == "application/x-bat" ||
+      type == "application/com" ||
+      type == "application/x-com" ||
+      type == "application/exe" ||
+      type == "application/x-exe" ||
+      type == "application/x-winexe" ||
+      type == "application/x-winhlp" ||
+      type == "application/x-winhelp" ||
+      type == "application/x-javascript" ||
+      type == "application/hta" ||
+      type == "application/x-ms-shortcut" ||
+      type == "application/octet-stream" ||
+      type == "vms/exe")
+    THROWXS("Uploading files of type " << type << " not allowed.",
+            HTTP_UNAUTHORIZED);
+}
+
+
+const char *Transaction::getUploadACL() const {
+  return app.getAWSPrivate() ? "private" : "public-read";
+}
+
+
+void Transaction::callS3(HTTP::RequestMethod method, const string &body,
+                         http_member_functor_t member) {
+  AWS4PresignedURL url = app.getS3URL(uploadPath, method, s3RequestExpires);
+  url.set("uploadId", pendingArgs->getString("upload_id"));
+  app.signS3URL(url);
+
+  unsigned eventMethod =
+    method == HTTP::RequestMethod::HTTP_DELETE ? HTTP_DELETE : HTTP_POST;
+
+  call(url, eventMethod, body, member);
+}
+
+
+void Transaction::call(const URI &url, unsigned method, const string &body,
+                       http_member_functor_t member, const string &type) {
+  pending = worker.getEventClient()
+    .callMember(url, method, body.data(), body.length(), this,
+                &Transaction::outgoingReturned);
+  if (!type.empty()) pending->outSet("Content-Type", type);
+  pending->send();
+
+  outgoingMember = member;
+  outgoing++;
+}
+
+
+bool Transaction::outgoingReturned(Event::Request &req) {
+  if (!outgoingDone()) return true;
+  return (this->*outgoingMember)(req);
+}
+
+
+bool Transaction::outgoingDone() {
+  if (outgoing) outgoing--;
+  if (!orphaned) return true;
+
+  // Freed from the event loop, the caller may still touch its members
+  if (!outgoing) worker.retire(responder);
+
+  return false;
+}
+
+
+string Transaction::getS3Error(Event::Request &req) {
+  int code = req.getResponseCode();
+  string body = req.getInput();
+
+  // CompleteMultipartUpload can fail after responding 200
+  if (200 <= code && code < 300 && body.find("<Error>") == string::npos)
+    return "";
+
+  string message = xmlTag(body, "Message");
+  if (message.empty()) message = String(code);
+
+  return "S3 error: " + message;
 }
 
 
@@ -248,7 +758,61 @@ void Transaction::sendError(int code, const std::string &message) {
 }
 
 
+void Transaction::reply(int code) {
+  uint32_t minSize = app.getCompressionMinSize();
+  evbuffer *output = getOutputBuffer().getBuffer();
+  unsigned length = evbuffer_get_length(output);
+
+  // Compress large dynamic responses
+  if (code == HTTP_OK && minSize && minSize <= length &&
+      inHas("Accept-Encoding") && !outHas("Content-Encoding") &&
+      outHas("Content-Type") &&
+      Compressor::isCompressible(outGet("Content-Type"))) {
+    const char *encoding = Compressor::negotiate(inGet("Accept-Encoding"));
+
+    if (encoding) {
+      const char *data = (const char *)evbuffer_pullup(output, -1);
+      const string &compressed =
+        worker.getCompressor().compress(encoding, data, length);
+
+      if (compressed.length() < length) {
+        evbuffer_drain(output, length);
+        evbuffer_add(output, compressed.data(), compressed.length());
+        outSet("Content-Encoding", encoding);
+      }
+    }
+
+    outSet("Vary", "Accept-Encoding");
+  }
+
+  traceReply(code);
+  Request::reply(code);
+  replied();
+}
+
+
+void Transaction::redirect(const URI &uri, int code) {
+  traceReply(code);
+  Request::redirect(uri, code);
+  replied();
+}
+
+
+void Transaction::replied() {
+  if (responder) responder->replied();
+}
+
+
+bool Transaction::orphan() {
+  if (!outgoing) return false;
+  orphaned = true;
+  return true;
+}
+
+
 void Transaction::processProfile(const SmartPointer<JSON::Value> &profile) {
+  if (!outgoingDone()) return;
+
   if (!profile.isNull())
     try {
       // Authenticate user
@@ -268,8 +832,7 @@ void Transaction::processProfile(const SmartPointer<JSON::Value> &profile) {
 
       LOG_DEBUG(3, "Profile: " << *profile);
 
-      query(&Transaction::login, "CALL Login(%(provider)s, %(id)s, %(name)s, "
-            "%(email)s, %(avatar)s);", profile);
+      query(&Transaction::login, SQL::login, profile);
 
       return;
     } CATCH_ERROR;
@@ -281,12 +844,20 @@ void Transaction::processProfile(const SmartPointer<JSON::Value> &profile) {
 bool Transaction::apiAuthUser() {
   authorize();
 
+  const string *cached = user->getAuthCache();
+  if (cached) {
+    setContentType("application/json");
+    send(*cached);
+    reply();
+    return true;
+  }
+
   SmartPointer<JSON::Dict> dict = new JSON::Dict;
   dict->insert("provider", user->getProvider());
   dict->insert("id", user->getID());
 
   jsonFields = "*profile things followers following starred badges events auth";
-  query(&Transaction::authUser, "CALL GetUser(%(provider)s, %(id)s)", dict);
+  query(&Transaction::authUser, SQL::getUser, dict);
 
   return true;
 }
@@ -298,7 +869,7 @@ bool Transaction::apiAuthLogin() {
   // Get user
   lookupUser(true);
 
-  if (user.isNull()) user = app.getUserManager().create();
+  if (user.isNull()) user = worker.getUserManager().create();
   if (user->isAuthenticated()) {
     redirect("/");
     return true;
@@ -317,7 +888,17 @@ bool Transaction::apiAuthLogin() {
   else if (String::endsWith(path, "/facebook")) auth = &app.getFacebookAuth();
   else THROWC("Unsupported login provider", HTTP_BAD_REQUEST);
 
-  return OAuth2Login::authorize(*this, *auth, user->getToken());
+  // The callback leg calls the provider and ends in processProfile()
+  bool calling = uri.has("state");
+  if (calling) outgoing++;
+
+  try {
+    return OAuth2Login::authorize(*this, *auth, user->getToken());
+
+  } catch (...) {
+    if (calling && outgoing) outgoing--;
+    throw;
+  }
 }
 
 
@@ -330,23 +911,86 @@ bool Transaction::apiAuthLogout() {
 }
 
 
+bool Transaction::apiRateLimit() {
+  RateLimiter &limiter = app.getRateLimiter();
+  const string &path = getURI().getPath();
+
+  unsigned cls = RateLimiter::READ;
+  if (getMethod() != HTTP_GET) cls = RateLimiter::WRITE;
+  else if (path == "/api/things" || path == "/api/profiles" ||
+           path == "/api/suggest" || String::startsWith(path, "/api/tags/"))
+    cls = RateLimiter::SEARCH;
+
+  if (!limiter.isEnabled(cls)) return false;
+
+  unsigned retry = limiter.check(cls, getViewID());
+  if (!retry) return false;
+
+  outSet("Retry-After", String(retry));
+  sendError(tooManyRequests, "Too many requests, please slow down");
+
+  return true;
+}
+
+
+bool Transaction::apiFlushWrites() {
+  if (!app.getWriteQueue().isEnabled() || !lookupUser()) return false;
+
+  // Flush this user's writes before serving their request
+  return worker.getWriteFlusher().flush(*this, user->getName());
+}
+
+
 bool Transaction::apiGetInfo() {
   jsonFields = "permissions licenses";
-  query(&Transaction::returnJSONFields, "CALL GetInfo()");
+  query(&Transaction::returnJSONFields, SQL::getInfo);
   return true;
 }
 
 
 bool Transaction::apiGetPermissions() {
-  query(&Transaction::returnList, "CALL GetPermissions()");
+  query(&Transaction::returnList, SQL::getPermissions);
+  return true;
+}
+
+
+bool Transaction::apiGetStats() {
+  authorize(AuthFlags::AUTH_ADMIN);
+
+  setContentType("application/json");
+  writer = getJSONWriter();
+  writer->beginDict();
+  writer->beginInsert("worker");
+  worker.writeStats(*writer);
+  writer->beginInsert("tasks");
+  app.getTaskPool().writeStats(*writer);
+  writer->beginInsert("thumbnails");
+  app.getThumbnailCache().writeStats(*writer);
+  writer->beginInsert("things");
+  app.getThingCache().writeStats(*writer);
+  writer->beginInsert("write_queue");
+  app.getWriteQueue().writeStats(*writer);
+  writer->beginInsert("rate_limits");
+  app.getRateLimiter().writeStats(*writer);
+  writer->beginInsert("tracing");
+  app.getTracer().writeStats(*writer);
+
+  if (app.getSupervisor().isEnabled()) {
+    writer->beginInsert("processes");
+    app.getSupervisor().writeStats(*writer);
+  }
+
+  writer->endDict();
+  writer.release();
+
+  reply();
   return true;
 }
 
 
 bool Transaction::apiGetProfiles() {
   JSON::ValuePtr args = parseArgsPtr();
-  query(&Transaction::returnList,
-        "CALL FindProfiles(%(query)s, %(limit)u, %(offset)u)", args);
+  query(&Transaction::returnList, SQL::findProfiles, args);
   return true;
 }
 
@@ -360,15 +1004,13 @@ bool Transaction::apiProfileRegister() {
   dict->insert("provider", user->getProvider());
   dict->insert("id", user->getID());
 
-  query(&Transaction::registration,
-        "CALL Register(%(profile)s, %(provider)s, %(id)s)", dict);
+  query(&Transaction::registration, SQL::registerProfile, dict);
   return true;
 }
 
 
 bool Transaction::apiProfileAvailable() {
-  query(&Transaction::returnBool, "CALL Available(%(profile)s)",
-        parseArgsPtr());
+  query(&Transaction::returnBool, SQL::available, parseArgsPtr());
   return true;
 }
 
@@ -381,8 +1023,7 @@ bool Transaction::apiProfileSuggest() {
   dict->insert("provider", user->getProvider());
   dict->insert("id", user->getID());
 
-  query(&Transaction::returnList, "CALL Suggest(%(provider)s, %(id)s, 5)",
-        dict);
+  query(&Transaction::returnList, SQL::suggest, dict);
 
   return true;
 }
@@ -392,9 +1033,7 @@ bool Transaction::apiPutProfile() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL PutProfile(%(profile)s, %(fullname)s, %(location)s, %(url)s, "
-        "%(bio)s)", args);
+  query(&Transaction::returnOK, SQL::putProfile, args);
 
   return true;
 }
@@ -403,8 +1042,7 @@ bool Transaction::apiPutProfile() {
 bool Transaction::apiGetProfile() {
   jsonFields = "*profile things followers following starred badges events";
 
-  query(&Transaction::returnJSONFields, "CALL GetProfile(%(profile)s)",
-        parseArgsPtr());
+  query(&Transaction::returnJSONFields, SQL::getProfile, parseArgsPtr());
 
   return true;
 }
@@ -412,7 +1050,7 @@ bool Transaction::apiGetProfile() {
 
 bool Transaction::apiGetProfileAvatar() {
   JSON::ValuePtr args = parseArgsPtr();
-  query(&Transaction::download, "CALL GetProfileAvatar(%(profile)s)", args);
+  query(&Transaction::download, SQL::getProfileAvatar, args);
   return true;
 }
 
@@ -429,13 +1067,9 @@ bool Transaction::apiPutProfileAvatar() {
   // Limit size
   if (5 * 1024 * 1024 < size) THROW("Avatar cannot be larger than 5MiB");
 
-  // Write post data
-  string url = postFile(path, file, type, size, size);
-
-  // Write to DB
-  args->insert("url", url);
-  query(&Transaction::returnReply,
-        "CALL PutProfileAvatar(%(profile)s, %(url)s)", args);
+  // Write post data and then write to DB
+  postFile(path, file, type, size, size, args, "url",
+           "CALL PutProfileAvatar(%(profile)s, %(url)s)");
 
   return true;
 }
@@ -451,8 +1085,7 @@ bool Transaction::apiConfirmProfileAvatar() {
 
   // Write to DB
   args->insert("url", "/" + guid + "/" + URI::encode(file));
-  query(&Transaction::returnOK,
-        "CALL ConfirmProfileAvatar(%(profile)s, %(url)s)", args);
+  query(&Transaction::returnOK, SQL::confirmProfileAvatar, args);
 
   return true;
 }
@@ -463,7 +1096,10 @@ bool Transaction::apiFollow() {
   authorize();
   args->insert("user", user->getName());
 
-  query(&Transaction::returnOK, "CALL Follow(%(user)s, %(profile)s)", args);
+  if (app.getWriteQueue().isEnabled())
+    return queueWrite(WriteQueue::FOLLOW, *args, true);
+
+  query(&Transaction::returnOK, SQL::follow, args);
 
   return true;
 }
@@ -474,7 +1110,10 @@ bool Transaction::apiUnfollow() {
   authorize();
   args->insert("user", user->getName());
 
-  query(&Transaction::returnOK, "CALL Unfollow(%(user)s, %(profile)s)", args);
+  if (app.getWriteQueue().isEnabled())
+    return queueWrite(WriteQueue::FOLLOW, *args, false);
+
+  query(&Transaction::returnOK, SQL::unfollow, args);
 
   return true;
 }
@@ -483,15 +1122,13 @@ bool Transaction::apiUnfollow() {
 bool Transaction::apiGetThings() {
   JSON::ValuePtr args = parseArgsPtr();
 
-  query(&Transaction::returnList,
-        "CALL FindThings(%(query)s, %(license)s, %(limit)u, %(offset)u)", args);
+  query(&Transaction::returnList, SQL::findThings, args);
   return true;
 }
 
 
 bool Transaction::apiThingAvailable() {
-  query(&Transaction::returnBool, "CALL ThingAvailable(%(profile)s, %(thing)s)",
-        parseArgsPtr());
+  query(&Transaction::returnBool, SQL::thingAvailable, parseArgsPtr());
   return true;
 }
 
@@ -501,10 +1138,28 @@ bool Transaction::apiGetThing() {
 
   args->insert("view_id", getViewID());
 
-  jsonFields = "*thing files comments stars";
+  string profile = args->getString("profile");
+  string thing = args->getString("thing");
+  ThingCache &cache = app.getThingCache();
+
+  if (cache.isEnabled()) {
+    thingKey = ThingCache::getKey(profile, thing);
+
+    string json;
+    if (cache.get(thingKey, json)) {
+      cache.addView(profile, thing, args->getString("view_id"));
 
-  query(&Transaction::returnJSONFields,
-        "CALL GetThing(%(profile)s, %(thing)s, %(view_id)s)", args);
+      setContentType("application/json");
+      send(json);
+      reply();
+
+      return true;
+    }
+
+    thingGeneration = cache.getGeneration();
+  }
+
+  query(&Transaction::thingLoaded, SQL::getThing, args);
 
   return true;
 }
@@ -514,8 +1169,9 @@ bool Transaction::apiPublishThing() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL PublishThing(%(profile)s, %(thing)s)", args);
+  thingChanged(*args, ThingCache::THING);
+
+  query(&Transaction::returnOK, SQL::publishThing, args);
 
   return true;
 }
@@ -527,9 +1183,9 @@ bool Transaction::apiPutThing() {
 
   if (!args->hasString("type")) args->insert("type", "project");
 
-  query(&Transaction::returnOK,
-        "CALL PutThing(%(profile)s, %(thing)s, %(type)s, %(title)s, "
-        "%(license)s, %(instructions)s)", args);
+  thingChanged(*args, ThingCache::THING);
+
+  query(&Transaction::returnOK, SQL::putThing, args);
 
   return true;
 }
@@ -539,8 +1195,9 @@ bool Transaction::apiRenameThing() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL RenameThing(%(profile)s, %(thing)s, %(name)s)", args);
+  thingChanged(*args, ThingCache::ALL);
+
+  query(&Transaction::returnOK, SQL::renameThing, args);
 
   return true;
 }
@@ -550,8 +1207,9 @@ bool Transaction::apiDeleteThing() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK, "CALL DeleteThing(%(profile)s, %(thing)s)",
-        args);
+  thingChanged(*args, ThingCache::ALL);
+
+  query(&Transaction::returnOK, SQL::deleteThing, args);
 
   return true;
 }
@@ -562,8 +1220,12 @@ bool Transaction::apiStarThing() {
   authorize();
   args->insert("user", user->getName());
 
-  query(&Transaction::returnOK,
-        "CALL StarThing(%(user)s, %(profile)s, %(thing)s)", args);
+  if (app.getWriteQueue().isEnabled())
+    return queueWrite(WriteQueue::STAR, *args, true);
+
+  thingChanged(*args, ThingCache::THING | ThingCache::STARS);
+
+  query(&Transaction::returnOK, SQL::starThing, args);
 
   return true;
 }
@@ -574,8 +1236,12 @@ bool Transaction::apiUnstarThing() {
   authorize();
   args->insert("user", user->getName());
 
-  query(&Transaction::returnOK,
-        "CALL UnstarThing(%(user)s, %(profile)s, %(thing)s)", args);
+  if (app.getWriteQueue().isEnabled())
+    return queueWrite(WriteQueue::STAR, *args, false);
+
+  thingChanged(*args, ThingCache::THING | ThingCache::STARS);
+
+  query(&Transaction::returnOK, SQL::unstarThing, args);
 
   return true;
 }
@@ -585,8 +1251,9 @@ bool Transaction::apiTagThing() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(hasTag("featured") ? AuthFlags::AUTH_ADMIN : AuthFlags::AUTH_NONE);
 
-  query(&Transaction::returnOK,
-        "CALL MultiTagThing(%(profile)s, %(thing)s, %(tags)s)", args);
+  thingChanged(*args, ThingCache::THING);
+
+  query(&Transaction::returnOK, SQL::multiTagThing, args);
 
   return true;
 }
@@ -597,8 +1264,9 @@ bool Transaction::apiUntagThing() {
   authorize(hasTag("featured") ? AuthFlags::AUTH_ADMIN : AuthFlags::AUTH_NONE,
             args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL MultiUntagThing(%(profile)s, %(thing)s, %(tags)s)", args);
+  thingChanged(*args, ThingCache::THING);
+
+  query(&Transaction::returnOK, SQL::multiUntagThing, args);
 
   return true;
 }
@@ -618,9 +1286,9 @@ bool Transaction::apiPostComment() {
   JSON::ValuePtr args = parseArgsPtr();
   commentAuth();
 
-  query(&Transaction::returnU64,
-        "CALL PostComment(%(owner)s, %(profile)s, %(thing)s, %(parent)u, "
-        "%(text)s)", args);
+  thingChanged(*args, ThingCache::THING | ThingCache::COMMENTS);
+
+  query(&Transaction::returnU64, SQL::postComment, args);
 
   return true;
 }
@@ -630,8 +1298,9 @@ bool Transaction::apiUpdateComment() {
   JSON::ValuePtr args = parseArgsPtr();
   commentAuth();
 
-  query(&Transaction::returnOK,
-        "CALL UpdateComment(%(owner)s, %(comment)u, %(text)s)", args);
+  thingChanged(*args, ThingCache::COMMENTS);
+
+  query(&Transaction::returnOK, SQL::updateComment, args);
 
   return true;
 }
@@ -642,8 +1311,9 @@ bool Transaction::apiDeleteComment() {
   if (!args->hasString("owner")) args->insert("owner", getUser().getName());
   authorize(args->getString("owner"));
 
-  query(&Transaction::returnOK, "CALL DeleteComment(%(owner)s, %(comment)u)",
-        args);
+  thingChanged(*args, ThingCache::THING | ThingCache::COMMENTS);
+
+  query(&Transaction::returnOK, SQL::deleteComment, args);
 
   return true;
 }
@@ -653,8 +1323,9 @@ bool Transaction::apiUpvoteComment() {
   JSON::ValuePtr args = parseArgsPtr();
   commentAuth();
 
-  query(&Transaction::returnJSON, "CALL UpvoteComment(%(owner)s, %(comment)u)",
-        args);
+  thingChanged(*args, ThingCache::COMMENTS);
+
+  query(&Transaction::returnJSON, SQL::upvoteComment, args);
 
   return true;
 }
@@ -664,8 +1335,9 @@ bool Transaction::apiDownvoteComment() {
   JSON::ValuePtr args = parseArgsPtr();
   commentAuth();
 
-  query(&Transaction::returnJSON,
-        "CALL DownvoteComment(%(owner)s, %(comment)u)", args);
+  thingChanged(*args, ThingCache::COMMENTS);
+
+  query(&Transaction::returnJSON, SQL::downvoteComment, args);
 
   return true;
 }
@@ -674,8 +1346,7 @@ bool Transaction::apiDownvoteComment() {
 bool Transaction::apiDownloadFile() {
   JSON::ValuePtr args = parseArgsPtr();
 
-  query(&Transaction::download,
-        "CALL DownloadFile(%(profile)s, %(thing)s, %(file)s, %(count)b)", args);
+  query(&Transaction::download, SQL::downloadFile, args);
 
   return true;
 }
@@ -685,62 +1356,186 @@ bool Transaction::apiUploadFile() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  // Restrict by extension
   string file = args->getString("file");
-  string ext = String::toLower(SystemUtilities::extension(file));
-  if (ext == "exe" || ext == "com" || ext == "bat" || ext == "lnk" ||
-      ext == "chm" || ext == "hta")
-    THROWXS("Uploading ." << ext << " files is not allowed.",
-            HTTP_UNAUTHORIZED);
-
-  // Restrict by media-type
   string type = args->getString("type");
-  if (type == "application/x-msdownload" ||
-      type == "application/x-msdos-program" ||
-      type == "application/x-msdos-windows" ||
-      type == "application/x-download" ||
-      type == "application/bat" ||
-      type == "application/x-bat" ||
-      type == "application/com" ||
-      type == "application/x-com" ||
-      type == "application/exe" ||
-      type == "application/x-exe" ||
-      type == "application/x-winexe" ||
-      type == "application/x-winhlp" ||
-      type == "application/x-winhelp" ||
-      type == "application/x-javascript" ||
-      type == "application/hta" ||
-      type == "application/x-ms-shortcut" ||
-      type == "application/octet-stream" ||
-      type == "vms/exe")
-    THROWXS("Uploading files of type " << type << " not allowed.",
-            HTTP_UNAUTHORIZED);
+  checkUploadFile(file, type);
 
-    // Compute path
+  // Compute path
   string path =
     "/" + args->getString("profile") + "/" + args->getString("thing");
   uint32_t size = args->getU32("size");
 
-  // Write post data
-  path = postFile(path, file, type, size, size);
-  args->insert("path", path);
+  thingChanged(*args, ThingCache::FILES);
+
+  // Write post data and then write to DB
+  postFile(path, file, type, size, size, args, "path",
+           "CALL UploadFile(%(profile)s, %(thing)s, %(file)s, %(type)s, "
+           "%(size)u, %(path)s, %(caption)s, %(visibility)s)");
+
+  return true;
+}
+
+
+bool Transaction::apiUploadFiles() {
+  JSON::ValuePtr args = parseArgsPtr();
+  authorize(args->getString("profile"));
+
+  const JSON::Value &files = *args->get("files");
+  if (!files.size()) THROW("No files");
+  if (maxBatchUploads < files.size())
+    THROWS("Cannot upload more than " << maxBatchUploads << " files at once");
+
+  // Validate all before signing any
+  for (unsigned i = 0; i < files.size(); i++)
+    checkUploadFile(files.get(i)->getString("file"),
+                    files.get(i)->getString("type"));
+
+  string path =
+    "/" + args->getString("profile") + "/" + args->getString("thing");
+
+  // One multi-row INSERT, values escaped by the formatter.  Missing
+  // captions and visibilities format as NULL and leave existing ones.
+  string sql = "INSERT INTO files "
+    "(thing_id, name, type, space, path, caption, visibility) VALUES ";
+  uploads_t uploads;
+
+  for (unsigned i = 0; i < files.size(); i++) {
+    const JSON::Value &entry = *files.get(i);
+    string file = entry.getString("file");
+    string type = entry.getString("type");
+    uint32_t size = entry.getU32("size");
+    string n = String(i);
+
+    uploads.push_back(createUpload(path, file, type, size, size));
+
+    args->insert("file" + n, file);
+    args->insert("type" + n, type);
+    args->insert("size" + n, size);
+    args->insert("path" + n, uploads.back().path);
+    if (entry.hasString("caption"))
+      args->insert("caption" + n, entry.getString("caption"));
+    if (entry.hasString("visibility"))
+      args->insert("visibility" + n, entry.getString("visibility"));
+    else if (args->hasString("visibility"))
+      args->insert("visibility" + n, args->getString("visibility"));
+
+    if (i) sql += ", ";
+    sql += "(GetThingID(%(profile)s, %(thing)s), %(file" + n + ")s, "
+      "%(type" + n + ")s, %(size" + n + ")u, %(path" + n + ")s, "
+      "%(caption" + n + ")s, %(visibility" + n + ")s)";
+  }
+
+  sql += " ON DUPLICATE KEY UPDATE type = VALUES(type), "
+    "space = VALUES(space), path = VALUES(path), "
+    "caption = IFNULL(VALUES(caption), caption), "
+    "visibility = IFNULL(VALUES(visibility), visibility)";
+
+  thingChanged(*args, ThingCache::FILES);
+
+  // Prepare all in one task and then write to DB
+  submit(new PrepareUploadsTask(*this, uploads, sql, args, true));
+
+  return true;
+}
+
+
+bool Transaction::apiStartMultipart() {
+  if (!app.getStorage().hasMultipart())
+    THROWC("Multipart uploads not supported by " << app.getStorage().getName()
+           << " storage", HTTP_NOT_FOUND);
+
+  JSON::ValuePtr args = parseArgsPtr();
+  authorize(args->getString("profile"));
+
+  string file = args->getString("file");
+  string type = args->getString("type");
+  checkUploadFile(file, type);
+
+  uint64_t size = args->getU64("size");
+  if (size < app.getAWSPartSize())
+    THROWC("File too small for multipart upload", HTTP_BAD_REQUEST);
+  if (maxMultipartSize < size)
+    THROWC("File too large", HTTP_BAD_REQUEST);
+
+  string path =
+    "/" + args->getString("profile") + "/" + args->getString("thing");
+  Upload upload = newUpload(path, file);
+  args->insert("path", upload.path);
+  args->insert("file_url", URI::encode(upload.fileURL));
+  pendingArgs = args;
+  uploadPath = upload.path;
+
+  // Initiate in S3
+  AWS4PresignedURL url =
+    app.getS3URL(upload.path, HTTP::RequestMethod::HTTP_POST, s3RequestExpires);
+  url.set("uploads", "");
+  url.set("x-amz-acl", getUploadACL());
+  url.setSignedHeader("Content-Type", type);
+  app.signS3URL(url);
+
+  call(url, HTTP_POST, "", &Transaction::multipartStarted, type);
+
+  return true;
+}
+
+
+bool Transaction::apiGetMultipart() {
+  JSON::ValuePtr args = parseArgsPtr();
+  authorize(args->getString("profile"));
+
+  // Fresh part URLs to resume an upload
+  args->insert("file_url", URI::encode("/" + args->getString("profile") +
+                                       "/" + args->getString("thing") + "/" +
+                                       args->getString("file")));
+  pendingArgs = args;
+
+  query(&Transaction::multipartLookup, SQL::getMultipartUpload, args);
+
+  return true;
+}
+
+
+bool Transaction::apiCompleteMultipart() {
+  JSON::ValuePtr args = parseArgsPtr();
+  authorize(args->getString("profile"));
+
+  if (!args->get("parts")->size()) THROWC("No parts", HTTP_BAD_REQUEST);
+  pendingArgs = args;
+
+  thingChanged(*args, ThingCache::FILES);
+
+  query(&Transaction::multipartLookup, SQL::getMultipartUpload, args);
+
+  return true;
+}
+
+
+bool Transaction::apiAbortMultipart() {
+  JSON::ValuePtr args = parseArgsPtr();
+  authorize(args->getString("profile"));
+
+  pendingArgs = args;
 
-  query(&Transaction::returnReply,
-        "CALL UploadFile(%(profile)s, %(thing)s, %(file)s, %(type)s, %(size)u, "
-        "%(path)s, %(caption)s, %(visibility)s)", args);
+  query(&Transaction::multipartLookup, SQL::getMultipartUpload, args);
 
   return true;
 }
 
 
+bool Transaction::apiStoreUpload() {
+  app.getStorage().store(*this, getArgs().getString("token"));
+  return true;
+}
+
+
 bool Transaction::apiUpdateFile() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
+  thingChanged(*args, ThingCache::FILES);
+
   // Write to DB
-  query(&Transaction::returnOK,
-        "CALL UpdateFile(%(profile)s, %(thing)s, %(file)s, %(caption)s, "
-        "%(visibility)s, %(rename)s)", args);
+  query(&Transaction::returnOK, SQL::updateFile, args);
 
   return true;
 }
@@ -750,8 +1545,9 @@ bool Transaction::apiDeleteFile() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL DeleteFile(%(profile)s, %(thing)s, %(file)s)", args);
+  thingChanged(*args, ThingCache::FILES);
+
+  query(&Transaction::returnOK, SQL::deleteFile, args);
 
   return true;
 }
@@ -761,8 +1557,9 @@ bool Transaction::apiConfirmFile() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL ConfirmFile(%(profile)s, %(thing)s, %(file)s)", args);
+  thingChanged(*args, ThingCache::FILES);
+
+  query(&Transaction::returnOK, SQL::confirmFile, args);
 
   return true;
 }
@@ -772,8 +1569,7 @@ bool Transaction::apiFileUp() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL FileUp(%(profile)s, %(thing)s, %(file)s)", args);
+  query(&Transaction::returnOK, SQL::fileUp, args);
 
   return true;
 }
@@ -783,8 +1579,7 @@ bool Transaction::apiFileDown() {
   JSON::ValuePtr args = parseArgsPtr();
   authorize(args->getString("profile"));
 
-  query(&Transaction::returnOK,
-        "CALL FileDown(%(profile)s, %(thing)s, %(file)s)", args);
+  query(&Transaction::returnOK, SQL::fileDown, args);
 
   return true;
 }
@@ -792,30 +1587,27 @@ bool Transaction::apiFileDown() {
 
 bool Transaction::apiGetTags() {
   JSON::ValuePtr args = parseArgsPtr();
-  query(&Transaction::returnList, "CALL GetTags(%(limit)u)", args);
+  query(&Transaction::returnList, SQL::getTags, args);
   return true;
 }
 
 
 bool Transaction::apiGetTagThings() {
   JSON::ValuePtr args = parseArgsPtr();
-  query(&Transaction::returnList,
-        "CALL FindThingsByTag(%(tag)s, %(limit)u, %(offset)u)", args);
+  query(&Transaction::returnList, SQL::findThingsByTag, args);
   return true;
 }
 
 
 bool Transaction::apiGetLicenses() {
-  query(&Transaction::returnList, "CALL GetLicenses()");
+  query(&Transaction::returnList, SQL::getLicenses);
   return true;
 }
 
 
 bool Transaction::apiGetEvents() {
   JSON::ValuePtr args = parseArgsPtr();
-  query(&Transaction::returnList, "CALL GetEvents(%(subject)s, %(action)s, "
-        "%(object_type)s, %(object)s, %(owner)s, %(following)b, %(since)s, "
-        "%(limit)u)", args);
+  query(&Transaction::returnList, SQL::getEvents, args);
   return true;
 }
 
@@ -852,8 +1644,16 @@ void Transaction::download(MariaDB::EventDBCallback::state_t state) {
     break;
 
   case MariaDB::EventDBCallback::EVENTDB_DONE:
-    setCache(Time::SEC_PER_HOUR);
-    redirect(redirectTo);
+    if (!thumbnailSize.empty())
+      worker.getThumbnailer().get(*this, storagePath, thumbnailSize);
+
+    else if (!storagePath.empty())
+      app.getStorage().download(*this, storagePath, storageType);
+
+    else {
+      setCache(Time::SEC_PER_HOUR);
+      redirect(redirectTo);
+    }
     break;
 
   case MariaDB::EventDBCallback::EVENTDB_ROW: {
@@ -890,11 +1690,18 @@ void Transaction::download(MariaDB::EventDBCallback::state_t state) {
     if (size != "orig" &&
         (type == "image/png" || type == "image/gif" || type == "image/jpeg" ||
          type == "avatar")) {
-      redirectTo = app.getImageHost() + path + "?size=" + size;
-      break;
+      // The image host cannot read private objects, the Thumbnailer
+      // fetches them with presigned URLs
+      if (!app.getImageHost().empty() && !app.getAWSPrivate()) {
+        redirectTo = app.getImageHost() + path + "?size=" + size;
+        break;
+      }
+
+      if (Thumbnailer::getPixels(size)) thumbnailSize = size;
     }
 
-    redirectTo = "//" + app.getAWSBucket() + ".s3.amazonaws.com" + path;
+    storagePath = path;
+    storageType = type;
     break;
   }
 
@@ -905,6 +1712,18 @@ void Transaction::download(MariaDB::EventDBCallback::state_t state) {
 
 void Transaction::authUser(MariaDB::EventDBCallback::state_t state) {
   switch (state) {
+  case MariaDB::EventDBCallback::EVENTDB_DONE:
+    if (!writer.isNull()) writer->endDict();
+    writer.release(); // Flush
+
+    // Cache response
+    if (getOutputBuffer().getLength() <= maxAuthCacheSize)
+      user->setAuthCache(getOutputBuffer().toString(),
+                         Time::now() + app.getAuthUserCacheTimeout());
+
+    reply();
+    break;
+
   case MariaDB::EventDBCallback::EVENTDB_ERROR:
     // Not really logged in, clear cookie
     clearAuthCookie();
@@ -928,7 +1747,7 @@ void Transaction::login(MariaDB::EventDBCallback::state_t state) {
     break;
 
   case MariaDB::EventDBCallback::EVENTDB_DONE:
-    app.getUserManager().updateSession(user);
+    worker.getUserManager().updateSession(user);
     setAuthCookie();
 
     getJSONWriter()->write("ok");
@@ -945,7 +1764,7 @@ void Transaction::registration(MariaDB::EventDBCallback::state_t state) {
   switch (state) {
   case MariaDB::EventDBCallback::EVENTDB_DONE:
     user->setName(getArg("profile"));
-    app.getUserManager().updateSession(user);
+    worker.getUserManager().updateSession(user);
     setAuthCookie();
     // Fall through
 
@@ -954,9 +1773,144 @@ void Transaction::registration(MariaDB::EventDBCallback::state_t state) {
 }
 
 
+bool Transaction::multipartStarted(Event::Request &req) {
+  pending.release();
+
+  string error = getS3Error(req);
+  if (!error.empty()) {
+    sendError(HTTP_BAD_GATEWAY, error);
+    return true;
+  }
+
+  string uploadID = xmlTag(req.getInput(), "UploadId");
+  if (uploadID.empty()) {
+    sendError(HTTP_BAD_GATEWAY, "S3 did not return an UploadId");
+    return true;
+  }
+
+  pendingArgs->insert("upload_id", uploadID);
+
+  query(&Transaction::multipartRecorded,
+        SQL::startMultipartUpload, pendingArgs);
+
+  return true;
+}
+
+
+void Transaction::multipartRecorded(MariaDB::EventDBCallback::state_t state) {
+  if (state != MariaDB::EventDBCallback::EVENTDB_DONE)
+    return returnReply(state);
+
+  writeMultipartParts();
+}
+
+
+void Transaction::writeMultipartParts() {
+  string uploadID = pendingArgs->getString("upload_id");
+  uint64_t size = pendingArgs->getU64("size");
+  uint64_t partSize = app.getAWSPartSize();
+  if (partSize < size / maxMultipartParts + 1)
+    partSize = size / maxMultipartParts + 1;
+  unsigned parts = (size + partSize - 1) / partSize;
+
+  setContentType("application/json");
+  writer = getJSONWriter();
+  writer->beginDict();
+  writer->insert("upload_id", uploadID);
+  writer->insert("file_url", pendingArgs->getString("file_url"));
+  writer->insert("part_size", partSize);
+  writer->insertList("parts");
+
+  // Parts may be uploaded in parallel and retried until the URLs expire
+  for (unsigned i = 1; i <= parts; i++) {
+    AWS4PresignedURL url =
+      app.getS3URL(uploadPath, HTTP::RequestMethod::HTTP_PUT,
+                   app.getAWSUploadExpires());
+    url.set("partNumber", String(i));
+    url.set("uploadId", uploadID);
+    app.signS3URL(url);
+
+    writer->append(url.toString());
+  }
+
+  writer->endList();
+  writer->endDict();
+  writer.release();
+
+  reply();
+}
+
+
+void Transaction::multipartLookup(MariaDB::EventDBCallback::state_t state) {
+  switch (state) {
+  case MariaDB::EventDBCallback::EVENTDB_ROW:
+    uploadPath = db->getString(0);
+    pendingArgs->insert("size", db->getU64(1));
+    break;
+
+  case MariaDB::EventDBCallback::EVENTDB_BEGIN_RESULT:
+  case MariaDB::EventDBCallback::EVENTDB_END_RESULT:
+    break;
+
+  case MariaDB::EventDBCallback::EVENTDB_DONE:
+    if (getMethod() == HTTP_GET) return writeMultipartParts();
+
+    if (getMethod() == HTTP_DELETE) {
+      callS3(HTTP::RequestMethod::HTTP_DELETE, "",
+             &Transaction::multipartAborted);
+      break;
+    }
+
+    {
+      // Complete
+      string body = "<CompleteMultipartUpload>";
+      const JSON::Value &parts = *pendingArgs->get("parts");
+
+      for (unsigned i = 0; i < parts.size(); i++)
+        body += "<Part><PartNumber>" + String(parts.get(i)->getU32("part")) +
+          "</PartNumber><ETag>" + xmlEscape(parts.get(i)->getString("etag")) +
+          "</ETag></Part>";
+
+      body += "</CompleteMultipartUpload>";
+
+      callS3(HTTP::RequestMethod::HTTP_POST, body,
+             &Transaction::multipartCompleted);
+    }
+    break;
+
+  default: returnReply(state); return;
+  }
+}
+
+
+bool Transaction::multipartCompleted(Event::Request &req) {
+  pending.release();
+
+  string error = getS3Error(req);
+  if (!error.empty()) sendError(HTTP_BAD_GATEWAY, error);
+  else query(&Transaction::returnOK, SQL::completeMultipartUpload, pendingArgs);
+
+  return true;
+}
+
+
+bool Transaction::multipartAborted(Event::Request &req) {
+  pending.release();
+
+  // 404 means S3 already forgot the upload
+  string error = getS3Error(req);
+  if (!error.empty() && req.getResponseCode() != HTTP_NOT_FOUND)
+    sendError(HTTP_BAD_GATEWAY, error);
+  else query(&Transaction::returnOK, SQL::abortMultipartUpload, pendingArgs);
+
+  return true;
+}
+
+
 void Transaction::returnOK(MariaDB::EventDBCallback::state_t state) {
   switch (state) {
   case MariaDB::EventDBCallback::EVENTDB_DONE:
+    invalidateThing();
     getJSONWriter()->write("ok");
     setContentType("application/json");
     reply();
@@ -1088,9 +2042,68 @@ void Transaction::returnJSONFields(MariaDB::EventDBCallback::state_t state) {
 }
 
 
+void Transaction::thingLoaded(MariaDB::EventDBCallback::state_t state) {
+  switch (state) {
+  case MariaDB::EventDBCallback::EVENTDB_ROW:
+    // Same layout as returnJSONFields()
+    if (sectionWriter->inDict()) db->insertRow(*sectionWriter, 0, -1, false);
+
+    else if (db->getFieldCount() == 1) {
+      sectionWriter->beginAppend();
+      db->writeField(*sectionWriter, 0);
+
+    } else {
+      sectionWriter->appendDict();
+      db->insertRow(*sectionWriter, 0, -1, false);
+      sectionWriter->endDict();
+    }
+    break;
+
+  case MariaDB::EventDBCallback::EVENTDB_BEGIN_RESULT:
+    if (ThingCache::SECTIONS <= thingSections.size())
+      THROW("Unexpected result set");
+
+    sectionWriter = new JSON::BufferWriter(0, true);
+    if (thingSections.empty()) sectionWriter->beginDict();
+    else sectionWriter->beginList();
+    break;
+
+  case MariaDB::EventDBCallback::EVENTDB_END_RESULT:
+    if (sectionWriter->inList()) sectionWriter->endList();
+    else sectionWriter->endDict();
+
+    sectionWriter->flush();
+    thingSections.push_back(sectionWriter->toString());
+    sectionWriter.release();
+    break;
+
+  case MariaDB::EventDBCallback::EVENTDB_DONE:
+    if (thingSections.size() != ThingCache::SECTIONS)
+      THROW("Missing result set");
+
+    if (!thingKey.empty())
+      app.getThingCache().insert(thingKey, &thingSections[0],
+                                 thingGeneration);
+
+    setContentType("application/json");
+    send(ThingCache::splice(&thingSections[0]));
+    reply();
+    break;
+
+  case MariaDB::EventDBCallback::EVENTDB_RETRY:
+    thingSections.clear();
+    sectionWriter.release();
+    // Fall through
+
+  default: return returnReply(state);
+  }
+}
+
+
 void Transaction::returnReply(MariaDB::EventDBCallback::state_t state) {
   switch (state) {
   case MariaDB::EventDBCallback::EVENTDB_DONE:
+    invalidateThing();
     writer.release();
     reply();
     break;
@@ -1123,3 +2136,27 @@ void Transaction::returnReply(MariaDB::EventDBCallback::state_t state) {
     return;
   }
 }
+
+
+void Transaction::queryTraced(MariaDB::EventDBCallback::state_t state) {
+  event_db_member_functor_t member = queryMember;
+
+  if (dbSpan != Trace::MAX_SPANS && state != EVENTDB_RETRY) {
+    // First response, the rest is rows and callback processing
+    trace.end(dbSpan);
+    dbSpan = Trace::MAX_SPANS;
+    rowsSpan = trace.begin("rows");
+  }
+
+  // The callback may issue the next query or throw
+  if (state == EVENTDB_DONE || state == EVENTDB_ERROR) {
+    trace.end(rowsSpan);
+    rowsSpan = Trace::MAX_SPANS;
+    return (this->*member)(state);
+  }
+
+  unsigned span = rowsSpan;
+  uint64_t start = Trace::now();
+  (this->*member)(state);
+  trace.addBusy(span, Trace::now() - start);
+}
@@ -33,19 +33,26 @@
 #define BUILDBOTICS_TRANSACTION_H
 
 #include "AuthFlags.h"
+#include "Upload.h"
+#include "Trace.h"
 
 #include <cbang/event/Request.h>
 #include <cbang/event/RequestMethod.h>
 #include <cbang/event/PendingRequest.h>
 #include <cbang/event/OAuth2Login.h>
+#include <cbang/event/HTTPHandlerMemberFunctor.h>
+#include <cbang/http/RequestMethod.h>
 #include <cbang/db/maria/EventDBCallback.h>
 
+struct event;
+
 
 namespace cb {
   class OAuth2Login;
   namespace MariaDB {class EventDB;}
   namespace JSON {
     class Writer;
+    class BufferWriter;
     class Value;
   }
 }
@@ -53,21 +60,72 @@ namespace cb {
 
 namespace Buildbotics {
   class App;
+  class Worker;
   class User;
-  class AWS4Post;
+  class Arena;
+  class Task;
+  class Responder;
+  class SQLLiteral;
 
   class Transaction : public cb::Event::Request, public cb::Event::OAuth2Login {
+    Worker &worker;
     App &app;
+    Arena &arena;
     cb::SmartPointer<User> user;
     cb::SmartPointer<cb::MariaDB::EventDB> db;
     cb::SmartPointer<cb::JSON::Writer> writer;
     const char *jsonFields;
     std::string redirectTo;
+    std::string storagePath;
+    std::string storageType;
+    std::string thumbnailSize;
+
+    // Thing cache state
+    std::string thingKey;
+    uint64_t thingGeneration;
+    std::vector<std::string> thingSections;
+    cb::SmartPointer<cb::JSON::BufferWriter> sectionWriter;
+    std::string changedThingKey;
+    unsigned changedThing;
+
+    // Multipart upload state
+    cb::SmartPointer<cb::JSON::Value> pendingArgs;
+    cb::SmartPointer<cb::Event::PendingRequest> pending;
+    std::string uploadPath;
+
+    // Cancelled if the client goes away first, owned by the Worker
+    Task *task;
+
+    // Told of the reply when there is no HTTP/1.1 connection
+    Responder *responder;
+
+    // Outgoing HTTP calls which have not returned.  They hold a raw pointer
+    // to this Transaction so it outlives its Responder until they do.
+    unsigned outgoing;
+    bool orphaned;
+    cb::Event::HTTPHandlerMemberFunctor<Transaction>::member_t outgoingMember;
+
+    // Tracing state
+    Trace trace;
+    bool tracing;
+    int traceStatus;
+    unsigned dbSpan;
+    unsigned rowsSpan;
+    cb::MariaDB::EventDBMemberFunctor<Transaction>::member_t queryMember;
 
   public:
-    Transaction(App &app, evhttp_request *req);
+    Transaction(Worker &worker, Arena &arena, evhttp_request *req);
     ~Transaction();
 
+    /// Transactions live in their own Arena which is recycled when they
+    /// are deleted
+    static void *operator new(size_t size, Arena &arena);
+    static void operator delete(void *ptr);
+    static void operator delete(void *ptr, Arena &arena);
+
+    Arena &getArena() {return arena;}
+    void setRoute(const char *route);
+
     cb::SmartPointer<cb::JSON::Dict> parseArgsPtr();
 
     bool lookupUser(bool skipAuthCheck = false);
@@ -86,17 +144,88 @@ namespace Buildbotics {
     event_db_member_functor_t;
     void query(event_db_member_functor_t member, const std::string &s,
                const cb::SmartPointer<cb::JSON::Value> &dict = 0);
+    /// Compiled once per Worker and rendered without reparsing
+    void query(event_db_member_functor_t member, const SQLLiteral &sql,
+               const cb::SmartPointer<cb::JSON::Value> &dict = 0);
+    void connectDB();
+    /// Wraps @param member so the query's phases are traced
+    event_db_member_functor_t traceQuery(event_db_member_functor_t member);
+
+    /// Record the response status and start timing the write
+    void traceReply(int code);
+
+    /// Send @param path with sendfile().  Handles conditional and Range
+    /// requests.  @param hash identifies the content, for the ETag.
+    void sendFile(const std::string &path, const std::string &type,
+                  const std::string &hash, unsigned maxAge);
+    bool notModified(const std::string &etag, uint64_t modified);
 
     bool apiError(int status, const std::string &msg);
     bool pleaseLogin();
 
-    std::string postFile(const std::string &key, const std::string &file,
-                         const std::string &type, uint32_t minSize,
-                         uint32_t maxSize);
+    /// Invalidate @param sections, ThingCache flags, of the thing named in
+    /// @param args once the request's DB write completes.
+    void thingChanged(const cb::JSON::Value &args, unsigned sections);
+    void invalidateThing();
+
+    /// Acknowledge a toggle which the WriteQueue will write later
+    bool queueWrite(unsigned type, const cb::JSON::Value &args, bool on);
+    /// Called by the WriteFlusher once this user's queued writes are in the
+    /// DB.  Dispatches the request to the API routes.
+    void writesFlushed(bool success = true);
+
+    Worker &getWorker() {return worker;}
+    App &getApp() {return app;}
+
+    void setResponder(Responder *responder) {this->responder = responder;}
+    void replied();
+    /// Called by the Responder, in place of delete, when its client goes
+    /// away.  @return false if there are no outgoing calls.  Otherwise the
+    /// Worker calls Responder::released() once they have all returned.
+    bool orphan();
+
+    /// Run @param task off the event loop for this request.  Takes
+    /// ownership.
+    void submit(Task *task);
+    /// Called by the task's complete(), after which the Worker frees it
+    void taskCompleted() {task = 0;}
+
+    Upload newUpload(const std::string &path, const std::string &file);
+    Upload createUpload(const std::string &path, const std::string &file,
+                        const std::string &type, uint32_t minSize,
+                        uint32_t maxSize);
+    void postFile(const std::string &path, const std::string &file,
+                  const std::string &type, uint32_t minSize, uint32_t maxSize,
+                  const cb::SmartPointer<cb::JSON::Value> &args,
+                  const std::string &urlField, const std::string &sql);
+    void uploadsPrepared(const uploads_t &uploads, const std::string &sql,
+                         const cb::SmartPointer<cb::JSON::Value> &args,
+                         bool batch);
+    void checkUploadFile(const std::string &file, const std::string &type);
+    /// Reply with presigned URLs for the parts of a multipart upload
+    void writeMultipartParts();
+    const char *getUploadACL() const;
+
+    typedef cb::Event::HTTPHandlerMemberFunctor<Transaction>::member_t
+    http_member_functor_t;
+    /// Call @param member when the request to @param url returns, unless
+    /// the client has gone away.
+    void call(const cb::URI &url, unsigned method, const std::string &body,
+              http_member_functor_t member, const std::string &type = "");
+    bool outgoingReturned(cb::Event::Request &req);
+    /// @return false if the Transaction was orphaned
+    bool outgoingDone();
+    void callS3(cb::HTTP::RequestMethod method, const std::string &body,
+                http_member_functor_t member);
+    std::string getS3Error(cb::Event::Request &req);
 
     // From cb::Event::Request
     using cb::Event::Request::sendError;
     void sendError(int code, const std::string &message);
+    using cb::Event::Request::reply;
+    void reply(int code = cb::Event::HTTP_OK);
+    void redirect(const cb::URI &uri,
+                  int code = cb::Event::HTTP_TEMPORARY_REDIRECT);
 
     // From cb::Event::OAuth2Login
     void processProfile(const cb::SmartPointer<cb::JSON::Value> &profile);
@@ -106,10 +235,15 @@ namespace Buildbotics {
     bool apiAuthLogin();
     bool apiAuthLogout();
 
+    bool apiRateLimit();
+    bool apiFlushWrites();
+
     bool apiGetInfo();
 
     bool apiGetPermissions();
 
+    bool apiGetStats();
+
     bool apiGetProfiles();
     bool apiProfileRegister();
     bool apiProfileAvailable();
@@ -146,6 +280,12 @@ namespace Buildbotics {
 
     bool apiDownloadFile();
     bool apiUploadFile();
+    bool apiUploadFiles();
+    bool apiStartMultipart();
+    bool apiGetMultipart();
+    bool apiCompleteMultipart();
+    bool apiAbortMultipart();
+    bool apiStoreUpload();
     bool apiUpdateFile();
     bool apiDeleteFile();
     bool apiConfirmFile();
@@ -164,6 +304,11 @@ namespace Buildbotics {
     bool apiNotFound();
     bool notFound();
 
+    // Event::Client callbacks
+    bool multipartStarted(cb::Event::Request &req);
+    bool multipartCompleted(cb::Event::Request &req);
+    bool multipartAborted(cb::Event::Request &req);
+
     // MariaDB::EventDB callbacks
     std::string nextJSONField();
 
@@ -171,6 +316,8 @@ namespace Buildbotics {
     void authUser(cb::MariaDB::EventDBCallback::state_t state);
     void login(cb::MariaDB::EventDBCallback::state_t state);
     void registration(cb::MariaDB::EventDBCallback::state_t state);
+    void multipartRecorded(cb::MariaDB::EventDBCallback::state_t state);
+    void multipartLookup(cb::MariaDB::EventDBCallback::state_t state);
     void returnOK(cb::MariaDB::EventDBCallback::state_t state);
     void returnList(cb::MariaDB::EventDBCallback::state_t state);
     void returnBool(cb::MariaDB::EventDBCallback::state_t state);
@@ -178,7 +325,9 @@ namespace Buildbotics {
     void returnS64(cb::MariaDB::EventDBCallback::state_t state);
     void returnJSON(cb::MariaDB::EventDBCallback::state_t state);
     void returnJSONFields(cb::MariaDB::EventDBCallback::state_t state);
+    void thingLoaded(cb::MariaDB::EventDBCallback::state_t state);
     void returnReply(cb::MariaDB::EventDBCallback::state_t state);
+    void queryTraced(cb::MariaDB::EventDBCallback::state_t state);
   };
 }
 
@@ -0,0 +1,67 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_UPLOAD_H
+#define BUILDBOTICS_UPLOAD_H
+
+#include <cbang/SmartPointer.h>
+#include <cbang/StdTypes.h>
+#include <cbang/json/Dict.h>
+
+#include <string>
+#include <vector>
+
+
+namespace Buildbotics {
+  /// A file the client has been authorized to upload
+  struct Upload {
+    std::string file;
+    std::string key;      ///< <guid>/<file>
+    std::string path;     ///< The URI encoded key, as stored in the DB
+    std::string fileURL;
+    std::string guid;
+    std::string type;
+    uint32_t minSize;
+    uint32_t maxSize;
+
+    // Filled in by Storage::prepareUpload()
+    std::string method;
+    std::string uploadURL;
+    cb::SmartPointer<cb::JSON::Dict> form; ///< POST form fields, if any
+
+    Upload() : minSize(0), maxSize(0), method("POST") {}
+  };
+
+  typedef std::vector<Upload> uploads_t;
+}
+
+#endif // BUILDBOTICS_UPLOAD_H
+
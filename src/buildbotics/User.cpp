@@ -37,38 +37,149 @@
 
 #include <cbang/String.h>
 #include <cbang/time/Time.h>
+#include <cbang/time/Timer.h>
 #include <cbang/openssl/KeyContext.h>
 #include <cbang/openssl/KeyPair.h>
+#include <cbang/openssl/Digest.h>
 #include <cbang/net/Base64.h>
 #include <cbang/io/StringInputSource.h>
 #include <cbang/log/Logger.h>
 #include <cbang/event/Request.h>
 
+#include <vector>
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace cb;
 using namespace Buildbotics;
 
 
-User::User(App &app) : app(app), expires(0), auth(0) {
+namespace {
+  const char *sessionVersion = "2";
+
+
+  Base64 &sessionBase64() {
+    static Base64 base64('=', '-', '_', 0);
+    return base64;
+  }
+
+
+  bool secureEquals(const string &a, const string &b) {
+    if (a.length() != b.length()) return false;
+
+    unsigned char diff = 0;
+    for (unsigned i = 0; i < a.length(); i++) diff |= a[i] ^ b[i];
+
+    return !diff;
+  }
+
+
+  /// @return An error message, or 0 if @param session is signed with one
+  /// of the configured keys.  Fills @param parts.
+  const char *verify(const App &app, const string &session,
+                     vector<string> &parts) {
+    String::tokenize(session, parts, ".");
+
+    if (parts.size() != 4 || parts[1] != sessionVersion)
+      return "Invalid session format";
+
+    const string *key = app.findSessionKey(parts[2]);
+    if (!key) return "Unknown session key";
+
+    string body = session.substr(parts[0].length() + 1);
+    string sig = Digest::signHMAC(*key, body, "sha256");
+    if (!secureEquals(sessionBase64().encode(sig), parts[0]))
+      return "Invalid session signature";
+
+    return 0;
+  }
+
+
+  // lrand48() shares one state between threads
+  __thread unsigned short nonceState[3];
+  __thread pid_t noncePID = 0;
+
+
+  long nextNonce() {
+    // Seed per thread and again in forked workers
+    if (noncePID != getpid()) {
+      noncePID = getpid();
+      uint64_t seed = (uint64_t)(Timer::now() * 1e6) ^
+        ((uint64_t)noncePID << 32) ^ (uint64_t)(uintptr_t)nonceState;
+      for (unsigned i = 0; i < 3; i++) nonceState[i] = seed >> (16 * i);
+    }
+
+    return nrand48(nonceState);
+  }
+
+
+  struct FreeBlock {FreeBlock *next;};
+  __thread FreeBlock *freeBlocks = 0; // Per worker thread
+  const unsigned poolChunkSize = 256;
+}
+
+
+void *User::operator new(size_t size) {
+  if (size != sizeof(User)) return ::operator new(size); // Subclasses
+
+  if (!freeBlocks) {
+    // Blocks are never returned to the system, the session cache is bounded
+    const size_t align = sizeof(uint64_t);
+    size_t blockSize = (sizeof(User) + align - 1) / align * align;
+    char *chunk = (char *)::operator new(blockSize * poolChunkSize);
+
+    for (unsigned i = 0; i < poolChunkSize; i++) {
+      FreeBlock *block = (FreeBlock *)(chunk + i * blockSize);
+      block->next = freeBlocks;
+      freeBlocks = block;
+    }
+  }
+
+  FreeBlock *block = freeBlocks;
+  freeBlocks = block->next;
+
+  return block;
+}
+
+
+void User::operator delete(void *ptr, size_t size) {
+  if (!ptr) return;
+  if (size != sizeof(User)) return ::operator delete(ptr);
+
+  FreeBlock *block = (FreeBlock *)ptr;
+  block->next = freeBlocks;
+  freeBlocks = block;
+}
+
+
+User::User(App &app) :
+  app(app), expires(0), auth(0), outdated(false), authCacheExpires(0),
+  authCacheGeneration(0) {
   updateSession();
 }
 
 
 User::User(App &app, const string &session) :
-  app(app), session(session) {
+  app(app), session(session), outdated(false), authCacheExpires(0),
+  authCacheGeneration(0) {
   decodeSession(session);
 }
 
 
+User::User(App &app, const string &session, uint64_t expires) :
+  app(app), session(session), expires(expires), auth(0), outdated(false),
+  authCacheExpires(0), authCacheGeneration(0) {}
+
+
 string User::updateSession() {
-  const KeyPair &key = app.getPrivateKey();
   JSON::BufferWriter buf;
   expires = Time::now() + app.getAuthTimeout();
 
   buf.beginDict();
-  buf.insert("nonce", lrand48());
+  buf.insert("nonce", nextNonce());
   buf.insert("expires", Time(expires).toString());
   if (!provider.empty()) buf.insert("provider", provider);
   if (!id.empty()) buf.insert("id", id);
@@ -77,41 +188,63 @@ string User::updateSession() {
   buf.endDict();
   buf.flush();
 
-  string state(buf.data(), buf.size());
-  // TODO limit size so that it cannot exceed key size
-  if (key.size() < state.length()) THROW("User data too long");
-  state.resize(key.size(), ' '); // Pad with spaces
+  // Format: <signature>.<version>.<key id>.<state>
+  // The signature comes first so that the token is unpredictable.
+  string body = string(sessionVersion) + "." + app.getSessionKeyID() + "." +
+    sessionBase64().encode(string(buf.data(), buf.size()));
+  string sig = Digest::signHMAC(app.getSessionKey(), body, "sha256");
 
-  KeyContext ctx(key);
-  ctx.signInit();
-  ctx.setRSAPadding(KeyContext::NO_PADDING);
-
-  session = Base64('=', '-', '_', 0).encode(ctx.sign(state));
+  session = sessionBase64().encode(sig) + "." + body;
+  outdated = false;
 
   return getToken();
 }
 
 
 void User::decodeSession(const string &session) {
-  KeyContext ctx(app.getPrivateKey());
+  string state;
 
-  ctx.verifyRecoverInit();
-  ctx.setRSAPadding(KeyContext::NO_PADDING);
+  if (session.find('.') == string::npos) {
+    // Upgrade legacy RSA sessions on next use
+    state = decodeLegacySession(session);
+    outdated = true;
+
+  } else {
+    vector<string> parts;
+    const char *error = verify(app, session, parts);
+    if (error) THROW(error);
+
+    state = sessionBase64().decode(parts[3]);
+
+    // Reissue sessions signed with a retired key
+    outdated = parts[2] != app.getSessionKeyID();
+  }
 
-  string state = ctx.verifyRecover(Base64('=', '-', '_', 0).decode(session));
   LOG_DEBUG(5, "state = " << String::trim(state));
   JSON::ValuePtr data = JSON::Reader(StringInputSource(state)).parse();
 
   data->getNumber("nonce");
   expires = Time::parse(data->getString("expires"));
   if (hasExpired()) THROW("User auth expired");
-  provider = data->getString("provider");
-  id = data->getString("id");
+  // Anonymous sessions have neither provider nor id
+  provider = data->getString("provider", "");
+  id = data->getString("id", "");
   name = data->getString("name", "");
   auth = data->getNumber("auth", 0);
 }
 
 
+bool User::verifySession() {
+  vector<string> parts;
+  if (verify(app, session, parts)) return false;
+
+  // Reissue sessions signed with a retired key
+  outdated = parts[2] != app.getSessionKeyID();
+
+  return true;
+}
+
+
 bool User::hasExpired() const {
   return expires < Time::now();
 }
@@ -120,3 +253,45 @@ bool User::hasExpired() const {
 bool User::isExpiring() const {
   return expires < Time::now() + app.getAuthGraceperiod();
 }
+
+
+void User::setAuthCache(const string &data, uint64_t expires) {
+  authCache = data;
+  authCacheExpires = expires;
+}
+
+
+const string *User::getAuthCache() {
+  uint32_t generation =
+    app.getSharedSessions().getGeneration(getAuthCacheKey());
+
+  if (authCacheExpires < Time::now() || authCacheGeneration != generation) {
+    authCacheGeneration = generation;
+    authCacheExpires = 0;
+    return 0;
+  }
+
+  return &authCache;
+}
+
+
+void User::invalidateAuthCache() {
+  string().swap(authCache); // Free memory
+  authCacheExpires = 0;
+  app.getSharedSessions().invalidate(getAuthCacheKey());
+}
+
+
+string User::getAuthCacheKey() const {
+  return isAuthenticated() ? provider + ":" + id : getToken();
+}
+
+
+string User::decodeLegacySession(const string &session) const {
+  KeyContext ctx(app.getPrivateKey());
+
+  ctx.verifyRecoverInit();
+  ctx.setRSAPadding(KeyContext::NO_PADDING);
+
+  return ctx.verifyRecover(sessionBase64().decode(session));
+}
@@ -54,20 +54,35 @@ namespace Buildbotics {
     std::string id;
     std::string name;
     uint64_t auth;
+    bool outdated;
+
+    // Serialized /api/auth/user response
+    std::string authCache;
+    uint64_t authCacheExpires;
+    uint32_t authCacheGeneration;
 
   public:
     User(App &app);
     User(App &app, const std::string &session);
+    User(App &app, const std::string &session, uint64_t expires);
+
+    // Users are allocated from a pool of fixed size blocks
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size);
 
     void setSession(const std::string &session) {this->session = session;}
     const std::string &getSession() const {return session;}
     std::string getToken() const {return session.substr(0, 32);}
+    uint64_t getExpires() const {return expires;}
 
     std::string updateSession();
     void decodeSession(const std::string &session);
+    /// Check the signature of a session restored without decoding it
+    bool verifySession();
 
     bool hasExpired() const;
     bool isExpiring() const;
+    bool isOutdated() const {return outdated;}
 
     void setProvider(const std::string &provider) {this->provider = provider;}
     const std::string &getProvider() const {return provider;}
@@ -82,6 +97,17 @@ namespace Buildbotics {
     uint64_t getAuth() const {return auth;}
 
     bool isAuthenticated() const {return !provider.empty() && !id.empty();}
+
+    /// Must follow a getAuthCache() miss, which records the generation the
+    /// response is computed from
+    void setAuthCache(const std::string &data, uint64_t expires);
+    const std::string *getAuthCache();
+    /// Invalidates the response cached by every worker for this user
+    void invalidateAuthCache();
+
+  protected:
+    std::string decodeLegacySession(const std::string &session) const;
+    std::string getAuthCacheKey() const;
   };
 }
 
@@ -30,40 +30,331 @@
 \******************************************************************************/
 
 #include "UserManager.h"
+#include "App.h"
 
+#include <cbang/String.h>
 #include <cbang/log/Logger.h>
 #include <cbang/util/DefaultCatch.h>
+#include <cbang/time/Time.h>
+#include <cbang/event/Base.h>
+#include <cbang/event/Event.h>
+#include <cbang/json/Writer.h>
+#include <cbang/openssl/Digest.h>
+#include <cbang/os/SysError.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
 
 using namespace std;
 using namespace cb;
 using namespace Buildbotics;
 
 
-UserManager::UserManager(App &app) : app(app) {
-  // TODO register cleanup event
+namespace {
+  const unsigned wheelSlots = 1024;
+  const char snapshotMagic[8] = {'B', 'B', 'S', 'N', 'A', 'P', '0', '1'};
+
+
+  struct SnapshotHeader {
+    char magic[8];
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t length;
+    char checksum[32]; // SHA-256 of the records
+  };
+
+
+  void append(string &buf, const void *data, unsigned length) {
+    buf.append((const char *)data, length);
+  }
+
+
+  void append(string &buf, const string &s) {
+    if (0xffff < s.length()) THROW("Snapshot string too long");
+    uint16_t length = s.length();
+    append(buf, &length, sizeof(length));
+    buf.append(s);
+  }
+
+
+  class SnapshotReader {
+    const char *ptr;
+    const char *end;
+
+  public:
+    SnapshotReader(const char *ptr, uint64_t length) :
+      ptr(ptr), end(ptr + length) {}
+
+    bool done() const {return ptr == end;}
+
+    void read(void *data, unsigned length) {
+      if (end - ptr < length) THROW("Truncated session snapshot");
+      memcpy(data, ptr, length);
+      ptr += length;
+    }
+
+    string readString() {
+      uint16_t length;
+      read(&length, sizeof(length));
+      if (end - ptr < length) THROW("Truncated session snapshot");
+
+      string s(ptr, length);
+      ptr += length;
+      return s;
+    }
+  };
+}
+
+
+UserManager::UserManager(App &app, Event::Base &base) :
+  app(app), base(base), shard(0), wheel(wheelSlots), wheelTick(0),
+  hits(0), sharedHits(0), misses(0), expirations(0), evictions(0) {}
+
+
+void UserManager::init(unsigned shard) {
+  this->shard = shard;
+
+  if (!app.getSessionCleanupPeriod())
+    THROW("session-cleanup-period must be greater than zero");
+
+  wheelTick = Time::now() / app.getSessionCleanupPeriod();
+
+  // Each shard keeps its own snapshot
+  if (app.getOptions()["session-snapshot"].hasValue()) {
+    snapshotPath = app.getOptions()["session-snapshot"].toString();
+    if (shard) snapshotPath += "." + String(shard);
+  }
+
+  base.newEvent(this, &UserManager::cleanupEvent)
+    .add(app.getSessionCleanupPeriod());
 }
 
 
 void UserManager::cleanup() {
-  // TODO clean up expired Users
+  uint64_t now = Time::now();
+  uint64_t tick = now / app.getSessionCleanupPeriod();
+  unsigned before = users.size();
+
+  // Visit each slot passed since the last cleanup, at most one revolution
+  if (wheelTick + wheelSlots < tick) wheelTick = tick - wheelSlots;
+
+  while (wheelTick < tick) {
+    slot_t slot;
+    slot.swap(wheel[++wheelTick % wheelSlots]);
+
+    for (unsigned i = 0; i < slot.size(); i++) {
+      Entry *entry = users.find(slot[i]);
+
+      // Stale entries were renewed or evicted
+      if (!entry) continue;
+
+      uint64_t expires = entry->user->getExpires();
+      if (expires < now) {
+        remove(slot[i]);
+        expirations++;
+
+      } else schedule(slot[i], expires); // Not this revolution
+    }
+  }
+
+  LOG_INFO(3, "Session cleanup: " << before - users.size() << " expired, "
+           << users.size() << " active, " << anonymousLRU.size()
+           << " anonymous");
+}
+
+
+void UserManager::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("shard", shard);
+  writer.insert("size", getSize());
+  writer.insert("max", app.getMaxSessions());
+  writer.insert("anonymous", getAnonymousCount());
+  writer.insert("authenticated", getSize() - getAnonymousCount());
+  writer.insert("hits", hits);
+  writer.insert("shared_hits", sharedHits);
+  writer.insert("misses", misses);
+  writer.insert("expirations", expirations);
+  writer.insert("evictions", evictions);
+  writer.insert("capacity", users.capacity());
+  writer.insert("bytes", users.getMemoryUsage());
+  writer.endDict();
+}
+
+
+void UserManager::saveSnapshot() {
+  if (snapshotPath.empty()) return;
+
+  // Records: token, expires, auth, session, provider, id, name
+  string body;
+  uint32_t count = 0;
+  uint64_t now = Time::now();
+  lru_t *lists[] = {&anonymousLRU, &authenticatedLRU};
+
+  for (unsigned i = 0; i < 2; i++)
+    for (lru_t::iterator it = lists[i]->begin(); it != lists[i]->end(); it++) {
+      const User &user = *users.find(*it)->user;
+      if (user.getExpires() < now || user.isOutdated()) continue;
+
+      uint64_t expires = user.getExpires();
+      uint64_t auth = user.getAuth();
+
+      append(body, it->data, SessionToken::SIZE);
+      append(body, &expires, sizeof(expires));
+      append(body, &auth, sizeof(auth));
+      append(body, user.getSession());
+      append(body, user.getProvider());
+      append(body, user.getID());
+      append(body, user.getName());
+      count++;
+    }
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, snapshotMagic, sizeof(header.magic));
+  header.count = count;
+  header.length = body.length();
+  string checksum = Digest::hash(body, "sha256");
+  memcpy(header.checksum, checksum.data(), sizeof(header.checksum));
+
+  // Write to a temporary file then atomically replace the snapshot
+  string tmp = snapshotPath + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) THROWS("Failed to open '" << tmp << "': " << SysError());
+
+  bool ok = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+    write(fd, body.data(), body.length()) == (ssize_t)body.length();
+  ::close(fd);
+
+  if (!ok || rename(tmp.c_str(), snapshotPath.c_str())) {
+    unlink(tmp.c_str());
+    THROWS("Failed to write session snapshot '" << snapshotPath << "': "
+           << SysError());
+  }
+
+  LOG_INFO(1, "Saved " << count << " sessions to '" << snapshotPath << "'");
+}
+
+
+void UserManager::loadSnapshot() {
+  if (snapshotPath.empty()) return;
+
+  int fd = ::open(snapshotPath.c_str(), O_RDONLY);
+  if (fd == -1) return; // No snapshot
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (!fstat(fd, &st) && sizeof(SnapshotHeader) <= (uint64_t)st.st_size)
+    map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+
+  if (map == MAP_FAILED) {
+    LOG_WARNING("Failed to map session snapshot '" << snapshotPath << "'");
+    return;
+  }
+
+  unsigned loaded = 0;
+  unsigned expired = 0;
+  unsigned invalid = 0;
+
+  try {
+    const SnapshotHeader &header = *(const SnapshotHeader *)map;
+    const char *body = (const char *)map + sizeof(SnapshotHeader);
+
+    if (memcmp(header.magic, snapshotMagic, sizeof(header.magic)) ||
+        header.length != st.st_size - sizeof(SnapshotHeader))
+      THROW("Invalid session snapshot header");
+
+    string checksum = Digest::hash(string(body, header.length), "sha256");
+    if (memcmp(checksum.data(), header.checksum, sizeof(header.checksum)))
+      THROW("Session snapshot checksum mismatch");
+
+    uint64_t now = Time::now();
+    SnapshotReader reader(body, header.length);
+
+    for (unsigned i = 0; i < header.count; i++) {
+      SessionToken token;
+      uint64_t expires;
+      uint64_t auth;
+
+      reader.read(token.data, SessionToken::SIZE);
+      reader.read(&expires, sizeof(expires));
+      reader.read(&auth, sizeof(auth));
+      string session = reader.readString();
+      string provider = reader.readString();
+      string id = reader.readString();
+      string name = reader.readString();
+
+      if (expires < now) {expired++; continue;}
+      if (users.find(token)) continue;
+
+      SmartPointer<User> user = new User(app, session, expires);
+      user->setProvider(provider);
+      user->setID(id);
+      user->setName(name);
+      user->setAuth(auth);
+
+      // Drop sessions signed with a key that is no longer configured
+      if (!user->verifySession()) {invalid++; continue;}
+
+      add(token, user);
+      loaded++;
+    }
+
+    if (!reader.done()) THROW("Trailing data in session snapshot");
+
+  } CATCH_ERROR;
+
+  munmap(map, st.st_size);
+
+  LOG_INFO(1, "Loaded " << loaded << " sessions from '" << snapshotPath
+           << "', dropped " << expired << " expired and " << invalid
+           << " invalid");
 }
 
 
 SmartPointer<User> UserManager::create() {
   SmartPointer<User> user = new User(app);
+  SessionToken token(user->getToken());
 
-  if (!users.insert(users_t::value_type(user->getToken(), user)).second)
+  if (users.find(token))
     THROWS("User token already exists: " << user->getToken());
 
-  return user;
+  return add(token, user);
 }
 
 
 SmartPointer<User> UserManager::get(const string &session) {
-  string token = session.substr(0, 32);
+  SessionToken token(session);
+  Entry *entry = users.find(token);
+
+  if (entry) {
+    hits++;
+    touch(*entry);
+    return entry->user;
+  }
+
+  // Check sessions decoded by other processes
+  SharedSessionTable::Entry shm;
+  if (app.getSharedSessions().get(token, shm)) {
+    SmartPointer<User> user = new User(app, session, shm.expires);
+    user->setProvider(shm.provider);
+    user->setID(shm.id);
+    user->setName(shm.name);
+    user->setAuth(shm.auth);
+
+    // Otherwise decoded below, which rejects it
+    if (user->verifySession()) {
+      sharedHits++;
+      return add(token, user);
+    }
+  }
 
-  users_t::iterator it = users.find(token);
-  if (it != users.end()) return it->second;
+  misses++;
 
   // Decode session and create user if valid
   try {
@@ -71,9 +362,10 @@ SmartPointer<User> UserManager::get(const string &session) {
 
     // TODO look up user profile in DB
 
-    // Add user
-    return users.insert(users_t::value_type(token, user)).first->second;
+    publish(token, *user);
 
+    // Add user
+    return add(token, user);
   } CATCH_ERROR;
 
   return 0;
@@ -81,13 +373,92 @@ SmartPointer<User> UserManager::get(const string &session) {
 
 
 void UserManager::updateSession(const SmartPointer<User> &user) {
-  string oldToken = user->getToken();
-  string newToken = user->updateSession();
+  SessionToken oldToken(user->getToken());
+  SessionToken newToken(user->updateSession());
 
   // Insert user under new token
-  if (!users.insert(users_t::value_type(newToken, user)).second)
-    THROWS("User token already exists " << newToken);
+  if (users.find(newToken))
+    THROWS("User token already exists " << newToken.toString());
+  add(newToken, user);
+  publish(newToken, *user);
+
+  // Remove user under old token, its wheel entry is dropped when visited
+  remove(oldToken);
+}
+
+
+SmartPointer<User>
+UserManager::add(const SessionToken &token, const SmartPointer<User> &user) {
+  if (app.getMaxSessions() <= users.size()) evict();
+
+  bool inserted;
+  Entry &entry = users.insert(token, inserted);
+  entry.user = user;
+  entry.anonymous = !user->isAuthenticated();
+
+  lru_t &lru = entry.anonymous ? anonymousLRU : authenticatedLRU;
+  entry.lru = lru.insert(lru.end(), token);
+
+  schedule(token, user->getExpires());
 
-  // Remove user under old token
-  users.erase(oldToken);
+  return user;
+}
+
+
+void UserManager::remove(const SessionToken &token) {
+  Entry *entry = users.find(token);
+  if (!entry) return;
+
+  lru_t &lru = entry->anonymous ? anonymousLRU : authenticatedLRU;
+  lru_t::iterator it = entry->lru;
+
+  // Token may refer to the LRU node, so erase it last
+  users.erase(token);
+  lru.erase(it);
+}
+
+
+void UserManager::publish(const SessionToken &token, const User &user) {
+  // Anonymous sessions are cheap to decode and would crowd out real users
+  if (user.isAuthenticated() && !user.isOutdated())
+    app.getSharedSessions().put(token, user);
+}
+
+
+void UserManager::touch(Entry &entry) {
+  lru_t &lru = entry.anonymous ? anonymousLRU : authenticatedLRU;
+  lru.splice(lru.end(), lru, entry.lru);
+}
+
+
+void UserManager::schedule(const SessionToken &token, uint64_t expires) {
+  // Round up so the slot is not visited before the session expires
+  uint64_t period = app.getSessionCleanupPeriod();
+  uint64_t tick = (expires + period - 1) / period;
+
+  // Entries due within the current tick are collected on the next one
+  if (tick <= wheelTick) tick = wheelTick + 1;
+
+  wheel[tick % wheelSlots].push_back(token);
+}
+
+
+void UserManager::evict() {
+  // Prefer unauthenticated sessions.  Evicted sessions are not invalidated,
+  // they are decoded again by get() if the client returns.
+  lru_t &lru = anonymousLRU.empty() ? authenticatedLRU : anonymousLRU;
+  if (lru.empty()) return;
+
+  LOG_DEBUG(5, "Evicting session " << lru.front().toString());
+  remove(lru.front());
+  evictions++;
+}
+
+
+void UserManager::cleanupEvent(Event::Event &e, int signal, unsigned flags) {
+  e.add(app.getSessionCleanupPeriod());
+
+  try {
+    cleanup();
+  } CATCH_ERROR;
 }
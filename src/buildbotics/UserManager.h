@@ -33,9 +33,20 @@
 #define BUILDBOTICS_USER_MANAGER_H
 
 #include "User.h"
+#include "SessionTable.h"
+#include "SharedSessionTable.h"
 
 #include <string>
-#include <map>
+#include <list>
+#include <vector>
+
+namespace cb {
+  namespace Event {
+    class Base;
+    class Event;
+  }
+  namespace JSON {class Writer;}
+}
 
 
 namespace Buildbotics {
@@ -43,20 +54,64 @@ namespace Buildbotics {
 
   class UserManager {
     App &app;
+    cb::Event::Base &base;
+    unsigned shard;
+
+    typedef std::list<SessionToken> lru_t;
+
+    struct Entry {
+      cb::SmartPointer<User> user;
+      lru_t::iterator lru;
+      bool anonymous;
+    };
 
-    typedef std::map<std::string, cb::SmartPointer<User> > users_t;
+    typedef SessionTable<Entry> users_t;
     users_t users;
 
+    // Least recently used first
+    lru_t anonymousLRU;
+    lru_t authenticatedLRU;
+
+    // Hashed timer wheel of session tokens keyed on User::expires
+    typedef std::vector<SessionToken> slot_t;
+    std::vector<slot_t> wheel;
+    uint64_t wheelTick;
+
+    std::string snapshotPath;
+
+    uint64_t hits;
+    uint64_t sharedHits;
+    uint64_t misses;
+    uint64_t expirations;
+    uint64_t evictions;
+
   public:
-    UserManager(App &app);
+    UserManager(App &app, cb::Event::Base &base);
 
+    void init(unsigned shard = 0);
     void cleanup();
+    unsigned getSize() const {return users.size();}
+    unsigned getAnonymousCount() const {return anonymousLRU.size();}
+    void writeStats(cb::JSON::Writer &writer) const;
+
+    void saveSnapshot();
+    void loadSnapshot();
 
     cb::SmartPointer<User> create();
     cb::SmartPointer<User> get(const std::string &session);
     void updateSession(const cb::SmartPointer<User> &user);
+
+  protected:
+    cb::SmartPointer<User> add(const SessionToken &token,
+                               const cb::SmartPointer<User> &user);
+    void remove(const SessionToken &token);
+    void publish(const SessionToken &token, const User &user);
+    void touch(Entry &entry);
+    void schedule(const SessionToken &token, uint64_t expires);
+    void evict();
+
+    void cleanupEvent(cb::Event::Event &e, int signal, unsigned flags);
   };
 }
 
 #endif // BUILDBOTICS_USER_MANAGER_H
-
@@ -0,0 +1,339 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "Worker.h"
+#include "App.h"
+#include "Responder.h"
+
+#include <cbang/Exception.h>
+#include <cbang/String.h>
+#include <cbang/os/SysError.h>
+#include <cbang/os/SmartLock.h>
+#include <cbang/log/Logger.h>
+#include <cbang/util/DefaultCatch.h>
+#include <cbang/openssl/SSLContext.h>
+#include <cbang/event/HTTP.h>
+#include <cbang/event/Event.h>
+#include <cbang/event/HTTPStatus.h>
+#include <cbang/db/maria/EventDB.h>
+#include <cbang/json/Writer.h>
+
+#include <event2/http.h>
+#include <event2/util.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  /// Passes only local storage uploads to the Server
+  class UploadHandler : public Event::HTTPHandler {
+    Server &server;
+
+  public:
+    UploadHandler(Server &server) : server(server) {}
+
+    // From Event::HTTPHandler
+    Event::Request *createRequest(evhttp_request *req) {
+      return server.createRequest(req);
+    }
+
+    bool operator()(Event::Request &req) {
+      if (!String::startsWith(req.getURI().getPath(), "/api/uploads/"))
+        return false;
+      return server(req);
+    }
+  };
+}
+
+
+Worker::Worker(App &app, unsigned id) :
+  app(app), id(id), options(id ? new Options : 0), dns(base),
+  client(base, dns, new SSLContext), sslCtx(new SSLContext), server(*this),
+  http2(*this), userManager(app, base), presignedURLs(app), thumbnailer(*this),
+  writeFlusher(*this), dbConnections(0), maxDBConnections(0),
+  doneEvent(&base.newEvent(this, &Worker::tasksEvent)),
+  retireEvent(&base.newEvent(this, &Worker::retiredEvent)) {}
+
+
+Options &Worker::getOptions() {
+  return options.isNull() ? app.getOptions() : *options;
+}
+
+
+void Worker::init(unsigned workers) {
+  if (!options.isNull()) {
+    // Copy configured server options except the listen addresses which are
+    // bound below with SO_REUSEPORT
+    Options &appOptions = app.getOptions();
+
+    for (Options::const_iterator it = options->begin(); it != options->end();
+         it++) {
+      const string &name = it->first;
+
+      if (name != "http-addresses" && name != "https-addresses" &&
+          appOptions.has(name) && appOptions[name].hasValue())
+        it->second->set(appOptions[name].toString());
+    }
+  }
+
+  server.init();
+  userManager.init(app.getProcessIndex() * workers + id);
+  userManager.loadSnapshot();
+
+  // Listen on sockets bound by the supervisor
+  const vector<int> &sockets = app.getListenSockets();
+  for (unsigned i = 0; i < sockets.size(); i++) accept(dup(sockets[i]), false);
+
+  const vector<int> &secureSockets = app.getSecureListenSockets();
+  for (unsigned i = 0; i < secureSockets.size(); i++)
+    accept(dup(secureSockets[i]), true);
+
+  const vector<int> &uploadSockets = app.getUploadListenSockets();
+  for (unsigned i = 0; i < uploadSockets.size(); i++)
+    accept(dup(uploadSockets[i]), false, true);
+
+  // Listen
+  const vector<IPAddress> &addrs = app.getListenAddresses();
+  for (unsigned i = 0; i < addrs.size(); i++) listen(addrs[i], false);
+
+  const vector<IPAddress> &secureAddrs = app.getSecureListenAddresses();
+  for (unsigned i = 0; i < secureAddrs.size(); i++)
+    listen(secureAddrs[i], true);
+
+  const vector<IPAddress> &uploadAddrs = app.getUploadListenAddresses();
+  for (unsigned i = 0; i < uploadAddrs.size(); i++)
+    listen(uploadAddrs[i], false, true);
+
+  http2.init();
+  writeFlusher.init();
+
+  // Split the DB connection budget
+  if (app.getDBMaxConnections()) {
+    maxDBConnections = app.getDBMaxConnections() / workers;
+    if (!maxDBConnections) maxDBConnections = 1;
+  }
+}
+
+
+void Worker::listen(const IPAddress &addr, bool secure, bool upload) {
+  accept(bind(addr), secure, upload);
+
+  LOG_INFO(3, "Worker " << id << " listening on " << addr
+           << (secure ? " (SSL)" : "") << (upload ? " (uploads)" : ""));
+}
+
+
+void Worker::accept(int fd, bool secure, bool upload) {
+  if (fd == -1) THROWS("Invalid listen socket: " << SysError());
+
+  SmartPointer<Event::HTTPHandler> handler;
+  if (upload) handler = new UploadHandler(server);
+  else handler = SmartPointer<Event::HTTPHandler>::Phony(&server);
+
+  SmartPointer<Event::HTTP> http =
+    new Event::HTTP(base, handler,
+                    secure ? sslCtx : SmartPointer<SSLContext>());
+
+  if (!evhttp_accept_socket_with_handle(http->getHTTP(), fd)) {
+    ::close(fd);
+    THROWS("Failed to accept on socket " << fd);
+  }
+
+  // Bodies are buffered in memory before a handler sees them and libevent
+  // cannot limit them per route, so only upload listeners take large ones
+  evhttp_set_max_body_size(http->getHTTP(), upload ? app.getUploadMaxSize() :
+                           app.getHTTPMaxBodySize());
+
+  listeners.push_back(http);
+}
+
+
+int Worker::bind(const IPAddress &addr) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) THROWS("Failed to create socket: " << SysError());
+
+  // Every worker binds the same address, the kernel balances connections
+  int on = 1;
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(addr.getIP());
+  sa.sin_port = htons(addr.getPort());
+
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) ||
+      ::bind(fd, (struct sockaddr *)&sa, sizeof(sa)) ||
+      ::listen(fd, 1024) || evutil_make_socket_nonblocking(fd)) {
+    int err = errno;
+    ::close(fd);
+    THROWS("Failed to listen on " << addr << ": " << SysError(err));
+  }
+
+  return fd;
+}
+
+
+void Worker::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("worker", id);
+  writer.insert("db_connections", dbConnections);
+  writer.beginInsert("sessions");
+  userManager.writeStats(writer);
+
+  writer.insertDict("presigned_urls");
+  writer.insert("size", presignedURLs.getSize());
+  writer.insert("hits", presignedURLs.getHits());
+  writer.insert("misses", presignedURLs.getMisses());
+  writer.endDict();
+
+  writer.beginInsert("thumbnails");
+  thumbnailer.writeStats(writer);
+  writer.beginInsert("compression");
+  compressor.writeStats(writer);
+  writer.beginInsert("static_files");
+  fileTable.writeStats(writer);
+  writer.beginInsert("http2");
+  http2.writeStats(writer);
+  writer.beginInsert("arenas");
+  arenas.writeStats(writer);
+  writer.beginInsert("sql_templates");
+  sqlTemplates.writeStats(writer);
+  writer.beginInsert("write_flusher");
+  writeFlusher.writeStats(writer);
+
+  writer.endDict();
+}
+
+
+SmartPointer<MariaDB::EventDB> Worker::getDBConnection() {
+  if (maxDBConnections && maxDBConnections <= dbConnections)
+    THROWX("Too many database connections", Event::HTTP_SERVICE_UNAVAILABLE);
+
+  dbConnections++;
+
+  return app.getDBConnection(base);
+}
+
+
+void Worker::releaseDBConnection() {
+  if (dbConnections) dbConnections--;
+}
+
+
+void Worker::submit(Task *_task) {
+  if (app.getTaskPool().submit(_task, *this)) return;
+
+  // Pool disabled or full, the task never leaves this thread
+  SmartPointer<Task> task = _task;
+
+  try {
+    task->run();
+  } catch (const Exception &e) {
+    task->setError(e.getMessage());
+  } catch (const std::exception &e) {
+    task->setError(e.what());
+  }
+
+  task->complete();
+}
+
+
+void Worker::taskDone(Task *task) {
+  SmartLock lock(&tasksLock);
+  doneTasks.push_back(task);
+  doneEvent->activate();
+}
+
+
+void Worker::tasksEvent(Event::Event &e, int signal, unsigned flags) {
+  vector<Task *> tasks;
+
+  tasksLock.lock();
+  tasks.swap(doneTasks);
+  tasksLock.unlock();
+
+  for (unsigned i = 0; i < tasks.size(); i++) {
+    try {
+      if (!tasks[i]->isCancelled()) tasks[i]->complete();
+    } CATCH_ERROR;
+
+    delete tasks[i];
+  }
+}
+
+
+void Worker::retire(Responder *responder) {
+  retired.push_back(responder);
+  retireEvent->activate();
+}
+
+
+void Worker::retiredEvent(Event::Event &e, int signal, unsigned flags) {
+  vector<Responder *> responders;
+  responders.swap(retired);
+
+  for (unsigned i = 0; i < responders.size(); i++)
+    try {
+      responders[i]->released();
+    } CATCH_ERROR;
+}
+
+
+void Worker::loopExit() {
+  base.loopExit();
+}
+
+
+void Worker::run() {
+  if (id) MariaDB::DB::threadInit();
+
+  try {
+    base.dispatch();
+  } CATCH_ERROR;
+
+  try {
+    userManager.saveSnapshot();
+  } CATCH_ERROR;
+
+  writeFlusher.shutdown();
+
+  if (id) MariaDB::DB::threadEnd();
+}
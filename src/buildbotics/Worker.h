@@ -0,0 +1,162 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_WORKER_H
+#define BUILDBOTICS_WORKER_H
+
+#include "ArenaPool.h"
+#include "Server.h"
+#include "HTTP2Server.h"
+#include "UserManager.h"
+#include "Task.h"
+#include "PresignedURLCache.h"
+#include "Thumbnailer.h"
+#include "Compressor.h"
+#include "FileTable.h"
+#include "SQLTemplateCache.h"
+#include "WriteFlusher.h"
+
+#include <cbang/os/Thread.h>
+#include <cbang/os/Mutex.h>
+#include <cbang/config/Options.h>
+#include <cbang/net/IPAddress.h>
+
+#include <cbang/event/Base.h>
+#include <cbang/event/DNSBase.h>
+#include <cbang/event/Client.h>
+
+#include <vector>
+
+namespace cb {
+  class SSLContext;
+  namespace Event {
+    class HTTP;
+    class Event;
+  }
+  namespace MariaDB {class EventDB;}
+  namespace JSON {class Writer;}
+}
+
+
+namespace Buildbotics {
+  class App;
+  class Responder;
+
+  /// An event loop with its own listeners, HTTP client, DB connection budget
+  /// and session table shard.  Workers share no mutable state with each other
+  /// except through thread safe structures owned by App.
+  class Worker : public cb::Thread {
+    App &app;
+    unsigned id;
+
+    cb::SmartPointer<cb::Options> options;
+    cb::Event::Base base;
+    cb::Event::DNSBase dns;
+    cb::Event::Client client;
+    cb::SmartPointer<cb::SSLContext> sslCtx;
+
+    ArenaPool arenas; // Outlives the Transactions
+    Server server;
+    HTTP2Server http2;
+    UserManager userManager;
+    PresignedURLCache presignedURLs;
+    Thumbnailer thumbnailer;
+    Compressor compressor;
+    FileTable fileTable;
+    SQLTemplateCache sqlTemplates;
+    WriteFlusher writeFlusher;
+
+    std::vector<cb::SmartPointer<cb::Event::HTTP> > listeners;
+
+    unsigned dbConnections;
+    unsigned maxDBConnections;
+
+    cb::Mutex tasksLock;
+    std::vector<Task *> doneTasks;
+    cb::Event::Event *doneEvent;
+
+    std::vector<Responder *> retired;
+    cb::Event::Event *retireEvent;
+
+  public:
+    Worker(App &app, unsigned id);
+
+    App &getApp() {return app;}
+    unsigned getID() const {return id;}
+
+    cb::Options &getOptions();
+    cb::Event::Base &getEventBase() {return base;}
+    cb::Event::DNSBase &getEventDNS() {return dns;}
+    cb::Event::Client &getEventClient() {return client;}
+    const cb::SmartPointer<cb::SSLContext> &getSSLContext() {return sslCtx;}
+
+    ArenaPool &getArenaPool() {return arenas;}
+    Server &getServer() {return server;}
+    HTTP2Server &getHTTP2Server() {return http2;}
+    UserManager &getUserManager() {return userManager;}
+    PresignedURLCache &getPresignedURLs() {return presignedURLs;}
+    Thumbnailer &getThumbnailer() {return thumbnailer;}
+    Compressor &getCompressor() {return compressor;}
+    FileTable &getFileTable() {return fileTable;}
+    SQLTemplateCache &getSQLTemplates() {return sqlTemplates;}
+    WriteFlusher &getWriteFlusher() {return writeFlusher;}
+
+    void init(unsigned workers);
+    void listen(const cb::IPAddress &addr, bool secure, bool upload = false);
+    void accept(int fd, bool secure, bool upload = false);
+    static int bind(const cb::IPAddress &addr);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+
+    cb::SmartPointer<cb::MariaDB::EventDB> getDBConnection();
+    void releaseDBConnection();
+    unsigned getDBConnectionCount() const {return dbConnections;}
+
+    /// Offload @param task to the App's TaskPool or run it inline.  Takes
+    /// ownership.
+    void submit(Task *task);
+    /// Thread safe.  Takes ownership of @param task back from the TaskPool.
+    void taskDone(Task *task);
+    void tasksEvent(cb::Event::Event &e, int signal, unsigned flags);
+
+    /// Call Responder::released() on @param responder from the event loop
+    void retire(Responder *responder);
+    void retiredEvent(cb::Event::Event &e, int signal, unsigned flags);
+
+    /// Thread safe
+    void loopExit();
+
+    // From cb::Thread
+    void run();
+  };
+}
+
+#endif // BUILDBOTICS_WORKER_H
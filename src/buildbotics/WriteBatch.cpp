@@ -0,0 +1,208 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "WriteBatch.h"
+#include "WriteFlusher.h"
+#include "App.h"
+
+#include <cbang/String.h>
+#include <cbang/Exception.h>
+#include <cbang/log/Logger.h>
+#include <cbang/util/DefaultCatch.h>
+#include <cbang/db/maria/EventDB.h>
+#include <cbang/json/JSON.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  // A derived table of the profile and object IDs of matching writes
+  string getRows(const WriteQueue::writes_t &writes, unsigned type, bool on,
+                 JSON::Dict &args) {
+    string rows;
+
+    for (unsigned i = 0; i < writes.size(); i++) {
+      const WriteQueue::Write &write = writes[i];
+      if (write.type != type || write.on != on) continue;
+
+      string n = String(i);
+      args.insert("user" + n, write.user);
+      args.insert("owner" + n, write.owner);
+
+      if (!rows.empty()) rows += " UNION ALL ";
+      rows += "SELECT GetProfileID(%(user" + n + ")s) profile, ";
+
+      if (type == WriteQueue::STAR) {
+        args.insert("thing" + n, write.thing);
+        rows += "GetThingID(%(owner" + n + ")s, %(thing" + n + ")s) object";
+
+      } else rows += "GetProfileID(%(owner" + n + ")s) object";
+    }
+
+    return rows;
+  }
+}
+
+
+WriteBatch::WriteBatch(App &app, const SmartPointer<MariaDB::EventDB> &db,
+                       WriteQueue::writes_t &writes, WriteFlusher *flusher) :
+  app(app), db(db), flusher(flusher), finished(false), next(0) {
+  this->writes.swap(writes);
+}
+
+
+void WriteBatch::flush() {
+  statements.clear();
+  statements.push_back("START TRANSACTION");
+  getStatements(*db, writes, statements);
+  statements.push_back("COMMIT");
+
+  next = 0;
+  db->query(this, &WriteBatch::flushCB, statements[next++]);
+}
+
+
+void WriteBatch::getStatements(MariaDB::DB &db,
+                               const WriteQueue::writes_t &writes,
+                               vector<string> &statements) {
+  const char *tables[][3] = {
+    {"stars", "profile_id", "thing_id"},
+    {"followers", "follower_id", "followed_id"},
+  };
+
+  JSON::Dict args;
+
+  for (unsigned type = WriteQueue::STAR; type <= WriteQueue::FOLLOW; type++)
+    for (unsigned on = 0; on < 2; on++) {
+      string rows = getRows(writes, type, on, args);
+      if (rows.empty()) continue;
+
+      string table = tables[type][0];
+      string profile = tables[type][1];
+      string object = tables[type][2];
+
+      // Rows already in the requested state are not touched, so no counter
+      // triggers fire for toggles which cancelled out
+      string sql;
+      if (on)
+        sql = "INSERT IGNORE INTO " + table + " (" + profile + ", " +
+          object + ") SELECT profile, object FROM (" + rows + ") w "
+          "WHERE profile IS NOT NULL AND object IS NOT NULL";
+
+      else sql = "DELETE x FROM " + table + " x INNER JOIN (" + rows +
+             ") w ON x." + profile + " = w.profile AND x." + object +
+             " = w.object";
+
+      statements.push_back(db.format(sql, args));
+    }
+}
+
+
+bool WriteBatch::flush(MariaDB::DB &db, const WriteQueue::writes_t &writes) {
+  vector<string> statements;
+  getStatements(db, writes, statements);
+
+  try {
+    db.query("START TRANSACTION");
+    for (unsigned i = 0; i < statements.size(); i++) db.query(statements[i]);
+    db.query("COMMIT");
+    return true;
+
+  } catch (const Exception &e) {
+    LOG_ERROR("Flushing " << writes.size() << " queued writes: " << e);
+  }
+
+  try {
+    db.query("ROLLBACK");
+  } CATCH_ERROR;
+
+  return false;
+}
+
+
+void WriteBatch::finish(App &app, const WriteQueue::writes_t &writes,
+                        bool success) {
+  app.getWriteQueue().done(writes, success);
+
+  if (success)
+    for (unsigned i = 0; i < writes.size(); i++)
+      if (writes[i].type == WriteQueue::STAR)
+        app.getThingCache().invalidate
+          (ThingCache::getKey(writes[i].owner, writes[i].thing),
+           ThingCache::THING | ThingCache::STARS);
+}
+
+
+void WriteBatch::flushCB(MariaDB::EventDBCallback::state_t state) {
+  switch (state) {
+  case MariaDB::EventDBCallback::EVENTDB_DONE:
+    if (next < statements.size())
+      db->query(this, &WriteBatch::flushCB, statements[next++]);
+    else done(true);
+    break;
+
+  case MariaDB::EventDBCallback::EVENTDB_ERROR:
+    LOG_ERROR("Flushing " << writes.size() << " queued writes: "
+              << db->getError());
+
+    // Release any row locks before the writes are retried
+    if (1 < next) db->query(this, &WriteBatch::rollbackCB, "ROLLBACK");
+    else done(false);
+    break;
+
+  default: break;
+  }
+}
+
+
+void WriteBatch::rollbackCB(MariaDB::EventDBCallback::state_t state) {
+  switch (state) {
+  case MariaDB::EventDBCallback::EVENTDB_DONE: done(false); break;
+
+  case MariaDB::EventDBCallback::EVENTDB_ERROR:
+    LOG_ERROR("Rolling back queued writes: " << db->getError());
+    done(false);
+    break;
+
+  default: break;
+  }
+}
+
+
+void WriteBatch::done(bool success) {
+  finished = true;
+  finish(app, writes, success);
+
+  if (flusher) flusher->batchDone(*this, success);
+  else app.writesFlushed(success);
+}
@@ -0,0 +1,101 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_WRITE_BATCH_H
+#define BUILDBOTICS_WRITE_BATCH_H
+
+#include "WriteQueue.h"
+
+#include <cbang/SmartPointer.h>
+#include <cbang/db/maria/EventDBCallback.h>
+
+#include <string>
+#include <vector>
+
+namespace cb {
+  namespace MariaDB {
+    class DB;
+    class EventDB;
+  }
+}
+
+
+namespace Buildbotics {
+  class App;
+  class WriteFlusher;
+
+  /// Writes taken from the WriteQueue flushed in one DB transaction of at
+  /// most four escaped multi-row statements.  Failed writes are returned to
+  /// the queue.
+  class WriteBatch {
+    App &app;
+    cb::SmartPointer<cb::MariaDB::EventDB> db;
+    WriteQueue::writes_t writes;
+    WriteFlusher *flusher;
+    bool finished;
+
+    std::vector<std::string> statements;
+    unsigned next;
+
+  public:
+    /// Takes the contents of @param writes.  Calls
+    /// WriteFlusher::batchDone() on @param flusher when done or
+    /// App::writesFlushed() if it is null.
+    WriteBatch(App &app, const cb::SmartPointer<cb::MariaDB::EventDB> &db,
+               WriteQueue::writes_t &writes, WriteFlusher *flusher = 0);
+
+    const WriteQueue::writes_t &getWrites() const {return writes;}
+    bool isDone() const {return finished;}
+
+    void flush();
+
+    /// Format the statements which write @param writes, without the
+    /// transaction.
+    static void getStatements(cb::MariaDB::DB &db,
+                              const WriteQueue::writes_t &writes,
+                              std::vector<std::string> &statements);
+    /// Write @param writes on the blocking connection @param db.  Used at
+    /// shutdown after the event loops have stopped.  @return true on success
+    static bool flush(cb::MariaDB::DB &db, const WriteQueue::writes_t &writes);
+    /// Finish @param writes in the WriteQueue and the ThingCache
+    static void finish(App &app, const WriteQueue::writes_t &writes,
+                       bool success);
+
+    // MariaDB::EventDB callbacks
+    void flushCB(cb::MariaDB::EventDBCallback::state_t state);
+    void rollbackCB(cb::MariaDB::EventDBCallback::state_t state);
+
+  protected:
+    void done(bool success);
+  };
+}
+
+#endif // BUILDBOTICS_WRITE_BATCH_H
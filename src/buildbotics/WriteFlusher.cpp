@@ -0,0 +1,156 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "WriteFlusher.h"
+#include "WriteBatch.h"
+#include "Worker.h"
+#include "App.h"
+#include "Transaction.h"
+
+#include <cbang/event/Event.h>
+#include <cbang/json/Writer.h>
+#include <cbang/db/maria/EventDB.h>
+
+#include <set>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+WriteFlusher::WriteFlusher(Worker &worker) :
+  worker(worker),
+  wakeEvent(&worker.getEventBase().newEvent(this, &WriteFlusher::wakeEventCB))
+{}
+
+
+void WriteFlusher::init() {
+  worker.getApp().getWriteQueue().addListener(this);
+}
+
+
+void WriteFlusher::shutdown() {
+  worker.getApp().getWriteQueue().removeListener(this);
+}
+
+
+bool WriteFlusher::flush(Transaction &tx, const string &user) {
+  WriteQueue &queue = worker.getApp().getWriteQueue();
+  if (!queue.hasPending(user)) return false;
+
+  // Before take() so a refused connection leaves the writes queued
+  SmartPointer<MariaDB::EventDB> db = worker.getDBConnection();
+
+  WriteQueue::writes_t writes;
+  bool inFlight = queue.take(user, writes);
+
+  if (!writes.empty()) {
+    batches.push_back(new WriteBatch(worker.getApp(), db, writes, this));
+    batches.back()->flush();
+
+  } else {
+    worker.releaseDBConnection();
+
+    // Otherwise woken when another batch is done
+    if (!inFlight) return false;
+  }
+
+  waiters[&tx] = user;
+
+  return true;
+}
+
+
+void WriteFlusher::cancel(Transaction &tx) {
+  waiters.erase(&tx);
+}
+
+
+void WriteFlusher::batchDone(WriteBatch &batch, bool success) {
+  worker.releaseDBConnection();
+  if (success) return; // Waiters are woken by writesDone()
+
+  // The writes were queued again, fail their waiters rather than retry
+  const WriteQueue::writes_t &writes = batch.getWrites();
+  set<string> users;
+  for (unsigned i = 0; i < writes.size(); i++) users.insert(writes[i].user);
+
+  vector<Transaction *> failed;
+  for (waiters_t::iterator it = waiters.begin(); it != waiters.end();)
+    if (users.count(it->second)) {
+      failed.push_back(it->first);
+      waiters.erase(it++);
+
+    } else it++;
+
+  for (unsigned i = 0; i < failed.size(); i++)
+    failed[i]->writesFlushed(false);
+}
+
+
+void WriteFlusher::takeUnfinished(WriteQueue::writes_t &writes) {
+  for (list<SmartPointer<WriteBatch> >::iterator it = batches.begin();
+       it != batches.end(); it++)
+    if (!(*it)->isDone())
+      writes.insert(writes.end(), (*it)->getWrites().begin(),
+                    (*it)->getWrites().end());
+
+  batches.clear(); // Closes their connections
+}
+
+
+void WriteFlusher::writeStats(JSON::Writer &writer) const {
+  writer.beginDict();
+  writer.insert("batches", batches.size());
+  writer.insert("waiters", waiters.size());
+  writer.endDict();
+}
+
+
+void WriteFlusher::writesDone() {
+  wakeEvent->activate();
+}
+
+
+void WriteFlusher::wakeEventCB(Event::Event &e, int signal, unsigned flags) {
+  // Batches are freed here, never from their own callbacks
+  for (list<SmartPointer<WriteBatch> >::iterator it = batches.begin();
+       it != batches.end();)
+    if ((*it)->isDone()) batches.erase(it++);
+    else it++;
+
+  // Waiters flush again or dispatch their request
+  waiters_t woken;
+  woken.swap(waiters);
+
+  for (waiters_t::iterator it = woken.begin(); it != woken.end(); it++)
+    it->first->writesFlushed(true);
+}
@@ -0,0 +1,95 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_WRITE_FLUSHER_H
+#define BUILDBOTICS_WRITE_FLUSHER_H
+
+#include "WriteQueue.h"
+
+#include <cbang/SmartPointer.h>
+
+#include <string>
+#include <list>
+#include <map>
+
+namespace cb {
+  namespace Event {class Event;}
+  namespace JSON {class Writer;}
+}
+
+
+namespace Buildbotics {
+  class Worker;
+  class Transaction;
+  class WriteBatch;
+
+  /// Flushes a user's queued writes before their reads.  Owns the
+  /// WriteBatches it starts and wakes waiting Transactions when any writes
+  /// are done, including ones flushed by other threads.  Not thread safe,
+  /// each Worker has its own.
+  class WriteFlusher : public WriteQueue::Listener {
+    Worker &worker;
+
+    std::list<cb::SmartPointer<WriteBatch> > batches;
+
+    typedef std::map<Transaction *, std::string> waiters_t;
+    waiters_t waiters;
+
+    cb::Event::Event *wakeEvent;
+
+  public:
+    WriteFlusher(Worker &worker);
+
+    void init();
+    /// Called before the App's WriteQueue is freed
+    void shutdown();
+
+    /// Start flushing @param user's queued writes.  @return true if
+    /// Transaction::writesFlushed() will be called on @param tx.
+    bool flush(Transaction &tx, const std::string &user);
+    /// Stop waiting for @param tx.  Called when it is freed.
+    void cancel(Transaction &tx);
+    void batchDone(WriteBatch &batch, bool success);
+    /// Free the batches still in flight and add their writes to
+    /// @param writes.  Called after the Worker's event loop has stopped.
+    void takeUnfinished(WriteQueue::writes_t &writes);
+
+    void writeStats(cb::JSON::Writer &writer) const;
+
+    // From WriteQueue::Listener
+    void writesDone();
+
+  protected:
+    void wakeEventCB(cb::Event::Event &e, int signal, unsigned flags);
+  };
+}
+
+#endif // BUILDBOTICS_WRITE_FLUSHER_H
@@ -0,0 +1,174 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#include "WriteQueue.h"
+
+#include <cbang/String.h>
+#include <cbang/json/Writer.h>
+
+using namespace std;
+using namespace cb;
+using namespace Buildbotics;
+
+
+namespace {
+  string getUserKey(const string &user) {
+    // Names are case insensitive in the DB
+    return String::toLower(user) + '\0';
+  }
+}
+
+
+string WriteQueue::Write::getKey() const {
+  return getUserKey(user) + String(type) + ':' + String::toLower(owner) +
+    '/' + String::toLower(thing);
+}
+
+
+WriteQueue::WriteQueue() :
+  enabled(false), queued(0), coalesced(0), flushed(0), failures(0) {}
+
+
+void WriteQueue::init(bool enabled) {
+  SmartLock lock(this);
+  this->enabled = enabled;
+}
+
+
+void WriteQueue::addListener(Listener *listener) {
+  SmartLock lock(this);
+  listeners.insert(listener);
+}
+
+
+void WriteQueue::removeListener(Listener *listener) {
+  SmartLock lock(this);
+  listeners.erase(listener);
+}
+
+
+void WriteQueue::add(const Write &write) {
+  SmartLock lock(this);
+
+  string key = write.getKey();
+  pending_t::iterator it = pending.find(key);
+  queued++;
+
+  if (it == pending.end()) {
+    pending.insert(pending_t::value_type(key, write));
+    users[getUserKey(write.user)]++;
+
+  } else {
+    it->second.on = write.on;
+    coalesced++;
+  }
+}
+
+
+bool WriteQueue::hasPending(const string &user) {
+  SmartLock lock(this);
+  return users.find(getUserKey(user)) != users.end();
+}
+
+
+void WriteQueue::take(writes_t &writes, unsigned max) {
+  SmartLock lock(this);
+
+  pending_t::iterator it = pending.begin();
+  while (it != pending.end() && writes.size() < max)
+    if (inFlight.find(it->first) == inFlight.end()) take(it++, writes);
+    else it++;
+}
+
+
+bool WriteQueue::take(const string &user, writes_t &writes) {
+  SmartLock lock(this);
+
+  string userKey = getUserKey(user);
+  pending_t::iterator it = pending.lower_bound(userKey);
+
+  while (it != pending.end() &&
+         !it->first.compare(0, userKey.length(), userKey))
+    if (inFlight.find(it->first) == inFlight.end()) take(it++, writes);
+    else it++;
+
+  // Counts the writes just taken and those held by other batches
+  users_t::iterator uit = users.find(userKey);
+  return uit != users.end() && writes.size() < uit->second;
+}
+
+
+void WriteQueue::done(const writes_t &writes, bool success) {
+  SmartLock lock(this);
+
+  if (success) flushed += writes.size();
+  else failures++;
+
+  for (unsigned i = 0; i < writes.size(); i++) {
+    string key = writes[i].getKey();
+    string userKey = getUserKey(writes[i].user);
+    inFlight.erase(key);
+
+    // Retry unless a newer write for the same object replaced it
+    if (!success && pending.find(key) == pending.end()) {
+      pending.insert(pending_t::value_type(key, writes[i]));
+      continue;
+    }
+
+    users_t::iterator it = users.find(userKey);
+    if (it != users.end() && !--it->second) users.erase(it);
+  }
+
+  for (set<Listener *>::iterator it = listeners.begin();
+       it != listeners.end(); it++)
+    (*it)->writesDone();
+}
+
+
+void WriteQueue::writeStats(JSON::Writer &writer) {
+  SmartLock lock(this);
+
+  writer.beginDict();
+  writer.insert("pending", pending.size());
+  writer.insert("in_flight", inFlight.size());
+  writer.insert("queued", queued);
+  writer.insert("coalesced", coalesced);
+  writer.insert("flushed", flushed);
+  writer.insert("failures", failures);
+  writer.endDict();
+}
+
+
+void WriteQueue::take(pending_t::iterator it, writes_t &writes) {
+  writes.push_back(it->second);
+  inFlight.insert(it->first);
+  pending.erase(it);
+}
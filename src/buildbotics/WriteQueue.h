@@ -0,0 +1,133 @@
+/******************************************************************************\
+
+                 This file is part of the Buildbotics Webserver.
+
+                Copyright (c) 2014-2015, Cauldron Development LLC
+                               All rights reserved.
+
+        The Buildbotics Webserver is free software: you can redistribute
+        it and/or modify it under the terms of the GNU General Public
+        License as published by the Free Software Foundation, either
+        version 2 of the License, or (at your option) any later version.
+
+        The Buildbotics Webserver is distributed in the hope that it will
+        be useful, but WITHOUT ANY WARRANTY; without even the implied
+        warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+        PURPOSE.  See the GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this software.  If not, see
+        <http://www.gnu.org/licenses/>.
+
+        In addition, BSD licensing may be granted on a case by case basis
+        by written permission from at least one of the copyright holders.
+        You may request written permission by emailing the authors.
+
+                For information regarding this software email:
+                               Joseph Coffland
+                        joseph@cauldrondevelopment.com
+
+\******************************************************************************/
+
+#ifndef BUILDBOTICS_WRITE_QUEUE_H
+#define BUILDBOTICS_WRITE_QUEUE_H
+
+#include <cbang/StdTypes.h>
+#include <cbang/os/Mutex.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+namespace cb {namespace JSON {class Writer;}}
+
+
+namespace Buildbotics {
+  /// Star and follow toggles shared by all Workers and written to the DB in
+  /// batches.  Only the last state requested for each user and object is
+  /// kept so repeated toggles collapse into at most one write.  The flush
+  /// statements are idempotent so a state which matches the DB changes no
+  /// rows and fires no counter triggers.
+  ///
+  /// A write is in flight from take() until done().  Writes in flight are
+  /// not taken again so two batches never race on the same object.
+  class WriteQueue : public cb::Mutex {
+  public:
+    enum {
+      STAR,
+      FOLLOW
+    };
+
+    /// Told, on the thread which finished them, when writes are done
+    class Listener {
+    public:
+      virtual ~Listener() {}
+      virtual void writesDone() = 0;
+    };
+
+    struct Write {
+      unsigned type;
+      std::string user;
+      std::string owner; // The followed profile for FOLLOW
+      std::string thing; // Empty for FOLLOW
+      bool on;
+
+      Write(unsigned type, const std::string &user, const std::string &owner,
+            const std::string &thing, bool on) :
+        type(type), user(user), owner(owner), thing(thing), on(on) {}
+
+      std::string getKey() const;
+    };
+
+    typedef std::vector<Write> writes_t;
+
+  protected:
+    bool enabled;
+
+    typedef std::map<std::string, Write> pending_t;
+    pending_t pending; // Ordered by user
+    std::set<std::string> inFlight;
+
+    // Pending and in flight writes per user
+    typedef std::map<std::string, unsigned> users_t;
+    users_t users;
+
+    std::set<Listener *> listeners;
+
+    uint64_t queued;
+    uint64_t coalesced;
+    uint64_t flushed;
+    uint64_t failures;
+
+  public:
+    WriteQueue();
+
+    void init(bool enabled);
+    bool isEnabled() const {return enabled;}
+
+    void addListener(Listener *listener);
+    void removeListener(Listener *listener);
+
+    void add(const Write &write);
+    bool hasPending(const std::string &user);
+
+    /// Take at most @param max pending writes
+    void take(writes_t &writes, unsigned max);
+
+    /// Take the pending writes of @param user
+    /// @return True if more of the user's writes are still in flight
+    bool take(const std::string &user, writes_t &writes);
+
+    /// Finish writes from take().  Failed writes are queued again unless
+    /// newer ones replaced them.  Tells all Listeners.
+    void done(const writes_t &writes, bool success);
+
+    void writeStats(cb::JSON::Writer &writer);
+
+  protected:
+    void take(pending_t::iterator it, writes_t &writes);
+  };
+}
+
+#endif // BUILDBOTICS_WRITE_QUEUE_H
@@ -395,10 +395,25 @@ END;
 
 CREATE PROCEDURE GetProfileByID(IN _profile_id INT)
 BEGIN
+  -- Includes counter changes not yet rolled up
   SELECT name, FormatTS(joined) joined, FormatTS(lastseen) lastseen, fullname,
-    location, url, bio, points, followers, following, stars, badges, comments
-    FROM profiles
-    WHERE id = _profile_id AND NOT disabled;
+    location, url, bio, p.points + IFNULL(c.points, 0) points,
+    p.followers + IFNULL(c.followers, 0) followers,
+    p.following + IFNULL(c.following, 0) following,
+    p.stars + IFNULL(c.stars, 0) stars, badges,
+    p.comments + IFNULL(c.comments, 0) comments
+    FROM profiles p
+    LEFT JOIN (
+      SELECT profile_id, CAST(SUM(points) AS SIGNED) points,
+        CAST(SUM(followers) AS SIGNED) followers,
+        CAST(SUM(following) AS SIGNED) following,
+        CAST(SUM(stars) AS SIGNED) stars,
+        CAST(SUM(comments) AS SIGNED) comments
+        FROM profile_counters
+        WHERE profile_id = _profile_id
+        GROUP BY profile_id) c
+    ON c.profile_id = p.id
+    WHERE p.id = _profile_id AND NOT disabled;
 
   IF FOUND_ROWS() != 1 THEN
     SIGNAL SQLSTATE '02000' -- ER_SIGNAL_NOT_FOUND
@@ -565,6 +580,7 @@ BEGIN
   START TRANSACTION;
 
   -- Profiles
+  UPDATE profile_counters SET stars = 0;
   UPDATE profiles SET stars = 0;
   UPDATE profiles p
     INNER JOIN (
@@ -574,6 +590,7 @@ BEGIN
     SET p.stars = s.cnt;
 
   -- Things
+  UPDATE thing_counters SET stars = 0;
   UPDATE things SET stars = 0;
   UPDATE things t
     INNER JOIN (
@@ -729,16 +746,26 @@ BEGIN
     VALUES (_thing_id, _user)
     ON DUPLICATE KEY UPDATE thing_id = thing_id;
 
-  -- Thing
+  -- Thing, including counter changes not yet rolled up
   SELECT t.name, _owner owner, o.points owner_points, t.type, t.title,
     IF(t.published IS null, null, FormatTS(t.published)) published,
     FormatTS(t.created) created, FormatTS(t.modified) modified,
-    t.tags, t.instructions, t.comments, t.stars, t.children, t.views,
-    t.downloads, t.license, l.url license_url,
-    CONCAT(p.name, '/', parent.name) parent
+    t.tags, t.instructions, t.comments + IFNULL(c.comments, 0) comments,
+    t.stars + IFNULL(c.stars, 0) stars, t.children,
+    t.views + IFNULL(c.views, 0) views,
+    t.downloads + IFNULL(c.downloads, 0) downloads, t.license,
+    l.url license_url, CONCAT(p.name, '/', parent.name) parent
 
     FROM things t
 
+    LEFT JOIN (
+      SELECT thing_id, CAST(SUM(comments) AS SIGNED) comments,
+        CAST(SUM(stars) AS SIGNED) stars, CAST(SUM(views) AS SIGNED) views,
+        CAST(SUM(downloads) AS SIGNED) downloads
+        FROM thing_counters
+        WHERE thing_id = _thing_id
+        GROUP BY thing_id) c
+    ON c.thing_id = t.id
     LEFT JOIN things parent ON parent.id = t.parent_id
     LEFT JOIN profiles p ON p.id = parent.owner_id
     LEFT JOIN profiles o ON o.id = _owner_id
@@ -1164,6 +1191,7 @@ BEGIN
   START TRANSACTION;
 
   -- Profiles
+  UPDATE profile_counters SET comments = 0;
   UPDATE profiles SET comments = 0;
   UPDATE profiles p
     INNER JOIN (
@@ -1174,6 +1202,7 @@ BEGIN
     SET p.comments = c.cnt;
 
   -- Things
+  UPDATE thing_counters SET comments = 0;
   UPDATE things SET comments = 0;
   UPDATE things t
     INNER JOIN (
@@ -1243,7 +1272,8 @@ END;
 
 CREATE PROCEDURE UploadFile(IN _owner VARCHAR(64), IN _thing VARCHAR(64),
   IN _name VARCHAR(256), IN _type VARCHAR(64),
-  IN _space INT, IN _path VARCHAR(256), IN _caption VARCHAR(256),
+  IN _space BIGINT UNSIGNED, IN _path VARCHAR(256),
+  IN _caption VARCHAR(256),
   IN _visibility VARCHAR(8))
 BEGIN
   DECLARE EXIT HANDLER FOR SQLSTATE '23000' BEGIN
@@ -1266,6 +1296,90 @@ BEGIN
 END;
 
 
+CREATE PROCEDURE StartMultipartUpload(IN _owner VARCHAR(64),
+  IN _thing VARCHAR(64), IN _name VARCHAR(256), IN _type VARCHAR(64),
+  IN _space BIGINT UNSIGNED, IN _path VARCHAR(256),
+  IN _caption VARCHAR(256),
+  IN _visibility VARCHAR(8), IN _upload_id VARCHAR(256))
+BEGIN
+  CALL UploadFile(_owner, _thing, _name, _type, _space, _path, _caption,
+    _visibility);
+
+  INSERT INTO multipart_uploads (upload_id, path) VALUES (_upload_id, _path);
+END;
+
+
+CREATE PROCEDURE GetMultipartUpload(IN _owner VARCHAR(64),
+  IN _thing VARCHAR(64), IN _name VARCHAR(256), IN _upload_id VARCHAR(256))
+BEGIN
+  DECLARE _path VARCHAR(256);
+  DECLARE _space BIGINT UNSIGNED;
+
+  SELECT m.path, f.space INTO _path, _space FROM multipart_uploads m
+    JOIN files f ON f.path = m.path
+    WHERE m.upload_id = _upload_id AND
+      f.thing_id = GetThingID(_owner, _thing) AND f.name = _name;
+
+  IF _path IS null THEN
+    SIGNAL SQLSTATE '02000' -- ER_SIGNAL_NOT_FOUND
+      SET MESSAGE_TEXT = 'Upload not found';
+  ELSE
+    SELECT _path path, _space size;
+  END IF;
+END;
+
+
+CREATE PROCEDURE CompleteMultipartUpload(IN _owner VARCHAR(64),
+  IN _thing VARCHAR(64), IN _name VARCHAR(256), IN _upload_id VARCHAR(256))
+BEGIN
+  DELETE FROM multipart_uploads WHERE upload_id = _upload_id;
+  CALL ConfirmFile(_owner, _thing, _name);
+END;
+
+
+CREATE PROCEDURE AbortMultipartUpload(IN _owner VARCHAR(64),
+  IN _thing VARCHAR(64), IN _name VARCHAR(256), IN _upload_id VARCHAR(256))
+BEGIN
+  DELETE FROM multipart_uploads WHERE upload_id = _upload_id;
+  CALL DeleteFile(_owner, _thing, _name);
+END;
+
+
+-- Returns uploads old enough that their files were removed by Maintenance()
+-- and marks them aborting.  The caller aborts them in S3 and then calls
+-- AbortedMultipartUploads().  The rows are locked while claimed so
+-- concurrent callers never return the same upload.  Claims older than an
+-- hour are retried.
+CREATE PROCEDURE ClaimAbandonedMultipartUploads()
+BEGIN
+  DECLARE _cutoff TIMESTAMP;
+  SET _cutoff = now() - INTERVAL 6 hour;
+
+  DROP TEMPORARY TABLE IF EXISTS abandoned_uploads;
+  CREATE TEMPORARY TABLE abandoned_uploads (
+    upload_id VARCHAR(256) NOT NULL,
+    path      VARCHAR(256) NOT NULL
+  );
+
+  START TRANSACTION;
+
+  INSERT INTO abandoned_uploads
+    SELECT upload_id, path FROM multipart_uploads
+    WHERE created < _cutoff AND
+      (aborting IS null OR aborting < now() - INTERVAL 1 hour)
+    FOR UPDATE;
+
+  UPDATE multipart_uploads m
+    JOIN abandoned_uploads a ON a.upload_id = m.upload_id
+    SET m.aborting = now();
+
+  COMMIT;
+
+  SELECT upload_id, path FROM abandoned_uploads;
+  DROP TEMPORARY TABLE abandoned_uploads;
+END;
+
+
 CREATE PROCEDURE UpdateFile(IN _owner VARCHAR(64), IN _thing VARCHAR(64),
   IN _name VARCHAR(256), IN _caption VARCHAR(256),
   IN _visibility VARCHAR(8), IN _rename VARCHAR(256))
@@ -1411,6 +1525,7 @@ BEGIN
   START TRANSACTION;
 
   -- Things
+  UPDATE thing_counters SET downloads = 0;
   UPDATE things SET downloads = 0;
   UPDATE things t
     INNER JOIN (
@@ -1654,6 +1769,124 @@ BEGIN
 END;
 
 
+-- Counters
+CREATE FUNCTION CounterSlot()
+RETURNS TINYINT UNSIGNED
+NOT DETERMINISTIC
+NO SQL
+BEGIN
+  -- Concurrent changes to one object's counters come from different
+  -- connections so they rarely wait on each other.  Unlike RAND() this is
+  -- replayed identically by statement based replication.
+  RETURN CONNECTION_ID() % 16;
+END;
+
+
+CREATE PROCEDURE AddProfileCounts(IN _profile_id INT, IN _points INT,
+  IN _followers INT, IN _following INT, IN _stars INT, IN _comments INT,
+  IN _space BIGINT)
+BEGIN
+  INSERT INTO profile_counters
+    (profile_id, slot, points, followers, following, stars, comments, space)
+    VALUES (_profile_id, CounterSlot(), _points, _followers, _following,
+      _stars, _comments, _space)
+    ON DUPLICATE KEY UPDATE
+      points = points + VALUES(points),
+      followers = followers + VALUES(followers),
+      following = following + VALUES(following),
+      stars = stars + VALUES(stars),
+      comments = comments + VALUES(comments),
+      space = space + VALUES(space);
+END;
+
+
+CREATE PROCEDURE AddThingCounts(IN _thing_id INT, IN _comments INT,
+  IN _stars INT, IN _views INT, IN _downloads INT, IN _space BIGINT)
+BEGIN
+  INSERT INTO thing_counters
+    (thing_id, slot, comments, stars, views, downloads, space)
+    VALUES (_thing_id, CounterSlot(), _comments, _stars, _views, _downloads,
+      _space)
+    ON DUPLICATE KEY UPDATE
+      comments = comments + VALUES(comments),
+      stars = stars + VALUES(stars),
+      views = views + VALUES(views),
+      downloads = downloads + VALUES(downloads),
+      space = space + VALUES(space);
+END;
+
+
+CREATE PROCEDURE RollupCounters()
+BEGIN
+  START TRANSACTION;
+
+  -- Things first, their space changes add to profile_counters
+  CREATE TEMPORARY TABLE thingRollupTable
+    SELECT thing_id, slot, comments, stars, views, downloads, space
+      FROM thing_counters;
+
+  UPDATE things t
+    INNER JOIN (
+      SELECT thing_id, SUM(comments) comments, SUM(stars) stars,
+        SUM(views) views, SUM(downloads) downloads, SUM(space) space
+        FROM thingRollupTable
+        GROUP BY thing_id) r
+    ON t.id = r.thing_id
+    SET t.comments = t.comments + r.comments, t.stars = t.stars + r.stars,
+      t.views = t.views + r.views, t.downloads = t.downloads + r.downloads,
+      t.space = t.space + r.space;
+
+  -- Subtract what was applied, keeping changes made since it was read
+  UPDATE thing_counters c
+    INNER JOIN thingRollupTable r
+    ON c.thing_id = r.thing_id AND c.slot = r.slot
+    SET c.comments = c.comments - r.comments, c.stars = c.stars - r.stars,
+      c.views = c.views - r.views, c.downloads = c.downloads - r.downloads,
+      c.space = c.space - r.space;
+
+  DELETE FROM thing_counters
+    WHERE comments = 0 AND stars = 0 AND views = 0 AND downloads = 0 AND
+      space = 0;
+
+  DROP TEMPORARY TABLE IF EXISTS thingRollupTable;
+
+  -- Profiles
+  CREATE TEMPORARY TABLE profileRollupTable
+    SELECT profile_id, slot, points, followers, following, stars, comments,
+      space
+      FROM profile_counters;
+
+  UPDATE profiles p
+    INNER JOIN (
+      SELECT profile_id, SUM(points) points, SUM(followers) followers,
+        SUM(following) following, SUM(stars) stars, SUM(comments) comments,
+        SUM(space) space
+        FROM profileRollupTable
+        GROUP BY profile_id) r
+    ON p.id = r.profile_id
+    SET p.points = p.points + r.points,
+      p.followers = p.followers + r.followers,
+      p.following = p.following + r.following, p.stars = p.stars + r.stars,
+      p.comments = p.comments + r.comments, p.space = p.space + r.space;
+
+  UPDATE profile_counters c
+    INNER JOIN profileRollupTable r
+    ON c.profile_id = r.profile_id AND c.slot = r.slot
+    SET c.points = c.points - r.points,
+      c.followers = c.followers - r.followers,
+      c.following = c.following - r.following, c.stars = c.stars - r.stars,
+      c.comments = c.comments - r.comments, c.space = c.space - r.space;
+
+  DELETE FROM profile_counters
+    WHERE points = 0 AND followers = 0 AND following = 0 AND stars = 0 AND
+      comments = 0 AND space = 0;
+
+  DROP TEMPORARY TABLE IF EXISTS profileRollupTable;
+
+  COMMIT;
+END;
+
+
 CREATE PROCEDURE Maintenance()
 BEGIN
   -- Clean thing views
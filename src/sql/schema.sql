@@ -74,6 +74,24 @@ CREATE TABLE IF NOT EXISTS profiles (
 );
 
 
+-- Pending changes to profile counters spread over CounterSlot() rows per
+-- profile and added to the profile by RollupCounters()
+CREATE TABLE IF NOT EXISTS profile_counters (
+  `profile_id` INT NOT NULL,
+  `slot`       TINYINT UNSIGNED NOT NULL,
+
+  `points`     INT NOT NULL DEFAULT 0,
+  `followers`  INT NOT NULL DEFAULT 0,
+  `following`  INT NOT NULL DEFAULT 0,
+  `stars`      INT NOT NULL DEFAULT 0,
+  `comments`   INT NOT NULL DEFAULT 0,
+  `space`      BIGINT NOT NULL DEFAULT 0,
+
+  PRIMARY KEY (`profile_id`, `slot`),
+  FOREIGN KEY (`profile_id`) REFERENCES profiles(id) ON DELETE CASCADE
+);
+
+
 CREATE TABLE IF NOT EXISTS profile_redirects (
   `old_profile` VARCHAR(64) NOT NULL,
   `new_profile` VARCHAR(64) NOT NULL,
@@ -305,6 +323,22 @@ CREATE TABLE IF NOT EXISTS thing_views (
 );
 
 
+-- Pending changes to thing counters, see profile_counters
+CREATE TABLE IF NOT EXISTS thing_counters (
+  `thing_id`  INT NOT NULL,
+  `slot`      TINYINT UNSIGNED NOT NULL,
+
+  `comments`  INT NOT NULL DEFAULT 0,
+  `stars`     INT NOT NULL DEFAULT 0,
+  `views`     INT NOT NULL DEFAULT 0,
+  `downloads` INT NOT NULL DEFAULT 0,
+  `space`     BIGINT NOT NULL DEFAULT 0,
+
+  PRIMARY KEY (`thing_id`, `slot`),
+  FOREIGN KEY (`thing_id`) REFERENCES things(id) ON DELETE CASCADE
+);
+
+
 CREATE TABLE IF NOT EXISTS stars (
   `profile_id` INT NOT NULL,
   `thing_id`   INT NOT NULL,
@@ -394,7 +428,7 @@ CREATE TABLE IF NOT EXISTS files (
   `thing_id`   INT NOT NULL,
   `name`       VARCHAR(80) NOT NULL,
   `type`       VARCHAR(64) NOT NULL,
-  `space`      INT NOT NULL,
+  `space`      BIGINT UNSIGNED NOT NULL,
   `path`       VARCHAR(256) NOT NULL,
   `caption`    VARCHAR(256),
   `visibility` VARCHAR(8) NOT NULL,
@@ -409,6 +443,17 @@ CREATE TABLE IF NOT EXISTS files (
 );
 
 
+CREATE TABLE IF NOT EXISTS multipart_uploads (
+  `upload_id`  VARCHAR(256) NOT NULL,
+  `path`       VARCHAR(256) NOT NULL,
+  `created`    TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  `aborting`   TIMESTAMP NULL DEFAULT NULL,
+
+  PRIMARY KEY (`upload_id`),
+  INDEX (`created`)
+);
+
+
 CREATE TABLE IF NOT EXISTS event_actions (
   name VARCHAR(16),
   PRIMARY KEY (name)
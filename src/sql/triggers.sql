@@ -17,9 +17,8 @@ BEGIN
 
   -- Space
   IF NEW.space != OLD.space THEN
-    UPDATE profiles
-      SET space = space + NEW.space - OLD.space
-      WHERE id = OLD.owner_id;
+    CALL AddProfileCounts(OLD.owner_id, 0, 0, 0, 0, 0,
+      CAST(NEW.space AS SIGNED) - CAST(OLD.space AS SIGNED));
   END IF;
 END;
 
@@ -38,9 +37,7 @@ DROP TRIGGER IF EXISTS InsertThingViews;
 CREATE TRIGGER InsertThingViews AFTER INSERT ON thing_views
 FOR EACH ROW
 BEGIN
-  UPDATE things
-    SET views = views + 1
-    WHERE id = NEW.thing_id;
+  CALL AddThingCounts(NEW.thing_id, 0, 0, 1, 0, 0);
 END;
 
 
@@ -53,12 +50,10 @@ BEGIN
   CALL Event(NEW.follower_id, 'follow', NEW.followed_id);
 
   -- Inc profile followers & points
-  UPDATE profiles SET followers = followers + 1, points = points + 25
-    WHERE id = NEW.followed_id;
+  CALL AddProfileCounts(NEW.followed_id, 25, 1, 0, 0, 0, 0);
 
   -- Inc profile following
-  UPDATE profiles SET following = following + 1
-    WHERE id = NEW.follower_id;
+  CALL AddProfileCounts(NEW.follower_id, 0, 0, 1, 0, 0, 0);
 END;
 
 DROP TRIGGER IF EXISTS DeleteFollowers;
@@ -66,12 +61,10 @@ CREATE TRIGGER DeleteFollowers AFTER DELETE ON followers
 FOR EACH ROW
 BEGIN
   -- Dec profile followers
-  UPDATE profiles SET followers = followers - 1, points = points - 25
-    WHERE id = OLD.followed_id;
+  CALL AddProfileCounts(OLD.followed_id, -25, -1, 0, 0, 0, 0);
 
   -- Dec profile following
-  UPDATE profiles SET following = following - 1
-    WHERE id = OLD.follower_id;
+  CALL AddProfileCounts(OLD.follower_id, 0, 0, -1, 0, 0, 0);
 END;
 
 
@@ -123,11 +116,11 @@ BEGIN
   CALL Event(NEW.profile_id, 'star', NEW.thing_id);
 
   -- Inc profile stars & points
-  UPDATE profiles SET stars = stars + 1, points = points + 10
-    WHERE id = (SELECT owner_id FROM things WHERE id = NEW.thing_id);
+  CALL AddProfileCounts((SELECT owner_id FROM things WHERE id = NEW.thing_id),
+    10, 0, 0, 1, 0, 0);
 
   -- Inc thing stars
-  UPDATE things SET stars = stars + 1 WHERE id = NEW.thing_id;
+  CALL AddThingCounts(NEW.thing_id, 0, 1, 0, 0, 0);
 END;
 
 DROP TRIGGER IF EXISTS DeleteStars;
@@ -135,9 +128,11 @@ CREATE TRIGGER DeleteStars AFTER DELETE ON stars
 FOR EACH ROW
 BEGIN
   -- Dec profile stars
-  UPDATE profiles SET stars = stars - 1, points = points - 10
-    WHERE id = (SELECT owner_id FROM things WHERE id = OLD.thing_id);
-  UPDATE things SET stars = stars - 1 WHERE id = OLD.thing_id;
+  CALL AddProfileCounts((SELECT owner_id FROM things WHERE id = OLD.thing_id),
+    -10, 0, 0, -1, 0, 0);
+
+  -- Dec thing stars
+  CALL AddThingCounts(OLD.thing_id, 0, -1, 0, 0, 0);
 END;
 
 
@@ -150,10 +145,10 @@ BEGIN
   CALL Event(NEW.owner_id, 'comment', NEW.id);
 
   -- Inc profile comments
-  UPDATE profiles SET comments = comments + 1 WHERE id = NEW.owner_id;
+  CALL AddProfileCounts(NEW.owner_id, 0, 0, 0, 0, 1, 0);
 
   -- Inc thing comments
-  UPDATE things SET comments = comments + 1 WHERE id = NEW.thing_id;
+  CALL AddThingCounts(NEW.thing_id, 1, 0, 0, 0, 0);
 END;
 
 DROP TRIGGER IF EXISTS UpdateComments;
@@ -162,42 +157,38 @@ FOR EACH ROW
 BEGIN
   -- Profile points
   IF NEW.upvotes != OLD.upvotes OR NEW.downvotes != OLD.downvotes THEN
-    UPDATE profiles
-      SET points = points - OLD.upvotes + NEW.upvotes +
-        OLD.downvotes - NEW.downvotes
-      WHERE id = NEW.owner_id;
+    CALL AddProfileCounts(NEW.owner_id, NEW.upvotes - OLD.upvotes +
+      OLD.downvotes - NEW.downvotes, 0, 0, 0, 0, 0);
   END IF;
 
   -- Deleted comments
   IF NOT OLD.deleted AND NEW.deleted THEN
     -- Profile points
     IF OLD.upvotes OR OLD.downvotes THEN
-      UPDATE profiles
-        SET points = points - OLD.upvotes + OLD.downvotes
-        WHERE id = OLD.owner_id;
+      CALL AddProfileCounts(OLD.owner_id, OLD.downvotes - OLD.upvotes,
+        0, 0, 0, 0, 0);
     END IF;
 
     -- Dec profile comments
-    UPDATE profiles SET comments = comments - 1 WHERE id = OLD.owner_id;
+    CALL AddProfileCounts(OLD.owner_id, 0, 0, 0, 0, -1, 0);
 
     -- Dec thing comments
-    UPDATE things SET comments = comments - 1 WHERE id = OLD.thing_id;
+    CALL AddThingCounts(OLD.thing_id, -1, 0, 0, 0, 0);
   END IF;
 
   -- Undeleted comments
   IF OLD.deleted AND NOT NEW.deleted THEN
     -- Profile points
     IF OLD.upvotes OR OLD.downvotes THEN
-      UPDATE profiles
-        SET points = points + OLD.upvotes - OLD.downvotes
-        WHERE id = OLD.owner_id;
+      CALL AddProfileCounts(OLD.owner_id, OLD.upvotes - OLD.downvotes,
+        0, 0, 0, 0, 0);
     END IF;
 
     -- Inc profile comments
-    UPDATE profiles SET comments = comments + 1 WHERE id = OLD.owner_id;
+    CALL AddProfileCounts(OLD.owner_id, 0, 0, 0, 0, 1, 0);
 
     -- Inc thing comments
-    UPDATE things SET comments = comments + 1 WHERE id = OLD.thing_id;
+    CALL AddThingCounts(OLD.thing_id, 1, 0, 0, 0, 0);
   END IF;
 END;
 
@@ -208,16 +199,15 @@ BEGIN
   IF NOT OLD.deleted THEN
     -- Profile points
     IF OLD.upvotes OR OLD.downvotes THEN
-      UPDATE profiles
-        SET points = points - OLD.upvotes + OLD.downvotes
-        WHERE id = OLD.owner_id;
+      CALL AddProfileCounts(OLD.owner_id, OLD.downvotes - OLD.upvotes,
+        0, 0, 0, 0, 0);
     END IF;
 
     -- Dec profile comments
-    UPDATE profiles SET comments = comments - 1 WHERE id = OLD.owner_id;
+    CALL AddProfileCounts(OLD.owner_id, 0, 0, 0, 0, -1, 0);
 
     -- Dec thing comments
-    UPDATE things SET comments = comments - 1 WHERE id = OLD.thing_id;
+    CALL AddThingCounts(OLD.thing_id, -1, 0, 0, 0, 0);
   END IF;
 END;
 
@@ -235,7 +225,7 @@ BEGIN
     UPDATE comments SET downvotes = downvotes + 1 WHERE id = NEW.comment_id;
 
     -- Profile points
-    UPDATE profiles SET points = points - 1 WHERE id = NEW.profile_id;
+    CALL AddProfileCounts(NEW.profile_id, -1, 0, 0, 0, 0, 0);
   END IF;
 END;
 
@@ -252,10 +242,10 @@ BEGIN
 
   -- Profile points
   IF NEW.vote = -1 THEN
-    UPDATE profiles SET points = points - 1 WHERE id = NEW.profile_id;
+    CALL AddProfileCounts(NEW.profile_id, -1, 0, 0, 0, 0, 0);
   END IF;
   IF OLD.vote = -1 THEN
-    UPDATE profiles SET points = points + 1 WHERE id = NEW.profile_id;
+    CALL AddProfileCounts(NEW.profile_id, 1, 0, 0, 0, 0, 0);
   END IF;
 END;
 
@@ -314,12 +304,10 @@ CREATE TRIGGER AfterInsertFiles AFTER INSERT ON files
 FOR EACH ROW
 BEGIN
   -- Space & file count
-  UPDATE things
-    SET
-      space = space + NEW.space,
-      downloads = downloads + IF(NEW.visibility = 'display', 0, 1),
-      modified = CURRENT_TIMESTAMP
-    WHERE id = NEW.thing_id;
+  CALL AddThingCounts(NEW.thing_id, 0, 0, 0,
+    IF(NEW.visibility = 'display', 0, 1), NEW.space);
+
+  UPDATE things SET modified = CURRENT_TIMESTAMP WHERE id = NEW.thing_id;
 END;
 
 
@@ -327,23 +315,15 @@ DROP TRIGGER IF EXISTS UpdateFiles;
 CREATE TRIGGER UpdateFiles AFTER UPDATE ON files
 FOR EACH ROW
 BEGIN
-  -- Space
-  IF NEW.space != OLD.space THEN
-    UPDATE things
-      SET
-        space = space + NEW.space - OLD.space,
-        modified = CURRENT_TIMESTAMP
-      WHERE id = OLD.thing_id;
-  END IF;
-
-  -- Visibility
-  IF NEW.visibility != OLD.visibility THEN
-    UPDATE things
-      SET
-        downloads = downloads + IF(NEW.visibility = 'display', -1,
-          IF(OLD.visibility = 'display', 1, 0)),
-        modified = CURRENT_TIMESTAMP
-      WHERE id = OLD.thing_id;
+  -- Space & visibility
+  IF NEW.space != OLD.space OR NEW.visibility != OLD.visibility THEN
+    CALL AddThingCounts(OLD.thing_id, 0, 0, 0,
+      IF(NEW.visibility = OLD.visibility, 0,
+        IF(NEW.visibility = 'display', -1,
+          IF(OLD.visibility = 'display', 1, 0))),
+      CAST(NEW.space AS SIGNED) - CAST(OLD.space AS SIGNED));
+
+    UPDATE things SET modified = CURRENT_TIMESTAMP WHERE id = OLD.thing_id;
   END IF;
 END;
 
@@ -352,11 +332,9 @@ DROP TRIGGER IF EXISTS DeleteFiles;
 CREATE TRIGGER DeleteFiles AFTER DELETE ON files
 FOR EACH ROW
 BEGIN
-  -- Space
-  UPDATE things
-    SET
-      space = space - OLD.space,
-      downloads = downloads - IF(OLD.visibility = 'display', 0, 1),
-      modified = CURRENT_TIMESTAMP
-    WHERE id = OLD.thing_id;
+  -- Space & file count
+  CALL AddThingCounts(OLD.thing_id, 0, 0, 0,
+    -IF(OLD.visibility = 'display', 0, 1), -CAST(OLD.space AS SIGNED));
+
+  UPDATE things SET modified = CURRENT_TIMESTAMP WHERE id = OLD.thing_id;
 END;
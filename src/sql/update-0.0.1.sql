@@ -0,0 +1,47 @@
+-- Multipart uploads may be larger than 2 GiB
+ALTER TABLE files MODIFY `space` BIGINT UNSIGNED NOT NULL;
+
+
+-- Tables added since 0.0.1, see schema.sql
+CREATE TABLE IF NOT EXISTS profile_counters (
+  `profile_id` INT NOT NULL,
+  `slot`       TINYINT UNSIGNED NOT NULL,
+
+  `points`     INT NOT NULL DEFAULT 0,
+  `followers`  INT NOT NULL DEFAULT 0,
+  `following`  INT NOT NULL DEFAULT 0,
+  `stars`      INT NOT NULL DEFAULT 0,
+  `comments`   INT NOT NULL DEFAULT 0,
+  `space`      BIGINT NOT NULL DEFAULT 0,
+
+  PRIMARY KEY (`profile_id`, `slot`),
+  FOREIGN KEY (`profile_id`) REFERENCES profiles(id) ON DELETE CASCADE
+);
+
+CREATE TABLE IF NOT EXISTS thing_counters (
+  `thing_id`  INT NOT NULL,
+  `slot`      TINYINT UNSIGNED NOT NULL,
+
+  `comments`  INT NOT NULL DEFAULT 0,
+  `stars`     INT NOT NULL DEFAULT 0,
+  `views`     INT NOT NULL DEFAULT 0,
+  `downloads` INT NOT NULL DEFAULT 0,
+  `space`     BIGINT NOT NULL DEFAULT 0,
+
+  PRIMARY KEY (`thing_id`, `slot`),
+  FOREIGN KEY (`thing_id`) REFERENCES things(id) ON DELETE CASCADE
+);
+
+CREATE TABLE IF NOT EXISTS multipart_uploads (
+  `upload_id`  VARCHAR(256) NOT NULL,
+  `path`       VARCHAR(256) NOT NULL,
+  `created`    TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  `aborting`   TIMESTAMP NULL DEFAULT NULL,
+
+  PRIMARY KEY (`upload_id`),
+  INDEX (`created`)
+);
+
+-- In case multipart_uploads was created from an older schema.sql
+ALTER TABLE multipart_uploads
+  ADD COLUMN IF NOT EXISTS `aborting` TIMESTAMP NULL DEFAULT NULL;
@@ -72,8 +72,8 @@ updates = sorted(updates)
 
 
 # Latest version
-if len(updates): latest = updates[-1]
-else: latest = (0, 0, 0)
+if len(updates): latest = updates[-1][0]
+else: latest = [0, 0, 0]
 
 
 # Update